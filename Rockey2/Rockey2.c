@@ -18,276 +18,1391 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
  */
 
-#include <stdio.h>
-#include <windows.h>
+#include "platform.h"
+#include "storage.h"
+#include "lock.h"
 #include "Rockey2.h"
 #include "crypto.h"
+#include "transform_cache.h"
+#include "flusher.h"
+#include "stats.h"
+#include "trace.h"
 
-#define RY2_MAX_DONGLES 32
-#define RY2_BLOCK_COUNT 5
+static const RY2_StorageBackend* Storage = NULL;
+#define RY2_WAIT_SLICE_MS 50
+#define RY2_SHARED_SPIN_LIMIT 65536 // Spins on one odd sequence before waiting for its lock
 
-static const HKEY RegRootKey = HKEY_CURRENT_USER;
-static const char* RegSubKey = "Software\\Rockey2\\Dongles";
-static const char* RegBlockName = "Block%d";
-static const char* const RegInfoNames[] = { "HID", "UID", "Version", "Protection" };
-static RY2_Dongle* Dongles = NULL;
-static int DongleCount = 0;
+static RY2_DongleTable EmptyTable = { 0 };
+static RY2_DongleTable* volatile Table = &EmptyTable;
+static volatile LONG TableEpoch = 0;
+static RY2_TableReaders TableReaders[2][RY2_TABLE_READER_STRIPES];
 static HANDLE ProcessHeap = NULL;
+static BOOL SharedImage = FALSE;
+static BOOL WriteBehind = FALSE;
+static BOOL DongleSetLoaded = FALSE;
+static RY2_ConfigShared* ConfigShared = NULL;
+static HANDLE ConfigMapping = NULL;
+static LONG ConfigGeneration = 0;
+static DWORD StorageStamp = 0; // Of the storage the open dongles were read from
 
-static void ReadRegDongleCountValue(void)
+/*
+ * Registers the calling thread as a reader of the current table, which then
+ * stays allocated until LeaveTable. The stripe is picked from the address of
+ * the thread's stack, so that threads seldom share a counter.
+ */
+static volatile LONG* EnterTable(void)
 {
-    const char* RegValueName = "Count";
-    HKEY regKey = NULL;
-    if ((RegCreateKeyEx(RegRootKey, RegSubKey, 0, NULL, REG_OPTION_NON_VOLATILE, KEY_WOW64_64KEY | KEY_READ | KEY_WRITE, NULL, &regKey, NULL) == ERROR_SUCCESS ||
-        RegOpenKeyEx(RegRootKey, RegSubKey, 0, KEY_WOW64_64KEY | KEY_READ, &regKey) == ERROR_SUCCESS) && regKey)
+    const BYTE stackMarker = 0;
+    const SIZE_T stripe = (((SIZE_T)&stackMarker >> 16) * 0x9E3779B1) >> 8;
+    for (;;)
     {
-        DWORD regType = REG_DWORD;
-        DWORD regSize = sizeof(DWORD);
-        LSTATUS regStatus = RegQueryValueEx(regKey, RegValueName, NULL, &regType, (LPBYTE)&DongleCount, &regSize);
-        if (!(regStatus == ERROR_SUCCESS && regType == REG_DWORD && regSize == sizeof(DWORD)) || DongleCount < 0 || DongleCount > RY2_MAX_DONGLES)
-        {
-            DongleCount = 0;
-            regType = REG_DWORD;
-            regSize = sizeof(DWORD);
-            regStatus = RegSetValueEx(regKey, RegValueName, 0, regType, (const LPBYTE)&DongleCount, regSize);
-        }
-        RegCloseKey(regKey);
+        const LONG epoch = TableEpoch;
+        volatile LONG* readers = &TableReaders[epoch & 1][stripe % RY2_TABLE_READER_STRIPES].count;
+        InterlockedIncrement(readers);
+        // A writer may have flipped the epoch before seeing this reader.
+        if (TableEpoch == epoch)
+            return readers;
+        InterlockedDecrement(readers);
+    }
+}
+
+static void LeaveTable(volatile LONG* readers)
+{
+    InterlockedDecrement(readers);
+}
+
+/*
+ * Makes table the current one and returns once no reader can still use the
+ * previous one. Must be called inside the flush section, which serializes
+ * writers; readers never enter it while registered, so the wait cannot
+ * deadlock.
+ */
+static RY2_DongleTable* PublishTable(RY2_DongleTable* table)
+{
+    RY2_DongleTable* previous = (RY2_DongleTable*)InterlockedExchangePointer((PVOID volatile*)&Table, table);
+    const LONG epoch = TableEpoch;
+    InterlockedExchange(&TableEpoch, epoch + 1);
+    for (int i = 0; i < RY2_TABLE_READER_STRIPES; i++)
+    {
+        while (TableReaders[epoch & 1][i].count)
+            Sleep(0);
+    }
+    return previous;
+}
+
+static void FreeTable(RY2_DongleTable* table)
+{
+    if (table != &EmptyTable)
+        HeapFree(ProcessHeap, 0, table);
+}
+
+static BOOL IsDongleOpen(const RY2_Dongle* dongle)
+{
+    return dongle && dongle->store && dongle->lockEvents[RY2_IDENTITY_LOCK] && dongle->shared;
+}
+
+/*
+ * The dongle behind a handle in the given table, or NULL if it is not open.
+ * *error receives the code RY2 functions return for the handle.
+ */
+static RY2_Dongle* GetDongle(const RY2_DongleTable* table, int handle, int* error)
+{
+    if (handle < 0 || handle >= table->count)
+    {
+        *error = RY2ERR_NO_SUCH_DEVICE;
+        return NULL;
+    }
+    RY2_Dongle* dongle = table->dongles[handle];
+    *error = IsDongleOpen(dongle) ? RY2ERR_SUCCESS : RY2ERR_NOT_OPENED_DEVICE;
+    return *error == RY2ERR_SUCCESS ? dongle : NULL;
+}
+
+/*
+ * Stores identifiers read from storage in the table, where RY2_Open looks
+ * them up. A changed HID or UID invalidates the lookup indexes.
+ */
+static void SetTableInfo(RY2_DongleTable* table, int handle, const DWORD info[RY2_INFO_COUNT])
+{
+    if (table->hids[handle] != info[0] || table->uids[handle] != info[1])
+        table->indexed = FALSE;
+    table->hids[handle] = info[0];
+    table->uids[handle] = info[1];
+    table->versions[handle] = info[2];
+    table->protections[handle] = info[3];
+    table->loaded[handle] = TRUE;
+}
+
+/*
+ * Updates the identifiers of an open dongle, and their copy in the current
+ * table. The caller is registered as a reader or inside the flush section,
+ * so the table cannot be freed meanwhile.
+ */
+static void SetDongleInfo(RY2_Dongle* dongle, const DWORD info[RY2_INFO_COUNT])
+{
+    dongle->hid = info[0];
+    dongle->uid = info[1];
+    dongle->version = info[2];
+    dongle->isProtected = info[3];
+    RY2_DongleTable* table = Table;
+    if (dongle->handle < table->count && table->dongles[dongle->handle] == dongle)
+        SetTableInfo(table, dongle->handle, info);
+}
+
+/*
+ * Reads the identifiers of a dongle from storage. Missing ones are written
+ * back with their defaults, as RY2_Find used to do.
+ */
+static void ReadStoredInfo(RY2_Store store, DWORD info[RY2_INFO_COUNT])
+{
+    DWORD* const storedInfo[RY2_INFO_COUNT] = { &info[0], &info[1], &info[2], &info[3] };
+    if (!Storage->ReadInfo(store, storedInfo))
+    {
+        const DWORD* const defaultInfo[RY2_INFO_COUNT] = { &info[0], &info[1], &info[2], &info[3] };
+        Storage->WriteInfo(store, defaultInfo);
+    }
+}
+
+static BOOL WriteDongleInfo(RY2_Dongle* dongle)
+{
+    const DWORD* const dongleInfo[RY2_INFO_COUNT] = { &dongle->hid, &dongle->uid, &dongle->version, &dongle->isProtected };
+    return Storage->WriteInfo(dongle->store, dongleInfo);
+}
+
+// Tells RY2_Find in every process that stored identifiers have changed.
+static void BumpConfigGeneration(void)
+{
+    if (ConfigShared)
+        InterlockedIncrement(&ConfigShared->generation);
+}
+
+static void RecoverDongleLock(RY2_Dongle* dongle, int lock_index);
+
+static void LockDongle(RY2_Dongle* dongle, int lock_index)
+{
+    if (AcquireLock(&dongle->shared->locks[lock_index], dongle->lockEvents[lock_index]))
+        RecoverDongleLock(dongle, lock_index);
+}
+
+static void UnlockDongle(RY2_Dongle* dongle, int lock_index)
+{
+    ReleaseLock(&dongle->shared->locks[lock_index], dongle->lockEvents[lock_index]);
+}
+
+static void LockWholeDongle(RY2_Dongle* dongle)
+{
+    for (int i = 0; i < RY2_LOCK_COUNT; i++)
+        LockDongle(dongle, i);
+}
+
+static void UnlockWholeDongle(RY2_Dongle* dongle)
+{
+    for (int i = RY2_LOCK_COUNT - 1; i >= 0; i--)
+        UnlockDongle(dongle, i);
+}
+
+static void LockDongleBlocks(RY2_Dongle* dongle, DWORD block_mask)
+{
+    for (int i = 0; i < RY2_BLOCK_COUNT; i++)
+    {
+        if (block_mask & RY2_BLOCK_MASK(i))
+            LockDongle(dongle, RY2_BLOCK_LOCK(i));
+    }
+}
+
+static void UnlockDongleBlocks(RY2_Dongle* dongle, DWORD block_mask)
+{
+    for (int i = RY2_BLOCK_COUNT - 1; i >= 0; i--)
+    {
+        if (block_mask & RY2_BLOCK_MASK(i))
+            UnlockDongle(dongle, RY2_BLOCK_LOCK(i));
+    }
+}
+
+static BOOL IsSharedImageLoaded(RY2_Dongle* dongle)
+{
+    return SharedImage && dongle->shared->loaded;
+}
+
+static BOOL IsDongleCacheCurrent(RY2_Dongle* dongle, int lock_index, LONG generation)
+{
+    return dongle->cacheValid[lock_index] && dongle->cacheGenerations[lock_index] == generation;
+}
+
+/*
+ * Reloads the cached info values when another process, or another handle in
+ * this one, has written them since the cache was filled. Must be called with
+ * the identity lock held.
+ */
+static void SyncDongleInfo(RY2_Dongle* dongle)
+{
+    const LONG generation = dongle->shared->generations[RY2_IDENTITY_LOCK];
+    if (IsDongleCacheCurrent(dongle, RY2_IDENTITY_LOCK, generation))
+        return;
+    if (IsSharedImageLoaded(dongle))
+    {
+        // Storage may lag behind the shared image in write-behind mode.
+        SetDongleInfo(dongle, dongle->shared->info);
     }
     else
-        DongleCount = 0;
+    {
+        DWORD info[RY2_INFO_COUNT] = { 0 };
+        ReadStoredInfo(dongle->store, info);
+        SetDongleInfo(dongle, info);
+    }
+    dongle->cacheGenerations[RY2_IDENTITY_LOCK] = generation;
+    dongle->cacheValid[RY2_IDENTITY_LOCK] = TRUE;
 }
 
-static void OpenRegDongleKey(int handle)
+/*
+ * Block counterpart of SyncDongleInfo: every stale block in the mask is
+ * reloaded with a single storage read. Must be called with the matching
+ * block locks held.
+ */
+static void SyncDongleBlocks(RY2_Dongle* dongle, DWORD block_mask)
 {
-    char regKeyPath[33 + 1] = { 0 }; // Software\Rockey2\Dongles\Dongle00 + '\0'
-    if (!Dongles[handle].regKey)
+    LONG generations[RY2_BLOCK_COUNT] = { 0 };
+    char* buffers[RY2_BLOCK_COUNT] = { NULL };
+    DWORD staleMask = 0;
+    int hits = 0;
+    for (int i = 0; i < RY2_BLOCK_COUNT; i++)
     {
-        _snprintf(regKeyPath, sizeof regKeyPath - 1, "%s\\Dongle%02d", RegSubKey, handle);
-        if (RegCreateKeyEx(RegRootKey, regKeyPath, 0, NULL, REG_OPTION_NON_VOLATILE, KEY_WOW64_64KEY | KEY_READ | KEY_WRITE, NULL, &Dongles[handle].regKey, NULL) != ERROR_SUCCESS &&
-            RegOpenKeyEx(RegRootKey, regKeyPath, 0, KEY_WOW64_64KEY | KEY_READ, &Dongles[handle].regKey) != ERROR_SUCCESS)
-            Dongles[handle].regKey = NULL;
+        if (!(block_mask & RY2_BLOCK_MASK(i)))
+            continue;
+        generations[i] = dongle->shared->generations[RY2_BLOCK_LOCK(i)];
+        if (!IsDongleCacheCurrent(dongle, RY2_BLOCK_LOCK(i), generations[i]))
+            staleMask |= RY2_BLOCK_MASK(i);
+        else
+            hits++;
+        buffers[i] = dongle->cacheBlocks[i];
+    }
+    AddStat(RY2_STAT_BLOCK_CACHE_HITS, hits);
+    if (!staleMask)
+        return;
+    const DWORD readMask = ReadStorageBlocks(Storage, dongle->store, staleMask, buffers);
+    for (int i = 0; i < RY2_BLOCK_COUNT; i++)
+    {
+        if (!(staleMask & RY2_BLOCK_MASK(i)))
+            continue;
+        AddStat(RY2_STAT_BLOCK_CACHE_MISSES, 1);
+        if (!(readMask & RY2_BLOCK_MASK(i)))
+            memset(buffers[i], 0xFF, RY2_BLOCK_SIZE);
+        dongle->cacheGenerations[RY2_BLOCK_LOCK(i)] = generations[i];
+        dongle->cacheValid[RY2_BLOCK_LOCK(i)] = TRUE;
     }
 }
 
-static BOOL ReadRegBlockValue(int handle, int block_index, char* buffer512)
+/*
+ * Publishes a write to the other processes. A cache that was current before
+ * the write stays current, since the caller has already updated it in place.
+ * Must be called with the matching lock held.
+ */
+static void BumpDongleGeneration(RY2_Dongle* dongle, int lock_index)
 {
-    if (!Dongles[handle].regKey)
-        return FALSE;
-    char regName[6 + 1] = { 0 }; // Block0 + '\0'
-    _snprintf(regName, sizeof regName - 1, RegBlockName, block_index);
-    DWORD regType = REG_BINARY;
-    DWORD regSize = 512;
-    LSTATUS regStatus = RegQueryValueEx(Dongles[handle].regKey, regName, NULL, &regType, (LPBYTE)buffer512, &regSize);
-    return regStatus == ERROR_SUCCESS && regType == REG_BINARY && regSize == 512;
+    const BOOL wasCurrent = dongle->cacheValid[lock_index] && dongle->cacheGenerations[lock_index] == dongle->shared->generations[lock_index];
+    const LONG generation = InterlockedIncrement(&dongle->shared->generations[lock_index]);
+    if (wasCurrent)
+        dongle->cacheGenerations[lock_index] = generation;
+    else
+        dongle->cacheValid[lock_index] = FALSE;
 }
 
-static BOOL WriteRegBlockValue(int handle, int block_index, const char* buffer512)
+static void BeginSharedWrite(RY2_DongleShared* shared, int lock_index)
 {
-    if (!Dongles[handle].regKey)
-        return FALSE;
-    char regName[6 + 1] = { 0 }; // Block0 + '\0'
-    _snprintf(regName, sizeof regName - 1, RegBlockName, block_index);
-    DWORD regType = REG_BINARY;
-    DWORD regSize = 512;
-    LSTATUS regStatus = RegSetValueEx(Dongles[handle].regKey, regName, 0, regType, (const LPBYTE)buffer512, regSize);
-    return regStatus == ERROR_SUCCESS /* && regType == REG_BINARY && regSize == 512 */;
+    InterlockedIncrement(&shared->sequences[lock_index]);
+    MemoryBarrier();
 }
 
-static BOOL ReadRegInfoValue(int handle)
+static void EndSharedWrite(RY2_DongleShared* shared, int lock_index)
 {
-    if (!Dongles[handle].regKey)
-        return FALSE;
-    BOOL success = TRUE;
-    DWORD* const dongleInfo[sizeof RegInfoNames / sizeof(char*)] = { &Dongles[handle].hid, &Dongles[handle].uid, &Dongles[handle].version, &Dongles[handle].isProtected };
-    for (int i = 0; i < sizeof dongleInfo / sizeof(DWORD*); i++)
-    {
-        DWORD regType = REG_DWORD;
-        DWORD regSize = sizeof(DWORD);
-        LSTATUS regStatus = RegQueryValueEx(Dongles[handle].regKey, RegInfoNames[i], NULL, &regType, (LPBYTE)dongleInfo[i], &regSize);
-        if (!(regStatus == ERROR_SUCCESS && regType == REG_DWORD && regSize == sizeof(DWORD)))
+    MemoryBarrier();
+    InterlockedIncrement(&shared->sequences[lock_index]);
+}
+
+/*
+ * Copies a consistent snapshot of part of the shared image without taking
+ * its lock. Writers hold the sequence odd only for a memcpy, so the reader
+ * spins in user mode instead of waiting in the kernel. A sequence that stays
+ * odd for RY2_SHARED_SPIN_LIMIT spins makes the reader wait for the lock
+ * instead, which takes it over if the writer has died.
+ */
+static void ReadSharedImage(RY2_Dongle* dongle, int lock_index, const void* source, void* dest, SIZE_T size)
+{
+    const RY2_DongleShared* shared = dongle->shared;
+    LONG oddSequence = 0;
+    DWORD oddSpins = 0;
+    for (;;)
+    {
+        const LONG sequence = shared->sequences[lock_index];
+        MemoryBarrier();
+        if (!(sequence & 1))
+        {
+            memcpy(dest, source, size);
+            MemoryBarrier();
+            if (shared->sequences[lock_index] == sequence)
+                return;
+        }
+        else if (sequence != oddSequence)
         {
-            if (success)
-                success = FALSE;
-            *dongleInfo[i] = 0;
+            oddSequence = sequence;
+            oddSpins = 0;
         }
+        else if (++oddSpins == RY2_SHARED_SPIN_LIMIT)
+        {
+            // A writer that never finishes has died: the lock takes over from it and repairs the image.
+            LockDongle(dongle, lock_index);
+            UnlockDongle(dongle, lock_index);
+            oddSpins = 0;
+        }
+        YieldProcessor();
     }
-    return success;
 }
 
-static BOOL WriteRegInfoValue(int handle)
+/*
+ * Discards a shared image and dirty bits left by a process that used other
+ * storage, and makes every process drop its cache of the dongle. Must be
+ * called with the whole dongle locked, before the dongle is synced.
+ */
+static void AdoptSharedImage(RY2_Dongle* dongle, DWORD stamp)
 {
-    if (!Dongles[handle].regKey)
+    RY2_DongleShared* shared = dongle->shared;
+    if ((DWORD)shared->storageStamp == stamp)
+        return;
+    InterlockedExchange(&shared->loaded, 0);
+    InterlockedExchange(&shared->dirty, 0);
+    for (int j = 0; j < RY2_LOCK_COUNT; j++)
+        BumpDongleGeneration(dongle, j);
+    InterlockedExchange(&shared->storageStamp, (LONG)stamp);
+}
+
+/*
+ * Publishes the freshly synced cache as the shared image if no other process
+ * has done so yet. Must be called with the whole dongle locked.
+ */
+static void LoadSharedImage(RY2_Dongle* dongle)
+{
+    RY2_DongleShared* shared = dongle->shared;
+    if (!SharedImage || shared->loaded)
+        return;
+    BeginSharedWrite(shared, RY2_IDENTITY_LOCK);
+    shared->info[0] = dongle->hid;
+    shared->info[1] = dongle->uid;
+    shared->info[2] = dongle->version;
+    shared->info[3] = dongle->isProtected;
+    EndSharedWrite(shared, RY2_IDENTITY_LOCK);
+    for (int i = 0; i < RY2_BLOCK_COUNT; i++)
+    {
+        BeginSharedWrite(shared, RY2_BLOCK_LOCK(i));
+        memcpy(shared->blocks[i], dongle->cacheBlocks[i], RY2_BLOCK_SIZE);
+        EndSharedWrite(shared, RY2_BLOCK_LOCK(i));
+    }
+    InterlockedIncrement(&shared->loaded);
+}
+
+/*
+ * Repairs a lock taken over from a process that died holding it. A shared
+ * write it left half done (odd sequence) is closed and that part of the
+ * image reloaded from storage, dropping its unflushed change; in any case
+ * every cache of the part is dropped, since a storage write may have been
+ * cut short too. Called with the lock held.
+ */
+static void RecoverDongleLock(RY2_Dongle* dongle, int lock_index)
+{
+    RY2_DongleShared* shared = dongle->shared;
+    if (shared->sequences[lock_index] & 1)
+    {
+        InterlockedIncrement(&shared->sequences[lock_index]);
+        if (shared->loaded && dongle->store)
+        {
+            BeginSharedWrite(shared, lock_index);
+            if (lock_index == RY2_IDENTITY_LOCK)
+            {
+                ReadStoredInfo(dongle->store, shared->info);
+                InterlockedAnd(&shared->dirty, ~RY2_DIRTY_INFO);
+            }
+            else
+            {
+                const int block = lock_index - RY2_BLOCK_LOCK(0);
+                if (!Storage->ReadBlock(dongle->store, block, shared->blocks[block]))
+                    memset(shared->blocks[block], 0xFF, RY2_BLOCK_SIZE);
+                InterlockedAnd(&shared->dirty, ~RY2_BLOCK_MASK(block));
+            }
+            EndSharedWrite(shared, lock_index);
+        }
+    }
+    InterlockedIncrement(&shared->generations[lock_index]);
+    dongle->cacheValid[lock_index] = FALSE;
+}
+
+/*
+ * Finds the range of bytes from the first to the last difference between two
+ * blocks. The equality test runs over whole words without early exit so that
+ * the compiler vectorizes it; the common unchanged case costs a few dozen
+ * vector compares.
+ */
+static BOOL FindBlockChange(const char* current, const char* data, DWORD* start, DWORD* end)
+{
+    const SIZE_T wordCount = RY2_BLOCK_SIZE / sizeof(UINT64);
+    UINT64 currentWords[RY2_BLOCK_SIZE / sizeof(UINT64)];
+    UINT64 dataWords[RY2_BLOCK_SIZE / sizeof(UINT64)];
+    memcpy(currentWords, current, RY2_BLOCK_SIZE);
+    memcpy(dataWords, data, RY2_BLOCK_SIZE);
+    UINT64 difference = 0;
+    for (SIZE_T i = 0; i < wordCount; i++)
+        difference |= currentWords[i] ^ dataWords[i];
+    if (!difference)
         return FALSE;
-    BOOL success = TRUE;
-    const DWORD* const dongleInfo[sizeof RegInfoNames / sizeof(char*)] = { &Dongles[handle].hid, &Dongles[handle].uid, &Dongles[handle].version, &Dongles[handle].isProtected };
-    for (int i = 0; i < sizeof dongleInfo / sizeof(DWORD*); i++)
-    {
-        DWORD regType = REG_DWORD;
-        DWORD regSize = sizeof(DWORD);
-        LSTATUS regStatus = RegSetValueEx(Dongles[handle].regKey, RegInfoNames[i], 0, regType, (const LPBYTE)dongleInfo[i], regSize);
-        if (!(regStatus == ERROR_SUCCESS /* && regType == REG_DWORD && regSize == sizeof(DWORD) */))
+    DWORD first = 0;
+    while (current[first] == data[first])
+        first++;
+    DWORD last = RY2_BLOCK_SIZE - 1;
+    while (current[last] == data[last])
+        last--;
+    *start = first;
+    *end = last + 1;
+    return TRUE;
+}
+
+/*
+ * The current content of a block as far as this process can tell without
+ * storage I/O, or NULL if neither the shared image nor the cache is current.
+ * Must be called with the block's lock held.
+ */
+static const char* GetCurrentBlock(RY2_Dongle* dongle, int block_index)
+{
+    if (IsSharedImageLoaded(dongle))
+        return dongle->shared->blocks[block_index];
+    if (IsDongleCacheCurrent(dongle, RY2_BLOCK_LOCK(block_index), dongle->shared->generations[RY2_BLOCK_LOCK(block_index)]))
+        return dongle->cacheBlocks[block_index];
+    return NULL;
+}
+
+/*
+ * Stores the given blocks with one storage write and publishes them to the
+ * cache, the shared image and the other processes. Blocks whose data matches
+ * the current content are elided, and only the changed range of the others
+ * is copied. Must be called with the matching block locks held.
+ */
+static void StoreDongleBlocks(RY2_Dongle* dongle, DWORD block_mask, const char* const buffers[RY2_BLOCK_COUNT])
+{
+    RY2_DongleShared* shared = dongle->shared;
+    DWORD dirtyStart[RY2_BLOCK_COUNT] = { 0 };
+    DWORD dirtyEnd[RY2_BLOCK_COUNT] = { 0 };
+    DWORD storeMask = 0;
+    for (int i = 0; i < RY2_BLOCK_COUNT; i++)
+    {
+        if (!(block_mask & RY2_BLOCK_MASK(i)))
+            continue;
+        const char* current = GetCurrentBlock(dongle, i);
+        if (!current)
+            dirtyEnd[i] = RY2_BLOCK_SIZE;
+        else if (!FindBlockChange(current, buffers[i], &dirtyStart[i], &dirtyEnd[i]))
         {
-            if (success)
-                success = FALSE;
+            shared->writeStats[i].elided++;
+            continue;
         }
+        storeMask |= RY2_BLOCK_MASK(i);
     }
-    return success;
+    if (!storeMask)
+        return;
+    if (WriteBehind)
+        InterlockedOr(&shared->dirty, storeMask);
+    else
+        WriteStorageBlocks(Storage, dongle->store, storeMask, buffers);
+    for (int i = 0; i < RY2_BLOCK_COUNT; i++)
+    {
+        if (!(storeMask & RY2_BLOCK_MASK(i)))
+            continue;
+        const DWORD start = dirtyStart[i];
+        const DWORD size = dirtyEnd[i] - start;
+        // A stale cache gets only the changed range, but BumpDongleGeneration drops it anyway.
+        memcpy(dongle->cacheBlocks[i] + start, buffers[i] + start, size);
+        if (IsSharedImageLoaded(dongle))
+        {
+            BeginSharedWrite(shared, RY2_BLOCK_LOCK(i));
+            memcpy(shared->blocks[i] + start, buffers[i] + start, size);
+            EndSharedWrite(shared, RY2_BLOCK_LOCK(i));
+        }
+        BumpDongleGeneration(dongle, RY2_BLOCK_LOCK(i));
+        shared->writeStats[i].writes++;
+        shared->writeStats[i].dirtyBytes += size;
+        shared->writeStats[i].lastDirtyStart = start;
+        shared->writeStats[i].lastDirtyEnd = dirtyEnd[i];
+    }
+    RaiseSignal(&shared->blockSignal, dongle->signalEvent);
+    if (WriteBehind)
+        WakeFlusher();
 }
 
-static void EraseDongleBlocks(int handle)
+/*
+ * Resets every block to 0xFF in storage, the cache and the shared image.
+ * Must be called with the whole dongle locked.
+ */
+static void EraseDongleBlocks(RY2_Dongle* dongle)
 {
-    char buffer[512];
+    char buffer[RY2_BLOCK_SIZE];
     memset(buffer, 0xFF, sizeof buffer);
-    for (int i = 0; i < RY2_BLOCK_COUNT; i++)
-        WriteRegBlockValue(handle, i, buffer);
+    const char* const buffers[RY2_BLOCK_COUNT] = { buffer, buffer, buffer, buffer, buffer };
+    StoreDongleBlocks(dongle, RY2_ALL_BLOCKS, buffers);
+}
+
+/*
+ * Writes the dirty parts of the shared image back to storage as one batch: the
+ * info values under the identity lock and all dirty blocks under their locks.
+ * The identity lock is always taken, and the dirty bits read only once it is
+ * held: GenUID dirties the erased blocks before the info under the whole
+ * dongle, so this sees both or neither.
+ */
+static void FlushDongle(RY2_Dongle* dongle)
+{
+    if (!IsDongleOpen(dongle) || !dongle->shared->dirty)
+        return;
+    RY2_DongleShared* shared = dongle->shared;
+    LockDongle(dongle, RY2_IDENTITY_LOCK);
+    const BOOL infoDirty = (shared->dirty & RY2_DIRTY_INFO) != 0;
+    const DWORD lockMask = shared->dirty & RY2_ALL_BLOCKS;
+    LockDongleBlocks(dongle, lockMask);
+    // Recovering a lock from a dead holder may have dropped some of them meanwhile.
+    const DWORD blockMask = shared->dirty & lockMask;
+    BeginStorageBatch(Storage, dongle->store);
+    if (infoDirty)
+    {
+        const DWORD* const info[RY2_INFO_COUNT] = { &shared->info[0], &shared->info[1], &shared->info[2], &shared->info[3] };
+        Storage->WriteInfo(dongle->store, info);
+    }
+    if (blockMask)
+    {
+        const char* buffers[RY2_BLOCK_COUNT];
+        for (int i = 0; i < RY2_BLOCK_COUNT; i++)
+            buffers[i] = shared->blocks[i];
+        WriteStorageBlocks(Storage, dongle->store, blockMask, buffers);
+    }
+    EndStorageBatch(Storage, dongle->store);
+    InterlockedAnd(&shared->dirty, ~(LONG)(blockMask | (infoDirty ? RY2_DIRTY_INFO : 0)));
+    if (infoDirty)
+        BumpConfigGeneration();
+    UnlockDongleBlocks(dongle, lockMask);
+    UnlockDongle(dongle, RY2_IDENTITY_LOCK);
 }
 
-static void CloseDongle(int handle)
+// Flusher callback, run inside the flush section.
+static void FlushDongles(void)
 {
-    if (Dongles[handle].regKey)
+    for (int i = 0; i < Table->count; i++)
+    {
+        RY2_Dongle* dongle = Table->dongles[i];
+        FlushDongle(dongle);
+        if (Storage->Maintain && IsDongleOpen(dongle))
+            Storage->Maintain(dongle->store);
+    }
+    DrainTrace();
+}
+
+static void CloseDongle(RY2_Dongle* dongle)
+{
+    if (!dongle)
+        return;
+    EnterFlushSection();
+    FlushDongle(dongle);
+    if (dongle->store)
+    {
+        Storage->CloseDongle(dongle->store);
+        dongle->store = NULL;
+    }
+    for (int i = 0; i < RY2_LOCK_COUNT; i++)
+    {
+        if (dongle->lockEvents[i])
+        {
+            CloseLockEvent(dongle->lockEvents[i]);
+            dongle->lockEvents[i] = NULL;
+        }
+        dongle->cacheValid[i] = FALSE;
+    }
+    if (dongle->signalEvent)
     {
-        RegCloseKey(Dongles[handle].regKey);
-        Dongles[handle].regKey = NULL;
+        CloseSignalEvent(dongle->signalEvent);
+        dongle->signalEvent = NULL;
     }
-    if (Dongles[handle].mutex)
+    if (dongle->shared)
     {
-        CloseHandle(Dongles[handle].mutex);
-        Dongles[handle].mutex = NULL;
+        CloseSharedMemory(dongle->shared, sizeof(RY2_DongleShared), dongle->sharedMapping);
+        dongle->shared = NULL;
+        dongle->sharedMapping = NULL;
+    }
+    LeaveFlushSection();
+}
+
+static void UnmapBlockView(RY2_Dongle* dongle)
+{
+    CloseSharedMemory((void*)dongle->blockView, sizeof(RY2_DongleShared), dongle->blockViewMapping);
+    dongle->blockView = NULL;
+    dongle->blockViewMapping = NULL;
+    dongle->blockViewCount = 0;
+}
+
+// Closes and releases the dongles of a retired table from first on.
+static void RemoveDongles(RY2_DongleTable* table, int first)
+{
+    for (int i = first; i < table->count; i++)
+    {
+        CloseDongle(table->dongles[i]);
+        if (table->dongles[i] && table->dongles[i]->blockView)
+            UnmapBlockView(table->dongles[i]);
+        if (table->dongles[i])
+            HeapFree(ProcessHeap, 0, table->dongles[i]);
     }
 }
 
 static void Cleanup(void)
 {
-    if (Dongles)
+    EnterFlushSection();
+    // No reader runs while the library is unloaded, and one killed at process
+    // exit would never leave, so there is no grace period to wait for.
+    RY2_DongleTable* table = Table;
+    Table = &EmptyTable;
+    RemoveDongles(table, 0);
+    FreeTable(table);
+    DongleSetLoaded = FALSE;
+    if (ConfigShared)
+    {
+        CloseSharedMemory(ConfigShared, sizeof(RY2_ConfigShared), ConfigMapping);
+        ConfigShared = NULL;
+        ConfigMapping = NULL;
+    }
+    LeaveFlushSection();
+}
+
+/*
+ * Whether RY2_Find has to rescan: the backend saw the dongle set change, or
+ * a process stored new identifiers (ROCKEY2_CONFIG generation). Both sources
+ * are polled on every call so that their notifications stay armed.
+ */
+static BOOL HasDongleSetChanged(void)
+{
+    BOOL changed = !DongleSetLoaded;
+    if (!Storage->HasChanged || Storage->HasChanged())
+        changed = TRUE;
+    if (!ConfigShared)
+        ConfigShared = (RY2_ConfigShared*)OpenSharedMemory("ROCKEY2_CONFIG", sizeof(RY2_ConfigShared), &ConfigMapping);
+    if (!ConfigShared)
+        return TRUE;
+    const LONG generation = ConfigShared->generation;
+    if (generation != ConfigGeneration)
     {
-        for (int i = 0; i < DongleCount; i++)
-            CloseDongle(i);
-        HeapFree(ProcessHeap, 0, Dongles);
-        Dongles = NULL;
+        ConfigGeneration = generation;
+        changed = TRUE;
     }
-    DongleCount = 0;
+    return changed;
+}
+
+static void* CarveTableArray(BYTE** cursor, SIZE_T size)
+{
+    void* array = *cursor;
+    *cursor += size;
+    return array;
+}
+
+/*
+ * Allocates a zeroed table for count dongles. The header and all arrays share
+ * one allocation, pointers first so that every array stays aligned; the
+ * buckets are sized to the next power of two.
+ */
+static RY2_DongleTable* AllocTable(int count)
+{
+    DWORD bucketCount = 1;
+    while (bucketCount < (DWORD)count)
+        bucketCount <<= 1;
+    const SIZE_T dongleSize = sizeof(RY2_Dongle*) + RY2_INFO_COUNT * sizeof(DWORD) + 2 * sizeof(int) + sizeof(BYTE);
+    BYTE* cursor = (BYTE*)HeapAlloc(ProcessHeap, HEAP_ZERO_MEMORY, sizeof(RY2_DongleTable) + count * dongleSize + 2 * bucketCount * sizeof(int));
+    if (!cursor)
+        return NULL;
+    RY2_DongleTable* table = (RY2_DongleTable*)CarveTableArray(&cursor, sizeof(RY2_DongleTable));
+    table->count = count;
+    table->dongles = (RY2_Dongle**)CarveTableArray(&cursor, count * sizeof(RY2_Dongle*));
+    table->hids = (DWORD*)CarveTableArray(&cursor, count * sizeof(DWORD));
+    table->uids = (DWORD*)CarveTableArray(&cursor, count * sizeof(DWORD));
+    table->versions = (DWORD*)CarveTableArray(&cursor, count * sizeof(DWORD));
+    table->protections = (DWORD*)CarveTableArray(&cursor, count * sizeof(DWORD));
+    table->hidNext = (int*)CarveTableArray(&cursor, count * sizeof(int));
+    table->uidNext = (int*)CarveTableArray(&cursor, count * sizeof(int));
+    table->hidBuckets = (int*)CarveTableArray(&cursor, bucketCount * sizeof(int));
+    table->uidBuckets = (int*)CarveTableArray(&cursor, bucketCount * sizeof(int));
+    table->loaded = (BYTE*)CarveTableArray(&cursor, count * sizeof(BYTE));
+    table->bucketMask = bucketCount - 1;
+    return table;
+}
+
+/*
+ * Moves an open dongle over to storage that replaced the one it was read
+ * from, such as an image file renamed over the old one: the store is
+ * reopened and the caches and shared image reloaded. Unflushed write-behind
+ * data meant for the old storage is dropped.
+ */
+static void ReopenDongle(RY2_Dongle* dongle, DWORD stamp)
+{
+    LockWholeDongle(dongle);
+    const RY2_Store store = Storage->OpenDongle(dongle->handle);
+    if (store)
+    {
+        Storage->CloseDongle(dongle->store);
+        dongle->store = store;
+        for (int j = 0; j < RY2_LOCK_COUNT; j++)
+            dongle->cacheValid[j] = FALSE;
+        AdoptSharedImage(dongle, stamp);
+        SyncDongleInfo(dongle);
+        SyncDongleBlocks(dongle, RY2_ALL_BLOCKS);
+        LoadSharedImage(dongle);
+    }
+    UnlockWholeDongle(dongle);
+}
+
+/*
+ * Rereads an open dongle's info values from storage for a rescan, which may
+ * follow an edit made outside the emulator. Unflushed write-behind values are
+ * kept. Must be called with the identity lock held and the cache synced.
+ */
+static void ReloadDongleInfo(RY2_Dongle* dongle)
+{
+    RY2_DongleShared* shared = dongle->shared;
+    if (!dongle->store || (shared->dirty & RY2_DIRTY_INFO))
+        return;
+    DWORD info[RY2_INFO_COUNT] = { 0 };
+    ReadStoredInfo(dongle->store, info);
+    const DWORD cached[RY2_INFO_COUNT] = { dongle->hid, dongle->uid, dongle->version, dongle->isProtected };
+    if (!memcmp(info, cached, sizeof info))
+        return;
+    if (IsSharedImageLoaded(dongle))
+    {
+        BeginSharedWrite(shared, RY2_IDENTITY_LOCK);
+        memcpy(shared->info, info, sizeof info);
+        EndSharedWrite(shared, RY2_IDENTITY_LOCK);
+    }
+    SetDongleInfo(dongle, info);
+    BumpDongleGeneration(dongle, RY2_IDENTITY_LOCK);
+}
+
+/*
+ * Publishes a fresh table for the current dongle set. Handles opened earlier
+ * stay valid as long as their dongle still exists: the new table takes over
+ * their state and identifiers, while the identifiers of the other dongles
+ * are left unread until RY2_Open needs them. Concurrent calls on the old
+ * table finish undisturbed before dongles beyond a reduced count are closed.
+ * Open dongles are reopened if the storage itself was replaced.
+ * Without a change notification since the previous call this returns at once.
+ */
+static int RescanDongles(void)
+{
+    EnterFlushSection();
+    if (!HasDongleSetChanged())
+    {
+        const int count = Table->count;
+        LeaveFlushSection();
+        return count;
+    }
+    RY2_DongleTable* current = Table;
+    RY2_DongleTable* table = AllocTable(Storage->ReadDongleCount());
+    if (!table)
+        table = &EmptyTable;
+    const DWORD stamp = GetStorageStamp(Storage);
+    const BOOL replaced = stamp != StorageStamp;
+    StorageStamp = stamp;
+    for (int i = 0; i < table->count && i < current->count; i++)
+    {
+        RY2_Dongle* dongle = current->dongles[i];
+        table->dongles[i] = dongle;
+        if (dongle && dongle->shared)
+        {
+            if (replaced && dongle->store)
+                ReopenDongle(dongle, stamp);
+            // An open dongle's identifiers are kept current through its generation, and reread from storage.
+            LockDongle(dongle, RY2_IDENTITY_LOCK);
+            SyncDongleInfo(dongle);
+            ReloadDongleInfo(dongle);
+            const DWORD info[RY2_INFO_COUNT] = { dongle->hid, dongle->uid, dongle->version, dongle->isProtected };
+            SetTableInfo(table, i, info);
+            UnlockDongle(dongle, RY2_IDENTITY_LOCK);
+        }
+    }
+    PublishTable(table);
+    RemoveDongles(current, table->count);
+    FreeTable(current);
+    DongleSetLoaded = TRUE;
+    LeaveFlushSection();
+    return table->count;
 }
 
 int WINAPI RY2_Find()
 {
-    Cleanup();
-    ReadRegDongleCountValue();
-    if (DongleCount > 0)
+    const UINT64 started = BeginStat();
+    const int ret = RescanDongles();
+    EndExportCall(RY2_STAT_FIND, started, 0, 0, 0, 0, ret);
+    return ret;
+}
+
+// Reads the identifiers of every dongle in the table that has not been read yet.
+static void LoadDongleInfos(RY2_DongleTable* table)
+{
+    for (int i = 0; i < table->count; i++)
     {
-        Dongles = (RY2_Dongle*)HeapAlloc(ProcessHeap, HEAP_ZERO_MEMORY, DongleCount * sizeof(RY2_Dongle));
-        if (!Dongles)
-            DongleCount = 0;
+        if (table->loaded[i])
+            continue;
+        const RY2_Store store = Storage->OpenDongle(i);
+        if (!store)
+            continue;
+        DWORD info[RY2_INFO_COUNT] = { 0 };
+        ReadStoredInfo(store, info);
+        SetTableInfo(table, i, info);
+        Storage->CloseDongle(store);
     }
-    for (int i = 0; i < DongleCount; i++)
+}
+
+static DWORD HashIdentifier(const RY2_DongleTable* table, DWORD value)
+{
+    value ^= value >> 16;
+    value *= 0x85EBCA6B;
+    value ^= value >> 13;
+    value *= 0xC2B2AE35;
+    value ^= value >> 16;
+    return value & table->bucketMask;
+}
+
+/*
+ * Rebuilds the HID and UID indexes unless they are current or another
+ * thread is rebuilding them. Handles are pushed in descending order, which
+ * leaves every chain ascending; since each next link points to a higher
+ * handle, a lookup racing with the rebuild still terminates.
+ */
+static void IndexDongles(RY2_DongleTable* table)
+{
+    const LONG sequence = table->indexSequence;
+    if (table->indexed || (sequence & 1) || InterlockedCompareExchange(&table->indexSequence, sequence + 1, sequence) != sequence)
+        return;
+    MemoryBarrier();
+    // Set before the identifiers are read, so that a change meanwhile clears it again.
+    InterlockedExchange(&table->indexed, TRUE);
+    for (DWORD i = 0; i <= table->bucketMask; i++)
+    {
+        table->hidBuckets[i] = -1;
+        table->uidBuckets[i] = -1;
+    }
+    for (int i = table->count - 1; i >= 0; i--)
     {
-        OpenRegDongleKey(i);
-        if (!ReadRegInfoValue(i))
-            WriteRegInfoValue(i);
-        CloseDongle(i);
+        const DWORD hidBucket = HashIdentifier(table, table->hids[i]);
+        const DWORD uidBucket = HashIdentifier(table, table->uids[i]);
+        table->hidNext[i] = table->hidBuckets[hidBucket];
+        table->hidBuckets[hidBucket] = i;
+        table->uidNext[i] = table->uidBuckets[uidBucket];
+        table->uidBuckets[uidBucket] = i;
     }
-    return DongleCount;
+    MemoryBarrier();
+    InterlockedExchange(&table->indexSequence, sequence + 2);
 }
 
-int WINAPI RY2_Open(int mode, DWORD uid, DWORD* hid)
+static BOOL IsDongleMatch(const RY2_DongleTable* table, int handle, int mode, DWORD uid, DWORD hid, int* uidMatchCount)
+{
+    if (mode == -1)
+        return table->hids[handle] == hid;
+    return table->uids[handle] == uid && ++*uidMatchCount == mode;
+}
+
+/*
+ * The handle RY2_Open selects: the first dongle (mode 0), the first with the
+ * given HID (mode -1) or the mode-th with the given UID, or -1 if none.
+ */
+static int FindDongle(RY2_DongleTable* table, int mode, DWORD uid, DWORD hid)
 {
+    if (table->count == 0 || mode < -1)
+        return -1;
+    if (mode == 0)
+        return 0;
+    if (!table->indexed)
+    {
+        LoadDongleInfos(table);
+        IndexDongles(table);
+    }
+    const LONG sequence = table->indexSequence;
+    MemoryBarrier();
+    if (!(sequence & 1) && table->indexed)
+    {
+        const int* buckets = mode == -1 ? table->hidBuckets : table->uidBuckets;
+        const int* next = mode == -1 ? table->hidNext : table->uidNext;
+        int uidMatchCount = 0;
+        int handle = buckets[HashIdentifier(table, mode == -1 ? hid : uid)];
+        while (handle >= 0 && !IsDongleMatch(table, handle, mode, uid, hid, &uidMatchCount))
+            handle = next[handle];
+        MemoryBarrier();
+        if (table->indexSequence == sequence)
+            return handle;
+    }
     int uidMatchCount = 0;
-    for (int i = 0; i < DongleCount; i++)
+    for (int i = 0; i < table->count; i++)
     {
-        if ((mode == 0) || (mode == -1 && *hid == Dongles[i].hid) || (mode > 0 && uid == Dongles[i].uid && mode == ++uidMatchCount))
+        if (IsDongleMatch(table, i, mode, uid, hid, &uidMatchCount))
+            return i;
+    }
+    return -1;
+}
+
+/*
+ * The lookup runs as a table reader; the dongle is then opened inside the
+ * flush section, where the table cannot be replaced.
+ */
+static int OpenDongleHandle(int mode, DWORD uid, DWORD* hid)
+{
+    volatile LONG* readers = EnterTable();
+    const int i = FindDongle(Table, mode, uid, mode == -1 ? *hid : 0);
+    LeaveTable(readers);
+    if (i < 0)
+        return RY2ERR_NO_SUCH_DEVICE;
+    EnterFlushSection();
+    if (i >= Table->count)
+    {
+        LeaveFlushSection();
+        return RY2ERR_NO_SUCH_DEVICE;
+    }
+    if (!Table->dongles[i])
+    {
+        RY2_Dongle* dongle = (RY2_Dongle*)HeapAlloc(ProcessHeap, HEAP_ZERO_MEMORY, sizeof(RY2_Dongle));
+        if (dongle)
+            dongle->handle = i;
+        Table->dongles[i] = dongle;
+    }
+    RY2_Dongle* dongle = Table->dongles[i];
+    if (!dongle)
+    {
+        LeaveFlushSection();
+        return RY2ERR_OPEN_DEVICE;
+    }
+    if (!dongle->store)
+        dongle->store = Storage->OpenDongle(i);
+    BOOL locksOpened = TRUE;
+    for (int j = 0; j < RY2_LOCK_COUNT; j++)
+    {
+        if (!dongle->lockEvents[j])
+            dongle->lockEvents[j] = OpenLockEvent(i, j);
+        if (!dongle->lockEvents[j])
+            locksOpened = FALSE;
+    }
+    if (!dongle->signalEvent)
+        dongle->signalEvent = OpenSignalEvent(i);
+    if (!dongle->shared)
+    {
+        char sharedName[19 + 1] = { 0 }; // ROCKEY2_SHARED65535 + '\0'
+        _snprintf(sharedName, sizeof sharedName - 1, "ROCKEY2_SHARED%02d", i);
+        dongle->shared = (RY2_DongleShared*)OpenSharedMemory(sharedName, sizeof(RY2_DongleShared), &dongle->sharedMapping);
+    }
+    if (dongle->store && locksOpened && dongle->signalEvent && dongle->shared)
+    {
+        LockWholeDongle(dongle);
+        AdoptSharedImage(dongle, GetStorageStamp(Storage));
+        SyncDongleInfo(dongle);
+        SyncDongleBlocks(dongle, RY2_ALL_BLOCKS);
+        LoadSharedImage(dongle);
+        UnlockWholeDongle(dongle);
+        *hid = dongle->hid;
+        LeaveFlushSection();
+        return i;
+    }
+    CloseDongle(dongle);
+    LeaveFlushSection();
+    return RY2ERR_OPEN_DEVICE;
+}
+
+int WINAPI RY2_Open(int mode, DWORD uid, DWORD* hid)
+{
+    const UINT64 started = BeginStat();
+    const DWORD requestedHid = mode == -1 ? *hid : 0;
+    const int ret = OpenDongleHandle(mode, uid, hid);
+    EndExportCall(RY2_STAT_OPEN, started, mode, uid, requestedHid, 0, ret);
+    return ret;
+}
+
+void WINAPI RY2_Close(int handle)
+{
+    const UINT64 started = BeginStat();
+    EnterFlushSection();
+    if (handle >= 0 && handle < Table->count)
+        CloseDongle(Table->dongles[handle]);
+    LeaveFlushSection();
+    EndExportCall(RY2_STAT_CLOSE, started, handle, 0, 0, 0, RY2ERR_SUCCESS);
+}
+
+static int GenDongleUID(RY2_Dongle* dongle, DWORD* uid, char* seed, int isProtect)
+{
+    const DWORD newUid = GenUID(seed);
+    LockWholeDongle(dongle);
+    // The erased blocks and the new UID reach storage together or not at all.
+    BeginStorageBatch(Storage, dongle->store);
+    EraseDongleBlocks(dongle);
+    SyncDongleInfo(dongle);
+    const DWORD oldUid = dongle->uid;
+    const DWORD info[RY2_INFO_COUNT] = { dongle->hid, newUid, dongle->version, isProtect };
+    SetDongleInfo(dongle, info);
+    if (!WriteBehind)
+        WriteDongleInfo(dongle);
+    EndStorageBatch(Storage, dongle->store);
+    if (!WriteBehind)
+        BumpConfigGeneration();
+    if (IsSharedImageLoaded(dongle))
+    {
+        RY2_DongleShared* shared = dongle->shared;
+        BeginSharedWrite(shared, RY2_IDENTITY_LOCK);
+        shared->info[1] = dongle->uid;
+        shared->info[3] = dongle->isProtected;
+        EndSharedWrite(shared, RY2_IDENTITY_LOCK);
+        if (WriteBehind)
+            InterlockedOr(&shared->dirty, RY2_DIRTY_INFO);
+    }
+    BumpDongleGeneration(dongle, RY2_IDENTITY_LOCK);
+    *uid = dongle->uid;
+    UnlockWholeDongle(dongle);
+    if (WriteBehind)
+        WakeFlusher();
+    if (oldUid != newUid)
+        FlushTransformCache(oldUid);
+    return RY2ERR_SUCCESS;
+}
+
+int WINAPI RY2_GenUID(int handle, DWORD* uid, char* seed, int isProtect)
+{
+    const UINT64 started = BeginStat();
+    volatile LONG* readers = EnterTable();
+    int ret;
+    RY2_Dongle* dongle = GetDongle(Table, handle, &ret);
+    // An invalid handle fails before the seed is read.
+    const SIZE_T seedLength = ret != (int)RY2ERR_NO_SUCH_DEVICE ? strlen(seed) : 0;
+    if (seedLength > 64)
+        ret = RY2ERR_TOO_LONG_SEED;
+    else if (dongle)
+        ret = GenDongleUID(dongle, uid, seed, isProtect);
+    LeaveTable(readers);
+    EndExportCall(RY2_STAT_GENUID, started, handle, isProtect, (DWORD)seedLength, 0, ret);
+    return ret;
+}
+
+/*
+ * Shared body of the block read exports. buffers[i] receives Block i for every
+ * block in the mask; the blocks' locks are taken together, in lock order, and
+ * any stale ones are reloaded with one storage read.
+ */
+static void ReadDongleBlocks(RY2_Dongle* dongle, DWORD block_mask, char* const buffers[RY2_BLOCK_COUNT])
+{
+    if (IsSharedImageLoaded(dongle))
+    {
+        for (int i = 0; i < RY2_BLOCK_COUNT; i++)
         {
-            OpenRegDongleKey(i);
-            if (!Dongles[i].mutex)
+            if (block_mask & RY2_BLOCK_MASK(i))
             {
-                char mutexName[15 + 1] = { 0 }; // ROCKEY2_MUTEX00 + '\0'
-                _snprintf(mutexName, sizeof mutexName - 1, "ROCKEY2_MUTEX%02d", i);
-                Dongles[i].mutex = CreateMutex(NULL, FALSE, mutexName);
+                ReadSharedImage(dongle, RY2_BLOCK_LOCK(i), dongle->shared->blocks[i], buffers[i], RY2_BLOCK_SIZE);
+                AddStat(RY2_STAT_BLOCK_CACHE_HITS, 1);
             }
-            if (Dongles[i].regKey && Dongles[i].mutex)
-            {
-                *hid = Dongles[i].hid;
-                return i;
-            }
-            CloseDongle(i);
-            return RY2ERR_OPEN_DEVICE;
         }
+        return;
     }
-    return RY2ERR_NO_SUCH_DEVICE;
+    LockDongleBlocks(dongle, block_mask);
+    SyncDongleBlocks(dongle, block_mask);
+    for (int i = 0; i < RY2_BLOCK_COUNT; i++)
+    {
+        if (block_mask & RY2_BLOCK_MASK(i))
+            memcpy(buffers[i], dongle->cacheBlocks[i], RY2_BLOCK_SIZE);
+    }
+    UnlockDongleBlocks(dongle, block_mask);
 }
 
-void WINAPI RY2_Close(int handle)
+static int WriteDongleBlocks(RY2_Dongle* dongle, DWORD block_mask, const char* const buffers[RY2_BLOCK_COUNT])
 {
-    if (handle < 0 || handle >= DongleCount)
-        return;
-    CloseDongle(handle);
+    if (dongle->isProtected)
+        return RY2ERR_WRITE_PROTECT;
+    LockDongleBlocks(dongle, block_mask);
+    StoreDongleBlocks(dongle, block_mask, buffers);
+    UnlockDongleBlocks(dongle, block_mask);
+    return RY2ERR_SUCCESS;
 }
 
-int WINAPI RY2_GenUID(int handle, DWORD* uid, char* seed, int isProtect)
+// Resolves the handle of a block transfer and runs it as a table reader.
+static int TransferDongleBlocks(int handle, DWORD block_mask, char* const read_buffers[RY2_BLOCK_COUNT], const char* const write_buffers[RY2_BLOCK_COUNT])
 {
-    if (handle < 0 || handle >= DongleCount)
-        return RY2ERR_NO_SUCH_DEVICE;
-    if (strlen(seed) > 64)
-        return RY2ERR_TOO_LONG_SEED;
-    if (!Dongles[handle].regKey || !Dongles[handle].mutex)
-        return RY2ERR_NOT_OPENED_DEVICE;
-    WaitForSingleObject(Dongles[handle].mutex, INFINITE);
-    EraseDongleBlocks(handle);
-    Dongles[handle].uid = GenUID(seed);
-    Dongles[handle].isProtected = isProtect;
-    WriteRegInfoValue(handle);
-    *uid = Dongles[handle].uid;
-    ReleaseMutex(Dongles[handle].mutex);
-    return RY2ERR_SUCCESS;
+    volatile LONG* readers = EnterTable();
+    int ret;
+    RY2_Dongle* dongle = GetDongle(Table, handle, &ret);
+    if (ret != (int)RY2ERR_NO_SUCH_DEVICE && (block_mask == 0 || (block_mask & ~RY2_ALL_BLOCKS)))
+        ret = RY2ERR_WRONG_INDEX;
+    else if (dongle && read_buffers)
+        ReadDongleBlocks(dongle, block_mask, read_buffers);
+    else if (dongle)
+        ret = WriteDongleBlocks(dongle, block_mask, write_buffers);
+    LeaveTable(readers);
+    return ret;
 }
 
 int WINAPI RY2_Read(int handle, int block_index, char* buffer512)
 {
-    if (handle < 0 || handle >= DongleCount)
-        return RY2ERR_NO_SUCH_DEVICE;
-    if (block_index < 0 || block_index >= RY2_BLOCK_COUNT)
-        return RY2ERR_WRONG_INDEX;
-    if (!Dongles[handle].regKey || !Dongles[handle].mutex)
-        return RY2ERR_NOT_OPENED_DEVICE;
-    WaitForSingleObject(Dongles[handle].mutex, INFINITE);
-    if (!ReadRegBlockValue(handle, block_index, buffer512))
-        memset(buffer512, 0xFF, 512);
-    ReleaseMutex(Dongles[handle].mutex);
-    return RY2ERR_SUCCESS;
+    const UINT64 started = BeginStat();
+    const DWORD blockMask = (block_index >= 0 && block_index < RY2_BLOCK_COUNT) ? RY2_BLOCK_MASK(block_index) : 0;
+    char* buffers[RY2_BLOCK_COUNT] = { NULL };
+    if (blockMask)
+        buffers[block_index] = buffer512;
+    const int ret = TransferDongleBlocks(handle, blockMask, buffers, NULL);
+    EndExportCall(RY2_STAT_READ, started, handle, block_index, 0, 0, ret);
+    return ret;
 }
 
 int WINAPI RY2_Write(int handle, int block_index, char* buffer512)
 {
-    if (handle < 0 || handle >= DongleCount)
-        return RY2ERR_NO_SUCH_DEVICE;
-    if (block_index < 0 || block_index >= RY2_BLOCK_COUNT)
-        return RY2ERR_WRONG_INDEX;
-    if (!Dongles[handle].regKey || !Dongles[handle].mutex)
-        return RY2ERR_NOT_OPENED_DEVICE;
-    if (Dongles[handle].isProtected)
-        return RY2ERR_WRITE_PROTECT;
-    WaitForSingleObject(Dongles[handle].mutex, INFINITE);
-    WriteRegBlockValue(handle, block_index, buffer512);
-    ReleaseMutex(Dongles[handle].mutex);
-    return RY2ERR_SUCCESS;
+    const UINT64 started = BeginStat();
+    const DWORD blockMask = (block_index >= 0 && block_index < RY2_BLOCK_COUNT) ? RY2_BLOCK_MASK(block_index) : 0;
+    const char* buffers[RY2_BLOCK_COUNT] = { NULL };
+    if (blockMask)
+        buffers[block_index] = buffer512;
+    const int ret = TransferDongleBlocks(handle, blockMask, NULL, buffers);
+    EndExportCall(RY2_STAT_WRITE, started, handle, block_index, 0, 0, ret);
+    return ret;
+}
+
+int WINAPI RY2_ReadBlocks(int handle, DWORD block_mask, char* buffer2560)
+{
+    const UINT64 started = BeginStat();
+    char* buffers[RY2_BLOCK_COUNT];
+    for (int i = 0; i < RY2_BLOCK_COUNT; i++)
+        buffers[i] = buffer2560 + i * RY2_BLOCK_SIZE;
+    const int ret = TransferDongleBlocks(handle, block_mask, buffers, NULL);
+    EndExportCall(RY2_STAT_READ_BLOCKS, started, handle, block_mask, 0, 0, ret);
+    return ret;
+}
+
+int WINAPI RY2_WriteBlocks(int handle, DWORD block_mask, char* buffer2560)
+{
+    const UINT64 started = BeginStat();
+    const char* buffers[RY2_BLOCK_COUNT];
+    for (int i = 0; i < RY2_BLOCK_COUNT; i++)
+        buffers[i] = buffer2560 + i * RY2_BLOCK_SIZE;
+    const int ret = TransferDongleBlocks(handle, block_mask, NULL, buffers);
+    EndExportCall(RY2_STAT_WRITE_BLOCKS, started, handle, block_mask, 0, 0, ret);
+    return ret;
+}
+
+int WINAPI RY2_GetWriteStats(int handle, int block_index, RY2_WriteStats* stats)
+{
+    const UINT64 started = BeginStat();
+    volatile LONG* readers = EnterTable();
+    int ret;
+    RY2_Dongle* dongle = GetDongle(Table, handle, &ret);
+    if (ret != (int)RY2ERR_NO_SUCH_DEVICE && (block_index < 0 || block_index >= RY2_BLOCK_COUNT))
+        ret = RY2ERR_WRONG_INDEX;
+    else if (dongle)
+    {
+        LockDongle(dongle, RY2_BLOCK_LOCK(block_index));
+        *stats = dongle->shared->writeStats[block_index];
+        UnlockDongle(dongle, RY2_BLOCK_LOCK(block_index));
+    }
+    LeaveTable(readers);
+    EndExportCall(RY2_STAT_GET_WRITE_STATS, started, handle, block_index, 0, 0, ret);
+    return ret;
+}
+
+int WINAPI RY2_Flush(int handle)
+{
+    const UINT64 started = BeginStat();
+    volatile LONG* readers = EnterTable();
+    int ret;
+    RY2_Dongle* dongle = GetDongle(Table, handle, &ret);
+    if (dongle)
+        FlushDongle(dongle);
+    LeaveTable(readers);
+    EndExportCall(RY2_STAT_FLUSH, started, handle, 0, 0, 0, ret);
+    return ret;
+}
+
+/*
+ * The generation of a block as reported to callers. It is one ahead of the
+ * shared counter, so that a caller starting from 0 always gets a first copy.
+ */
+static DWORD GetBlockGeneration(const RY2_Dongle* dongle, int block_index)
+{
+    return (DWORD)dongle->shared->generations[RY2_BLOCK_LOCK(block_index)] + 1;
+}
+
+/*
+ * Copies the block only if its generation differs from *generation, which
+ * then receives the generation read before the copy. A write racing with the
+ * copy may be reported again by the next call, but never missed.
+ */
+int WINAPI RY2_ReadIfChanged(int handle, int block_index, DWORD* generation, char* buffer512)
+{
+    const UINT64 started = BeginStat();
+    const DWORD requestedGeneration = *generation;
+    volatile LONG* readers = EnterTable();
+    int ret;
+    RY2_Dongle* dongle = GetDongle(Table, handle, &ret);
+    if (ret != (int)RY2ERR_NO_SUCH_DEVICE && (block_index < 0 || block_index >= RY2_BLOCK_COUNT))
+        ret = RY2ERR_WRONG_INDEX;
+    else if (dongle)
+    {
+        const DWORD current = GetBlockGeneration(dongle, block_index);
+        if (current == *generation)
+            ret = RY2ERR_NOT_CHANGED;
+        else
+        {
+            char* buffers[RY2_BLOCK_COUNT] = { NULL };
+            buffers[block_index] = buffer512;
+            ReadDongleBlocks(dongle, RY2_BLOCK_MASK(block_index), buffers);
+            *generation = current;
+        }
+    }
+    LeaveTable(readers);
+    EndExportCall(RY2_STAT_READ_IF_CHANGED, started, handle, block_index, requestedGeneration, 0, ret);
+    return ret;
+}
+
+/*
+ * Waits until the block's generation differs from the given one, returning
+ * RY2ERR_NOT_CHANGED once timeout_ms (or never, for INFINITE) has passed.
+ * The table is left between sleeps of at most RY2_WAIT_SLICE_MS, so that a
+ * waiting thread holds up RY2_Find no longer than that.
+ */
+int WINAPI RY2_WaitBlockChange(int handle, int block_index, DWORD generation, DWORD timeout_ms)
+{
+    const UINT64 started = BeginStat();
+    const DWORD start = GetTickCount();
+    int ret;
+    for (;;)
+    {
+        volatile LONG* readers = EnterTable();
+        RY2_Dongle* dongle = GetDongle(Table, handle, &ret);
+        BOOL waited = FALSE;
+        if (ret != (int)RY2ERR_NO_SUCH_DEVICE && (block_index < 0 || block_index >= RY2_BLOCK_COUNT))
+            ret = RY2ERR_WRONG_INDEX;
+        else if (dongle)
+        {
+            // Read before the generation, so that a change in between is not slept through.
+            const LONG sequence = dongle->shared->blockSignal.sequence;
+            const DWORD elapsed = GetTickCount() - start;
+            if (GetBlockGeneration(dongle, block_index) != generation)
+                ret = RY2ERR_SUCCESS;
+            else if (timeout_ms != INFINITE && elapsed >= timeout_ms)
+                ret = RY2ERR_NOT_CHANGED;
+            else
+            {
+                const DWORD remaining = timeout_ms == INFINITE ? INFINITE : timeout_ms - elapsed;
+                WaitForSignal(&dongle->shared->blockSignal, sequence, dongle->signalEvent, remaining < RY2_WAIT_SLICE_MS ? remaining : RY2_WAIT_SLICE_MS);
+                waited = TRUE;
+            }
+        }
+        LeaveTable(readers);
+        if (!waited)
+            break;
+    }
+    EndExportCall(RY2_STAT_WAIT_BLOCK_CHANGE, started, handle, block_index, generation, timeout_ms, ret);
+    return ret;
+}
+
+static DWORD GetDongleUID(RY2_Dongle* dongle)
+{
+    DWORD uid;
+    if (IsSharedImageLoaded(dongle))
+        ReadSharedImage(dongle, RY2_IDENTITY_LOCK, &dongle->shared->info[1], &uid, sizeof uid);
+    else
+    {
+        LockDongle(dongle, RY2_IDENTITY_LOCK);
+        SyncDongleInfo(dongle);
+        uid = dongle->uid;
+        UnlockDongle(dongle, RY2_IDENTITY_LOCK);
+    }
+    return uid;
+}
+
+/*
+ * Hands out a read-only view of the shared image, so that readers can check a
+ * few bytes in place without copying the block or taking its lock. The view
+ * is mapped once per handle inside the flush section and reference-counted;
+ * every successful call must be matched by RY2_UnmapBlocks.
+ */
+int WINAPI RY2_MapBlocks(int handle, RY2_BlockMap* map)
+{
+    const UINT64 started = BeginStat();
+    EnterFlushSection();
+    int ret;
+    RY2_Dongle* dongle = GetDongle(Table, handle, &ret);
+    if (dongle && !IsSharedImageLoaded(dongle))
+        ret = RY2ERR_NOT_SUPPORTED;
+    else if (dongle && !dongle->blockView)
+    {
+        char sharedName[19 + 1] = { 0 }; // ROCKEY2_SHARED65535 + '\0'
+        _snprintf(sharedName, sizeof sharedName - 1, "ROCKEY2_SHARED%02d", handle);
+        dongle->blockView = (const RY2_DongleShared*)OpenSharedMemoryView(sharedName, sizeof(RY2_DongleShared), &dongle->blockViewMapping);
+        if (!dongle->blockView)
+            ret = RY2ERR_OPEN_DEVICE;
+    }
+    if (ret == RY2ERR_SUCCESS)
+    {
+        dongle->blockViewCount++;
+        map->blocks = dongle->blockView->blocks;
+        map->versions = &dongle->blockView->sequences[RY2_BLOCK_LOCK(0)];
+    }
+    LeaveFlushSection();
+    EndExportCall(RY2_STAT_MAP_BLOCKS, started, handle, 0, 0, 0, ret);
+    return ret;
+}
+
+// Also accepted after RY2_Close, which leaves the view mapped.
+int WINAPI RY2_UnmapBlocks(int handle)
+{
+    const UINT64 started = BeginStat();
+    EnterFlushSection();
+    int ret = RY2ERR_NO_SUCH_DEVICE;
+    if (handle >= 0 && handle < Table->count)
+    {
+        RY2_Dongle* dongle = Table->dongles[handle];
+        ret = dongle && dongle->blockView ? RY2ERR_SUCCESS : RY2ERR_NOT_OPENED_DEVICE;
+        if (ret == RY2ERR_SUCCESS && !--dongle->blockViewCount)
+            UnmapBlockView(dongle);
+    }
+    LeaveFlushSection();
+    EndExportCall(RY2_STAT_UNMAP_BLOCKS, started, handle, 0, 0, 0, ret);
+    return ret;
 }
 
 int WINAPI RY2_GetVersion(int handle)
 {
-    if (handle < 0 || handle >= DongleCount)
-        return RY2ERR_NO_SUCH_DEVICE;
-    if (!Dongles[handle].regKey || !Dongles[handle].mutex)
-        return RY2ERR_NOT_OPENED_DEVICE;
-    return Dongles[handle].version;
+    const UINT64 started = BeginStat();
+    volatile LONG* readers = EnterTable();
+    int ret;
+    RY2_Dongle* dongle = GetDongle(Table, handle, &ret);
+    if (dongle && IsSharedImageLoaded(dongle))
+    {
+        DWORD version;
+        ReadSharedImage(dongle, RY2_IDENTITY_LOCK, &dongle->shared->info[2], &version, sizeof version);
+        ret = version;
+    }
+    else if (dongle)
+        ret = dongle->version;
+    LeaveTable(readers);
+    EndExportCall(RY2_STAT_GET_VERSION, started, handle, 0, 0, 0, ret);
+    return ret;
 }
 
 int WINAPI RY2_Transform(int handle, int len, BYTE* data)
 {
-    if (handle < 0 || handle >= DongleCount)
-        return RY2ERR_NO_SUCH_DEVICE;
-    if (!Dongles[handle].regKey || !Dongles[handle].mutex)
-        return RY2ERR_NOT_OPENED_DEVICE;
-    WaitForSingleObject(Dongles[handle].mutex, INFINITE);
-    int ret = Transform(Dongles[handle].uid, data, len);
-    ReleaseMutex(Dongles[handle].mutex);
+    const UINT64 started = BeginStat();
+    volatile LONG* readers = EnterTable();
+    int ret;
+    RY2_Dongle* dongle = GetDongle(Table, handle, &ret);
+    if (dongle)
+        ret = CachedTransform(GetDongleUID(dongle), data, len);
+    LeaveTable(readers);
+    EndExportCall(RY2_STAT_TRANSFORM, started, handle, len, 0, 0, ret);
+    return ret;
+}
+
+int WINAPI RY2_TransformBatch(int handle, int count, int* lens, BYTE** datas)
+{
+    const UINT64 started = BeginStat();
+    volatile LONG* readers = EnterTable();
+    int ret;
+    RY2_Dongle* dongle = GetDongle(Table, handle, &ret);
+    if (dongle && count > 0)
+        ret = CachedTransformBatch(GetDongleUID(dongle), count, lens, datas, NULL);
+    LeaveTable(readers);
+    EndExportCall(RY2_STAT_TRANSFORM_BATCH, started, handle, count, 0, 0, ret);
     return ret;
 }
 
@@ -303,6 +1418,20 @@ BOOL APIENTRY DllMain( HMODULE hModule,
         ProcessHeap = GetProcessHeap();
         if (!ProcessHeap)
             return FALSE;
+        InitStats();
+        Storage = SelectStorageBackend();
+        char sharedImage[1 + 1] = { 0 };
+        SharedImage = GetStorageSetting("ROCKEY2_SHARED_IMAGE", sharedImage, sizeof sharedImage) && sharedImage[0] == '1';
+        const DWORD writeBehindDelay = GetNumericSetting("ROCKEY2_WRITE_BEHIND", 0);
+        if (writeBehindDelay)
+        {
+            // Write-behind keeps the only current copy in the shared image.
+            WriteBehind = TRUE;
+            SharedImage = TRUE;
+        }
+        InitTrace(ProcessHeap);
+        InitFlusher(writeBehindDelay, (WriteBehind || Storage->Maintain || Tracing) ? FlushDongles : NULL);
+        InitTransformCache(ProcessHeap);
         DisableThreadLibraryCalls(hModule);
         break;
     }
@@ -311,9 +1440,31 @@ BOOL APIENTRY DllMain( HMODULE hModule,
         break;
     case DLL_PROCESS_DETACH:
     {
-        Cleanup();
+        // Cleanup drains write-behind data, and ShutdownTrace the queued calls,
+        // unless the process is terminating with the flusher killed halfway
+        // through a flush.
+        if (StopFlusher(lpReserved == NULL))
+        {
+            Cleanup();
+            ShutdownTrace(ProcessHeap);
+        }
+        Storage->Shutdown();
+        ShutdownTransformCache(ProcessHeap);
+        ShutdownStats();
         break;
     }
     }
     return TRUE;
 }
+
+#ifndef _WIN32
+__attribute__((constructor)) static void LibraryAttach(void)
+{
+    DllMain(NULL, DLL_PROCESS_ATTACH, NULL);
+}
+
+__attribute__((destructor)) static void LibraryDetach(void)
+{
+    DllMain(NULL, DLL_PROCESS_DETACH, NULL);
+}
+#endif
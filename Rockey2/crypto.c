@@ -19,9 +19,11 @@
  */
 
 #include <string.h>
+#include "platform.h"
 #include "crypto.h"
+#include "md5_rounds.h"
 
-#define MD5_ROTL(w,x,g,s,t) w=x+_rotl((w+f+t+buf[g]),s);
+#define MD5_ROTL(w,x,g,s,t) w=x+_rotl((w+f+MD5_KM(t,g)),s);
 #define MD5_R0(w,x,y,z,g,s,t) f=(x&y)|(~x&z);MD5_ROTL(w,x,g,s,t)
 #define MD5_R1(w,x,y,z,g,s,t) f=(z&x)|(~z&y);MD5_ROTL(w,x,g,s,t)
 #define MD5_R2(w,x,y,z,g,s,t) f=x^y^z;MD5_ROTL(w,x,g,s,t)
@@ -35,7 +37,13 @@ static const uint32_t MD5_InitState[16] =
     0x9086D35D, 0x2EBA8A42, 0x60965967, 0x22B7AC16
 };
 
-static void MD5_Transform(uint32_t* state, const void* buffer)
+/*
+ * MD5_KM(t, g) is the round constant t plus message word g. The specialized
+ * kernels below redefine it so that words known at compile time fold into t.
+ */
+#define MD5_KM(t,g) (t+buf[g])
+
+void MD5_Transform(uint32_t* state, const void* buffer)
 {
     const uint32_t* buf = (const uint32_t*)buffer;
     uint32_t a = state[0];
@@ -44,70 +52,31 @@ static void MD5_Transform(uint32_t* state, const void* buffer)
     uint32_t d = state[3];
     uint32_t f;
 
-    MD5_R0(a, b, c, d, 0, 7, 0xD76AA478);
-    MD5_R0(d, a, b, c, 1, 12, 0xE8C7B756);
-    MD5_R0(c, d, a, b, 2, 17, 0x242070DB);
-    MD5_R0(b, c, d, a, 3, 22, 0xC1BDCEEE);
-    MD5_R0(a, b, c, d, 4, 7, 0xF57C0FAF);
-    MD5_R0(d, a, b, c, 5, 12, 0x4787C62A);
-    MD5_R0(c, d, a, b, 6, 17, 0xA8304613);
-    MD5_R0(b, c, d, a, 7, 22, 0xFD469501);
-    MD5_R0(a, b, c, d, 8, 7, 0x698098D8);
-    MD5_R0(d, a, b, c, 9, 12, 0x8B44F7AF);
-    MD5_R0(c, d, a, b, 10, 17, 0xFFFF5BB1);
-    MD5_R0(b, c, d, a, 11, 22, 0x895CD7BE);
-    MD5_R0(a, b, c, d, 12, 7, 0x6B901122);
-    MD5_R0(d, a, b, c, 13, 12, 0xFD987193);
-    MD5_R0(c, d, a, b, 14, 17, 0xA679438E);
-    MD5_R0(b, c, d, a, 15, 22, 0x49B40821);
-    MD5_R1(a, b, c, d, 1, 5, 0xF61E2562);
-    MD5_R1(d, a, b, c, 6, 9, 0xC040B340);
-    MD5_R1(c, d, a, b, 11, 14, 0x265E5A51);
-    MD5_R1(b, c, d, a, 0, 20, 0xE9B6C7AA);
-    MD5_R1(a, b, c, d, 5, 5, 0xD62F105D);
-    MD5_R1(d, a, b, c, 10, 9, 0x02441453);
-    MD5_R1(c, d, a, b, 15, 14, 0xD8A1E681);
-    MD5_R1(b, c, d, a, 4, 20, 0xE7D3FBC8);
-    MD5_R1(a, b, c, d, 9, 5, 0x21E1CDE6);
-    MD5_R1(d, a, b, c, 14, 9, 0xC33707D6);
-    MD5_R1(c, d, a, b, 3, 14, 0xF4D50D87);
-    MD5_R1(b, c, d, a, 8, 20, 0x455A14ED);
-    MD5_R1(a, b, c, d, 13, 5, 0xA9E3E905);
-    MD5_R1(d, a, b, c, 2, 9, 0xFCEFA3F8);
-    MD5_R1(c, d, a, b, 7, 14, 0x676F02D9);
-    MD5_R1(b, c, d, a, 12, 20, 0x8D2A4C8A);
-    MD5_R2(a, b, c, d, 5, 4, 0xFFFA3942);
-    MD5_R2(d, a, b, c, 8, 11, 0x8771F681);
-    MD5_R2(c, d, a, b, 11, 16, 0x6D9D6122);
-    MD5_R2(b, c, d, a, 14, 23, 0xFDE5380C);
-    MD5_R2(a, b, c, d, 1, 4, 0xA4BEEA44);
-    MD5_R2(d, a, b, c, 4, 11, 0x4BDECFA9);
-    MD5_R2(c, d, a, b, 7, 16, 0xF6BB4B60);
-    MD5_R2(b, c, d, a, 10, 23, 0xBEBFBC70);
-    MD5_R2(a, b, c, d, 13, 4, 0x289B7EC6);
-    MD5_R2(d, a, b, c, 0, 11, 0xEAA127FA);
-    MD5_R2(c, d, a, b, 3, 16, 0xD4EF3085);
-    MD5_R2(b, c, d, a, 6, 23, 0x04881D05);
-    MD5_R2(a, b, c, d, 9, 4, 0xD9D4D039);
-    MD5_R2(d, a, b, c, 12, 11, 0xE6DB99E5);
-    MD5_R2(c, d, a, b, 15, 16, 0x1FA27CF8);
-    MD5_R2(b, c, d, a, 2, 23, 0xC4AC5665);
-    MD5_R3(a, b, c, d, 0, 6, 0xF4292244);
-    MD5_R3(d, a, b, c, 7, 10, 0x432AFF97);
-    MD5_R3(c, d, a, b, 14, 15, 0xAB9423A7);
-    MD5_R3(b, c, d, a, 5, 21, 0xFC93A039);
-    MD5_R3(a, b, c, d, 12, 6, 0x655B59C3);
-    MD5_R3(d, a, b, c, 3, 10, 0x8F0CCC92);
-    MD5_R3(c, d, a, b, 10, 15, 0xFFEFF47D);
-    MD5_R3(b, c, d, a, 1, 21, 0x85845DD1);
-    MD5_R3(a, b, c, d, 8, 6, 0x6FA87E4F);
-    MD5_R3(d, a, b, c, 15, 10, 0xFE2CE6E0);
-    MD5_R3(c, d, a, b, 6, 15, 0xA3014314);
-    MD5_R3(b, c, d, a, 13, 21, 0x4E0811A1);
-    MD5_R3(a, b, c, d, 4, 6, 0xF7537E82);
-    MD5_R3(d, a, b, c, 11, 10, 0xBD3AF235);
-    MD5_R3(c, d, a, b, 2, 15, 0x2AD7D2BB);
-    MD5_R3(b, c, d, a, 9, 21, 0xEB86D391);
+    MD5_ROUNDS(MD5_R0, MD5_R1, MD5_R2, MD5_R3)
+
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+}
+
+#undef MD5_KM
+
+/*
+ * Outer HMAC pass: the block is the 16-byte inner state followed by the
+ * constant padding of a 16-byte message, so only words 0-3 are read.
+ */
+#define MD5_KM(t,g) ((g) < 4 ? t + inner[(g) & 3] : (uint32_t)(t + MD5_OUTER_WORD(g)))
+
+void MD5_TransformOuter(uint32_t* state, const uint32_t* inner)
+{
+    uint32_t a = state[0];
+    uint32_t b = state[1];
+    uint32_t c = state[2];
+    uint32_t d = state[3];
+    uint32_t f;
+
+    MD5_ROUNDS(MD5_R0, MD5_R1, MD5_R2, MD5_R3)
 
     state[0] += a;
     state[1] += b;
@@ -115,32 +84,100 @@ static void MD5_Transform(uint32_t* state, const void* buffer)
     state[3] += d;
 }
 
-static void MD5_Final_HMAC(uint32_t* state, uint8_t* buffer, uint64_t len)
+#undef MD5_KM
+
+/*
+ * Inner HMAC pass over a 55-byte message: byte 55 is the 0x80 terminator and
+ * words 14-15 hold the constant bit count, so the caller's buffer needs no
+ * padding and whatever it holds past byte 54 is ignored.
+ */
+#define MD5_KM(t,g) ((g) < 13 ? t + buf[g] : (g) == 13 ? t + ((buf[13] & 0x00FFFFFF) | 0x80000000) : (uint32_t)(t + MD5_INNER55_WORD(g)))
+
+static void MD5_TransformInner55(uint32_t* state, const void* buffer)
+{
+    const uint32_t* buf = (const uint32_t*)buffer;
+    uint32_t a = state[0];
+    uint32_t b = state[1];
+    uint32_t c = state[2];
+    uint32_t d = state[3];
+    uint32_t f;
+
+    MD5_ROUNDS(MD5_R0, MD5_R1, MD5_R2, MD5_R3)
+
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+}
+
+#undef MD5_KM
+
+static void MD5_Pad_HMAC(uint8_t* buffer, uint64_t len)
 {
     const uint64_t bitcount = (len + 64) * 8;
     buffer[len] = 0x80;
     memcpy(buffer + 56, &bitcount, sizeof bitcount);
-    MD5_Transform(state, buffer);
 }
 
-uint32_t GenUID(const char* seed)
+static void MD5_HMAC55(uint32_t* state_ipad, uint32_t* state_opad, const uint8_t* buffer)
 {
-    uint32_t state_ipad[16] = { 0 };
-    uint32_t state_opad[4] = { 0 };
-    memcpy(state_ipad, MD5_InitState, 16);
-    memcpy(state_opad, MD5_InitState + 4, 16);
+    MD5_TransformInner55(state_ipad, buffer);
+    MD5_TransformOuter(state_opad, state_ipad);
+}
 
-    uint8_t buffer[64] = { 0 };
-    strncpy(buffer, seed, sizeof buffer);
+/*
+ * Transform keys both pads with the uid; the keyed initial states are built
+ * once per call and reused by every pass.
+ */
+static void PrepareTransformKey(uint32_t uid, uint32_t* key_ipad, uint32_t* key_opad)
+{
+    for (int j = 0; j < 4; j++)
+    {
+        key_ipad[j] = MD5_InitState[j] ^ uid;
+        key_opad[j] = MD5_InitState[4 + j] ^ uid;
+    }
+}
 
+/*
+ * Batched counterpart of the two MD5_Final_HMAC calls in GenUID and Transform:
+ * runs the inner pass of every item through the multi-buffer kernel, then
+ * the outer pass over the resulting inner states.
+ */
+static void MD5_Final_HMAC_Many(uint32_t (*state_ipad)[4], uint32_t (*state_opad)[4], uint32_t (*buffer)[16], int count)
+{
+    const uint32_t* blocks[MD5_BATCH_SIZE] = { 0 };
+    for (int k = 0; k < count; k++)
+    {
+        MD5_Pad_HMAC((uint8_t*)buffer[k], 55);
+        blocks[k] = buffer[k];
+    }
+    MD5_TransformMany(state_ipad, blocks, count);
+    MD5_TransformOuterMany(state_opad, (const uint32_t (*)[4])state_ipad, count);
+}
+
+static void PrepareSeed(uint8_t* buffer, const char* seed)
+{
+    // The seed fills the zeroed block; one of 64 characters is left unterminated.
+    for (int i = 0; i < 64 && seed[i]; i++)
+        buffer[i] = (uint8_t)seed[i];
     for (uint8_t i = 0, tail = 55; i < 54; i++)
     {
         buffer[i] ^= buffer[tail++];
         if (tail == 64) tail = 55;
     }
+}
+
+uint32_t GenUID(const char* seed)
+{
+    uint32_t state_ipad[4] = { 0 };
+    uint32_t state_opad[4] = { 0 };
+    memcpy(state_ipad, MD5_InitState, 16);
+    memcpy(state_opad, MD5_InitState + 4, 16);
 
-    MD5_Final_HMAC(state_ipad, buffer, 55);
-    MD5_Final_HMAC(state_opad, (uint8_t*)state_ipad, 16);
+    uint8_t buffer[64] = { 0 };
+    PrepareSeed(buffer, seed);
+
+    MD5_HMAC55(state_ipad, state_opad, buffer);
 
     return state_opad[0];
 }
@@ -154,21 +191,19 @@ int Transform(uint32_t uid, uint8_t* data, int len)
     uint64_t data_temp[4] = { 0 };
     memcpy(data_temp, data, len);
 
+    uint32_t key_ipad[4];
+    uint32_t key_opad[4];
+    PrepareTransformKey(uid, key_ipad, key_opad);
+
     for (int i = 0; i < 2; i++)
     {
-        uint32_t state_ipad[16] = { 0 };
-        uint32_t state_opad[4] = { 0 };
-        memcpy(state_ipad, MD5_InitState, 16);
-        memcpy(state_opad, MD5_InitState + 4, 16);
-        for (int j = 0; j < 4; j++)
-        {
-            state_ipad[j] ^= uid;
-            state_opad[j] ^= uid;
-        }
+        uint32_t state_ipad[4];
+        uint32_t state_opad[4];
+        memcpy(state_ipad, key_ipad, 16);
+        memcpy(state_opad, key_opad, 16);
         uint8_t buffer[64] = { 0 };
         memcpy(buffer + (((uint8_t*)data_temp)[i * 16] % 23), data_temp, len);
-        MD5_Final_HMAC(state_ipad, buffer, 55);
-        MD5_Final_HMAC(state_opad, (uint8_t*)state_ipad, 16);
+        MD5_HMAC55(state_ipad, state_opad, buffer);
         memcpy(xor_key + i * 2, state_opad, 16);
     }
 
@@ -179,16 +214,102 @@ int Transform(uint32_t uid, uint8_t* data, int len)
     return 0;
 }
 
+void GenUIDBatch(int count, const char* const* seeds, uint32_t* uids)
+{
+    for (int base = 0; base < count; base += MD5_BATCH_SIZE)
+    {
+        const int n = count - base < MD5_BATCH_SIZE ? count - base : MD5_BATCH_SIZE;
+        uint32_t state_ipad[MD5_BATCH_SIZE][4];
+        uint32_t state_opad[MD5_BATCH_SIZE][4];
+        uint32_t buffer[MD5_BATCH_SIZE][16];
+        for (int k = 0; k < n; k++)
+        {
+            memcpy(state_ipad[k], MD5_InitState, 16);
+            memcpy(state_opad[k], MD5_InitState + 4, 16);
+            memset(buffer[k], 0, sizeof buffer[k]);
+            PrepareSeed((uint8_t*)buffer[k], seeds[base + k]);
+        }
+        MD5_Final_HMAC_Many(state_ipad, state_opad, buffer, n);
+        for (int k = 0; k < n; k++)
+            uids[base + k] = state_opad[k][0];
+    }
+}
+
+static void TransformChunk(uint32_t uid, int count, const int* lens, uint8_t* const* datas)
+{
+    uint64_t data_temp[MD5_BATCH_SIZE][4] = { 0 };
+    uint64_t xor_key[MD5_BATCH_SIZE][4];
+    for (int k = 0; k < count; k++)
+        memcpy(data_temp[k], datas[k], lens[k]);
+
+    uint32_t key_ipad[4];
+    uint32_t key_opad[4];
+    PrepareTransformKey(uid, key_ipad, key_opad);
+
+    for (int i = 0; i < 2; i++)
+    {
+        uint32_t state_ipad[MD5_BATCH_SIZE][4];
+        uint32_t state_opad[MD5_BATCH_SIZE][4];
+        uint32_t buffer[MD5_BATCH_SIZE][16];
+        for (int k = 0; k < count; k++)
+        {
+            memcpy(state_ipad[k], key_ipad, 16);
+            memcpy(state_opad[k], key_opad, 16);
+            memset(buffer[k], 0, sizeof buffer[k]);
+            memcpy((uint8_t*)buffer[k] + (((uint8_t*)data_temp[k])[i * 16] % 23), data_temp[k], lens[k]);
+        }
+        MD5_Final_HMAC_Many(state_ipad, state_opad, buffer, count);
+        for (int k = 0; k < count; k++)
+            memcpy(xor_key[k] + i * 2, state_opad[k], 16);
+    }
+
+    for (int k = 0; k < count; k++)
+    {
+        for (int i = 0; i < 4; i++)
+            data_temp[k][i] ^= xor_key[k][i];
+        memcpy(datas[k], data_temp[k], lens[k]);
+    }
+}
+
+int TransformBatch(uint32_t uid, int count, const int* lens, uint8_t* const* datas, int* results)
+{
+    int ret = 0;
+    int chunkLens[MD5_BATCH_SIZE];
+    uint8_t* chunkDatas[MD5_BATCH_SIZE];
+    int chunkCount = 0;
+    for (int k = 0; k < count; k++)
+    {
+        const int result = (lens[k] == 0 || lens[k] > 32) ? 0xB7 : 0;
+        if (results)
+            results[k] = result;
+        if (result)
+        {
+            if (!ret)
+                ret = result;
+            continue;
+        }
+        chunkLens[chunkCount] = lens[k];
+        chunkDatas[chunkCount] = datas[k];
+        if (++chunkCount == MD5_BATCH_SIZE)
+        {
+            TransformChunk(uid, chunkCount, chunkLens, chunkDatas);
+            chunkCount = 0;
+        }
+    }
+    if (chunkCount)
+        TransformChunk(uid, chunkCount, chunkLens, chunkDatas);
+    return ret;
+}
+
 void Transform_Factory(const uint8_t* challenge, uint8_t* response)
 {
-    uint32_t state_ipad[16] = { 0 };
+    uint32_t state_ipad[4] = { 0 };
     uint32_t state_opad[4] = { 0 };
     memcpy(state_ipad, MD5_InitState + 8, 16);
     memcpy(state_opad, MD5_InitState + 12, 16);
 
     uint8_t buffer[64] = { 0 };
     memcpy(buffer, challenge, 55);
-    MD5_Final_HMAC(state_ipad, buffer, 55);
-    MD5_Final_HMAC(state_opad, (uint8_t*)state_ipad, 16);
+    MD5_HMAC55(state_ipad, state_opad, buffer);
     memcpy(response, state_opad, 16);
 }
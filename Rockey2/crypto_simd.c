@@ -0,0 +1,229 @@
+/*
+ * This file is part of the Rockey2 EMU project authored by Brian218.
+ *
+ * Copyright (C) 2026 Brian218 (https://github.com/brian218)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#include <stdint.h>
+#include "crypto.h"
+#include "md5_rounds.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define MD5_LANES_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define MD5_TARGET(isa)
+#else
+#define MD5_TARGET(isa) __attribute__((target(isa)))
+#endif
+#endif
+
+typedef void (*MD5_LanesKernel)(uint32_t (*state)[4], const uint32_t* const* block);
+typedef void (*MD5_LanesOuterKernel)(uint32_t (*state)[4], const uint32_t (*inner)[4]);
+
+#ifdef MD5_LANES_X86
+
+#define MD5_LANES_NAME MD5_Transform_SSE2
+#define MD5_LANES_OUTER_NAME MD5_TransformOuter_SSE2
+#define MD5_LANES_TARGET MD5_TARGET("sse2")
+#define MD5_LANES_COUNT 4
+#define MD5_LANES_VEC __m128i
+#define MD5_LANES_LOAD(p) _mm_loadu_si128((const __m128i*)(p))
+#define MD5_LANES_STORE(p,x) _mm_storeu_si128((__m128i*)(p),x)
+#define MD5_LANES_SET1(x) _mm_set1_epi32((int)(x))
+#define MD5_LANES_ADD(x,y) _mm_add_epi32(x,y)
+#define MD5_LANES_AND(x,y) _mm_and_si128(x,y)
+#define MD5_LANES_OR(x,y) _mm_or_si128(x,y)
+#define MD5_LANES_XOR(x,y) _mm_xor_si128(x,y)
+#define MD5_LANES_ANDNOT(x,y) _mm_andnot_si128(x,y)
+#define MD5_LANES_ROTL(x,s) _mm_or_si128(_mm_slli_epi32(x,s),_mm_srli_epi32(x,32-(s)))
+#include "md5_lanes.h"
+#undef MD5_LANES_NAME
+#undef MD5_LANES_OUTER_NAME
+#undef MD5_LANES_TARGET
+#undef MD5_LANES_COUNT
+#undef MD5_LANES_VEC
+#undef MD5_LANES_LOAD
+#undef MD5_LANES_STORE
+#undef MD5_LANES_SET1
+#undef MD5_LANES_ADD
+#undef MD5_LANES_AND
+#undef MD5_LANES_OR
+#undef MD5_LANES_XOR
+#undef MD5_LANES_ANDNOT
+#undef MD5_LANES_ROTL
+
+#define MD5_LANES_NAME MD5_Transform_AVX2
+#define MD5_LANES_OUTER_NAME MD5_TransformOuter_AVX2
+#define MD5_LANES_TARGET MD5_TARGET("avx2")
+#define MD5_LANES_COUNT 8
+#define MD5_LANES_VEC __m256i
+#define MD5_LANES_LOAD(p) _mm256_loadu_si256((const __m256i*)(p))
+#define MD5_LANES_STORE(p,x) _mm256_storeu_si256((__m256i*)(p),x)
+#define MD5_LANES_SET1(x) _mm256_set1_epi32((int)(x))
+#define MD5_LANES_ADD(x,y) _mm256_add_epi32(x,y)
+#define MD5_LANES_AND(x,y) _mm256_and_si256(x,y)
+#define MD5_LANES_OR(x,y) _mm256_or_si256(x,y)
+#define MD5_LANES_XOR(x,y) _mm256_xor_si256(x,y)
+#define MD5_LANES_ANDNOT(x,y) _mm256_andnot_si256(x,y)
+#define MD5_LANES_ROTL(x,s) _mm256_or_si256(_mm256_slli_epi32(x,s),_mm256_srli_epi32(x,32-(s)))
+#include "md5_lanes.h"
+#undef MD5_LANES_NAME
+#undef MD5_LANES_OUTER_NAME
+#undef MD5_LANES_TARGET
+#undef MD5_LANES_COUNT
+#undef MD5_LANES_VEC
+#undef MD5_LANES_LOAD
+#undef MD5_LANES_STORE
+#undef MD5_LANES_SET1
+#undef MD5_LANES_ADD
+#undef MD5_LANES_AND
+#undef MD5_LANES_OR
+#undef MD5_LANES_XOR
+#undef MD5_LANES_ANDNOT
+#undef MD5_LANES_ROTL
+
+#define MD5_LANES_NAME MD5_Transform_AVX512
+#define MD5_LANES_OUTER_NAME MD5_TransformOuter_AVX512
+#define MD5_LANES_TARGET MD5_TARGET("avx512f")
+#define MD5_LANES_COUNT 16
+#define MD5_LANES_VEC __m512i
+#define MD5_LANES_LOAD(p) _mm512_loadu_si512((const void*)(p))
+#define MD5_LANES_STORE(p,x) _mm512_storeu_si512((void*)(p),x)
+#define MD5_LANES_SET1(x) _mm512_set1_epi32((int)(x))
+#define MD5_LANES_ADD(x,y) _mm512_add_epi32(x,y)
+#define MD5_LANES_AND(x,y) _mm512_and_si512(x,y)
+#define MD5_LANES_OR(x,y) _mm512_or_si512(x,y)
+#define MD5_LANES_XOR(x,y) _mm512_xor_si512(x,y)
+#define MD5_LANES_ANDNOT(x,y) _mm512_andnot_si512(x,y)
+#define MD5_LANES_ROTL(x,s) _mm512_rol_epi32(x,s)
+#include "md5_lanes.h"
+#undef MD5_LANES_NAME
+#undef MD5_LANES_OUTER_NAME
+#undef MD5_LANES_TARGET
+#undef MD5_LANES_COUNT
+#undef MD5_LANES_VEC
+#undef MD5_LANES_LOAD
+#undef MD5_LANES_STORE
+#undef MD5_LANES_SET1
+#undef MD5_LANES_ADD
+#undef MD5_LANES_AND
+#undef MD5_LANES_OR
+#undef MD5_LANES_XOR
+#undef MD5_LANES_ANDNOT
+#undef MD5_LANES_ROTL
+
+#ifdef _MSC_VER
+static int DetectLaneCount(void)
+{
+    int info[4] = { 0 };
+    __cpuid(info, 0);
+    const int maxLeaf = info[0];
+    __cpuid(info, 1);
+    const int sse2 = (info[3] >> 26) & 1;
+    const int osxsave = (info[2] >> 27) & 1;
+    if (!osxsave || maxLeaf < 7)
+        return sse2 ? 4 : 1;
+    const unsigned long long xcr0 = _xgetbv(0);
+    __cpuidex(info, 7, 0);
+    if ((info[1] >> 16) & 1 && (xcr0 & 0xE6) == 0xE6) // AVX-512F with opmask and ZMM state
+        return 16;
+    if ((info[1] >> 5) & 1 && (xcr0 & 0x06) == 0x06) // AVX2 with YMM state
+        return 8;
+    return sse2 ? 4 : 1;
+}
+#else
+static int DetectLaneCount(void)
+{
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f"))
+        return 16;
+    if (__builtin_cpu_supports("avx2"))
+        return 8;
+    if (__builtin_cpu_supports("sse2"))
+        return 4;
+    return 1;
+}
+#endif
+
+#endif
+
+static int LaneCount = 0;
+static MD5_LanesKernel LanesKernel = 0;
+static MD5_LanesOuterKernel LanesOuterKernel = 0;
+
+static void SelectLanesKernel(void)
+{
+    int laneCount = 1;
+    MD5_LanesKernel kernel = 0;
+    MD5_LanesOuterKernel outerKernel = 0;
+#ifdef MD5_LANES_X86
+    laneCount = DetectLaneCount();
+    if (laneCount == 16)
+    {
+        kernel = MD5_Transform_AVX512;
+        outerKernel = MD5_TransformOuter_AVX512;
+    }
+    else if (laneCount == 8)
+    {
+        kernel = MD5_Transform_AVX2;
+        outerKernel = MD5_TransformOuter_AVX2;
+    }
+    else if (laneCount == 4)
+    {
+        kernel = MD5_Transform_SSE2;
+        outerKernel = MD5_TransformOuter_SSE2;
+    }
+#endif
+    LanesKernel = kernel;
+    LanesOuterKernel = outerKernel;
+    LaneCount = laneCount;
+}
+
+int MD5_LaneCount(void)
+{
+    if (!LaneCount)
+        SelectLanesKernel();
+    return LaneCount;
+}
+
+void MD5_TransformMany(uint32_t (*state)[4], const uint32_t* const* block, int count)
+{
+    const int laneCount = MD5_LaneCount();
+    int i = 0;
+    if (LanesKernel)
+    {
+        for (; i + laneCount <= count; i += laneCount)
+            LanesKernel(state + i, block + i);
+    }
+    for (; i < count; i++)
+        MD5_Transform(state[i], block[i]);
+}
+
+void MD5_TransformOuterMany(uint32_t (*state)[4], const uint32_t (*inner)[4], int count)
+{
+    const int laneCount = MD5_LaneCount();
+    int i = 0;
+    if (LanesOuterKernel)
+    {
+        for (; i + laneCount <= count; i += laneCount)
+            LanesOuterKernel(state + i, inner + i);
+    }
+    for (; i < count; i++)
+        MD5_TransformOuter(state[i], inner[i]);
+}
@@ -0,0 +1,266 @@
+/*
+ * This file is part of the Rockey2 EMU project authored by Brian218.
+ *
+ * Copyright (C) 2026 Brian218 (https://github.com/brian218)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#include "platform.h"
+#include "flusher.h"
+
+#ifndef _WIN32
+#include <pthread.h>
+#include <time.h>
+#endif
+
+// How long a detaching process waits for the flusher to leave the library.
+#define RY2_FLUSHER_STOP_TIMEOUT_MS 1000
+
+static DWORD FlushDelay = 0;
+static void (*FlushCallback)(void) = NULL;
+static volatile LONG FlushPending = 0;
+static volatile LONG FlushRunning = 0;
+static volatile LONG FlusherStopping = 0;
+static BOOL FlusherStarted = FALSE;
+
+#ifdef _WIN32
+static CRITICAL_SECTION FlushSection;
+static CRITICAL_SECTION StartSection;
+static HANDLE WakeEvent = NULL;
+static HANDLE StopEvent = NULL;
+static HANDLE StoppedEvent = NULL;
+static HANDLE FlusherThread = NULL;
+#else
+static pthread_mutex_t FlushSection;
+static pthread_mutex_t StateMutex;
+static pthread_cond_t StateCond;
+static pthread_t FlusherThread;
+static pthread_once_t FlusherOnce = PTHREAD_ONCE_INIT;
+#endif
+
+static void RunFlush(void)
+{
+    InterlockedExchange(&FlushRunning, 1);
+    EnterFlushSection();
+    FlushCallback();
+    LeaveFlushSection();
+    InterlockedExchange(&FlushRunning, 0);
+}
+
+#ifdef _WIN32
+static DWORD WINAPI FlusherMain(LPVOID parameter)
+{
+    (void)parameter;
+    while (WaitForSingleObject(WakeEvent, INFINITE) == WAIT_OBJECT_0 && !FlusherStopping)
+    {
+        // The commit window: writes arriving meanwhile join this batch.
+        if (WaitForSingleObject(StopEvent, FlushDelay) == WAIT_OBJECT_0)
+            break;
+        InterlockedExchange(&FlushPending, 0);
+        RunFlush();
+    }
+    // Acknowledged instead of joined: a detaching DllMain holds the loader
+    // lock, which ExitThread needs, so the thread finishes exiting only after
+    // DllMain has returned.
+    SetEvent(StoppedEvent);
+    ExitThread(0);
+}
+
+void InitFlusher(DWORD delay_ms, void (*flush)(void))
+{
+    InitializeCriticalSection(&FlushSection);
+    InitializeCriticalSection(&StartSection);
+    FlushDelay = delay_ms;
+    FlushCallback = flush;
+}
+
+static void StartFlusher(void)
+{
+    EnterCriticalSection(&StartSection);
+    if (!FlusherStarted && !FlusherStopping)
+    {
+        WakeEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+        StopEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+        StoppedEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+        if (WakeEvent && StopEvent && StoppedEvent)
+            FlusherThread = CreateThread(NULL, 0, FlusherMain, NULL, 0, NULL);
+        FlusherStarted = FlusherThread != NULL;
+    }
+    LeaveCriticalSection(&StartSection);
+}
+
+void WakeFlusher(void)
+{
+    if (!FlushCallback || InterlockedExchange(&FlushPending, 1))
+        return;
+    if (!FlusherStarted)
+        StartFlusher();
+    if (FlusherStarted)
+        SetEvent(WakeEvent);
+}
+
+/*
+ * Returns FALSE if the flusher may have been stopped in the middle of a
+ * flush, in which case the caller must not flush or wait for dongle locks.
+ * That happens at process termination, when Windows has already killed the
+ * thread. On FreeLibrary the flusher is waited for until it has left its
+ * loop, and the caller then drains on its own thread.
+ */
+BOOL StopFlusher(BOOL wait)
+{
+    if (!FlushCallback)
+        return TRUE;
+    InterlockedExchange(&FlusherStopping, 1);
+    if (!FlusherStarted)
+        return TRUE;
+    SetEvent(StopEvent);
+    SetEvent(WakeEvent);
+    BOOL idle = !FlushRunning;
+    if (wait)
+        idle = WaitForSingleObject(StoppedEvent, RY2_FLUSHER_STOP_TIMEOUT_MS) == WAIT_OBJECT_0;
+    CloseHandle(FlusherThread);
+    CloseHandle(WakeEvent);
+    CloseHandle(StopEvent);
+    CloseHandle(StoppedEvent);
+    FlusherThread = WakeEvent = StopEvent = StoppedEvent = NULL;
+    FlusherStarted = FALSE;
+    return idle;
+}
+
+void EnterFlushSection(void)
+{
+    EnterCriticalSection(&FlushSection);
+}
+
+void LeaveFlushSection(void)
+{
+    LeaveCriticalSection(&FlushSection);
+}
+#else
+static void* FlusherMain(void* parameter)
+{
+    (void)parameter;
+    pthread_mutex_lock(&StateMutex);
+    for (;;)
+    {
+        while (!FlushPending && !FlusherStopping)
+            pthread_cond_wait(&StateCond, &StateMutex);
+        if (FlusherStopping)
+            break;
+        // The commit window: writes arriving meanwhile join this batch.
+        struct timespec deadline;
+        clock_gettime(CLOCK_MONOTONIC, &deadline);
+        deadline.tv_sec += FlushDelay / 1000;
+        deadline.tv_nsec += (long)(FlushDelay % 1000) * 1000000;
+        if (deadline.tv_nsec >= 1000000000)
+        {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000;
+        }
+        while (!FlusherStopping && pthread_cond_timedwait(&StateCond, &StateMutex, &deadline) == 0)
+            ;
+        if (FlusherStopping)
+            break;
+        InterlockedExchange(&FlushPending, 0);
+        pthread_mutex_unlock(&StateMutex);
+        RunFlush();
+        pthread_mutex_lock(&StateMutex);
+    }
+    pthread_mutex_unlock(&StateMutex);
+    return NULL;
+}
+
+static void InitFlusherState(void)
+{
+    pthread_mutexattr_t mutexAttr;
+    pthread_mutexattr_init(&mutexAttr);
+    pthread_mutexattr_settype(&mutexAttr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&FlushSection, &mutexAttr);
+    pthread_mutexattr_destroy(&mutexAttr);
+    pthread_mutex_init(&StateMutex, NULL);
+    pthread_condattr_t condAttr;
+    pthread_condattr_init(&condAttr);
+    pthread_condattr_setclock(&condAttr, CLOCK_MONOTONIC);
+    pthread_cond_init(&StateCond, &condAttr);
+    pthread_condattr_destroy(&condAttr);
+}
+
+// A forked child has no flusher thread, and the parent's one may have held
+// the mutexes; the child starts afresh and gets its own thread on its first
+// write.
+static void ResetFlusher(void)
+{
+    InitFlusherState();
+    FlusherStarted = FALSE;
+    FlushPending = 0;
+    FlushRunning = 0;
+}
+
+static void InitFlusherOnce(void)
+{
+    InitFlusherState();
+    pthread_atfork(NULL, NULL, ResetFlusher);
+}
+
+void InitFlusher(DWORD delay_ms, void (*flush)(void))
+{
+    pthread_once(&FlusherOnce, InitFlusherOnce);
+    FlushDelay = delay_ms;
+    FlushCallback = flush;
+}
+
+void WakeFlusher(void)
+{
+    if (!FlushCallback || InterlockedExchange(&FlushPending, 1))
+        return;
+    pthread_mutex_lock(&StateMutex);
+    if (!FlusherStarted && !FlusherStopping)
+        FlusherStarted = pthread_create(&FlusherThread, NULL, FlusherMain, NULL) == 0;
+    pthread_cond_broadcast(&StateCond);
+    pthread_mutex_unlock(&StateMutex);
+}
+
+BOOL StopFlusher(BOOL wait)
+{
+    if (!FlushCallback)
+        return TRUE;
+    pthread_mutex_lock(&StateMutex);
+    InterlockedExchange(&FlusherStopping, 1);
+    const BOOL started = FlusherStarted;
+    FlusherStarted = FALSE;
+    pthread_cond_broadcast(&StateCond);
+    pthread_mutex_unlock(&StateMutex);
+    if (!started)
+        return TRUE;
+    if (!wait)
+    {
+        pthread_detach(FlusherThread);
+        return !FlushRunning;
+    }
+    pthread_join(FlusherThread, NULL);
+    return TRUE;
+}
+
+void EnterFlushSection(void)
+{
+    pthread_mutex_lock(&FlushSection);
+}
+
+void LeaveFlushSection(void)
+{
+    pthread_mutex_unlock(&FlushSection);
+}
+#endif
@@ -1,4 +1,4 @@
-/*
+﻿/*
  * This file is part of the Rockey2 EMU project authored by Brian218.
  * 
  * Copyright (C) 2026 Brian218 (https://github.com/brian218)
@@ -28,17 +28,179 @@
 #define RY2ERR_TOO_LONG_SEED        0xA0100005
 #define RY2ERR_WRITE_PROTECT        0xA0100006
 #define RY2ERR_OPEN_DEVICE          0xA0100007
+#define RY2ERR_NOT_CHANGED          0xA0100008 // Not a failure: see RY2_ReadIfChanged
+#define RY2ERR_NOT_SUPPORTED        0xA0100009 // RY2_MapBlocks outside shared image mode
+
+/*
+ * Each dongle has one lock per block plus an identity lock guarding the info
+ * values, so that accesses to different blocks never wait for each other.
+ * Lock order: whenever more than one lock is held they are acquired in
+ * ascending lock index (identity first, then Block0 to Block4) and released
+ * in reverse. RY2_GenUID and RY2_Open are the only callers holding them all.
+ */
+#define RY2_IDENTITY_LOCK 0
+#define RY2_BLOCK_LOCK(block_index) ((block_index) + 1)
+#define RY2_LOCK_COUNT (RY2_BLOCK_COUNT + 1)
+
+/*
+ * Write counters of one block, kept in the shared segment so that they cover
+ * every process using the dongle. A write whose data matches the current
+ * block is elided: it never reaches storage. A write that changes the block
+ * counts in writes, even when write-behind later merges it with others, and
+ * adds the length of its changed range (first to last differing byte) to
+ * dirtyBytes, leaving that range in lastDirtyStart/lastDirtyEnd.
+ */
+typedef struct
+{
+    DWORD writes;
+    DWORD elided;
+    DWORD dirtyBytes;
+    DWORD lastDirtyStart;
+    DWORD lastDirtyEnd;
+} RY2_WriteStats;
+
+/*
+ * Per-dongle state shared by every process that has the dongle open, mapped
+ * from the ROCKEY2_SHARED%02d segment. The locks serialize every access that
+ * goes to storage, across threads and processes. Each lock index has its own
+ * generation, bumped by every write under that lock so that other processes
+ * know that part of their cache is stale.
+ *
+ * In shared image mode the segment also holds the live copy of the blocks
+ * and info values (HID, UID, Version, Protection), loaded once by the first
+ * opener. Writers update it under the matching lock inside a sequence lock:
+ * the sequence is odd while a write is in progress, so readers copy without
+ * locking and retry if the sequence was odd or moved during their copy.
+ *
+ * In write-behind mode, which implies shared image mode, writes only update
+ * the shared image and set their bit in the dirty mask (RY2_BLOCK_MASK for a
+ * block, RY2_DIRTY_INFO for the info values). The flusher of any process
+ * with the dongle open writes dirty parts back to storage and clears the bits
+ * under the matching lock.
+ *
+ * storageStamp is the GetStorageStamp of the storage the image and the
+ * dirty bits belong to. Segments outlive their processes on POSIX, so an
+ * opener that finds another stamp discards the image and the dirty bits and
+ * reloads from its own storage.
+ *
+ * blockSignal is raised after every write that changes a block, once its
+ * generation has been bumped, so that RY2_WaitBlockChange in any process
+ * sleeps instead of polling.
+ */
+#define RY2_DIRTY_INFO 0x100
+
+typedef struct
+{
+    RY2_Lock locks[RY2_LOCK_COUNT];
+    volatile LONG generations[RY2_LOCK_COUNT];
+    volatile LONG sequences[RY2_LOCK_COUNT];
+    volatile LONG loaded;
+    volatile LONG dirty;
+    volatile LONG storageStamp;
+    RY2_Signal blockSignal;
+    RY2_WriteStats writeStats[RY2_BLOCK_COUNT];
+    DWORD info[RY2_INFO_COUNT];
+    char blocks[RY2_BLOCK_COUNT][RY2_BLOCK_SIZE];
+} RY2_DongleShared;
+
+/*
+ * A read-only view of the shared image of a dongle, filled in by
+ * RY2_MapBlocks. blocks[i] is Block i and versions[i] its sequence word,
+ * which is odd while a write is in progress. A consistent snapshot of the
+ * bytes read from a block is one where versions[i] was even before the reads
+ * and unchanged after them; otherwise the reads must be retried.
+ */
+typedef struct
+{
+    const char (*blocks)[RY2_BLOCK_SIZE];
+    const volatile LONG* versions;
+} RY2_BlockMap;
+
+/*
+ * Process-wide state shared by every process using the library, mapped from
+ * the ROCKEY2_CONFIG segment. The generation is bumped whenever a process
+ * stores new identifiers, so that RY2_Find elsewhere knows to rescan.
+ */
+typedef struct
+{
+    volatile LONG generation;
+} RY2_ConfigShared;
 
+/*
+ * Process-local state of an open dongle. It is allocated by the first
+ * RY2_Open of its handle, so a table of thousands of dongles only pays for
+ * the ones actually in use, and carried over by every table RY2_Find
+ * publishes until its handle disappears. The read-only view handed out by
+ * RY2_MapBlocks is counted apart from the open state: it survives RY2_Close
+ * until the last RY2_UnmapBlocks, or until the handle disappears.
+ */
 typedef struct
 {
+    int handle;
     DWORD hid;
     DWORD uid;
     DWORD version;
     DWORD isProtected;
-    HKEY regKey;
-    HANDLE mutex;
+    RY2_Store store;
+    HANDLE lockEvents[RY2_LOCK_COUNT];
+    HANDLE signalEvent;
+    HANDLE sharedMapping;
+    RY2_DongleShared* shared;
+    HANDLE blockViewMapping;
+    const RY2_DongleShared* blockView;
+    int blockViewCount;
+    BOOL cacheValid[RY2_LOCK_COUNT];
+    LONG cacheGenerations[RY2_LOCK_COUNT];
+    char cacheBlocks[RY2_BLOCK_COUNT][RY2_BLOCK_SIZE];
 } RY2_Dongle;
 
+/*
+ * The dongles found by RY2_Find, as parallel arrays indexed by handle. Each
+ * RY2_Find publishes a new table through an atomic pointer and frees the old
+ * one once no reader can use it (see EnterTable), so resolving a handle
+ * never takes a lock. Its shape is fixed at publication; only the slots are
+ * filled in later: dongles by RY2_Open, under the flush section, and the
+ * lookup copies of the identifiers (HID, UID, Version, Protection), read
+ * from storage on first use (loaded) and kept current for open dongles.
+ *
+ * RY2_Open looks the identifiers up through two hash indexes: a bucket holds
+ * the lowest handle whose HID (or UID) hashes to it, and the next arrays
+ * chain the handles of a bucket in ascending order, so the n-th dongle with
+ * a UID is the n-th match along its chain. The indexes are rebuilt on demand
+ * after any identifier changes, by one thread at a time inside a sequence
+ * lock; a lookup that overlaps a rebuild scans the arrays instead.
+ */
+typedef struct
+{
+    int count;
+    DWORD* hids;
+    DWORD* uids;
+    DWORD* versions;
+    DWORD* protections;
+    BYTE* loaded;
+    int* hidNext;
+    int* uidNext;
+    int* hidBuckets;
+    int* uidBuckets;
+    DWORD bucketMask;
+    volatile LONG indexed;
+    volatile LONG indexSequence;
+    RY2_Dongle** dongles;
+} RY2_DongleTable;
+
+/*
+ * Readers of the current table, counted per epoch parity in cache-line sized
+ * stripes. A writer publishes a new table, flips the epoch and waits for the
+ * old parity's counters to drain; after that nobody can hold the old table.
+ */
+#define RY2_TABLE_READER_STRIPES 16
+
+typedef struct
+{
+    volatile LONG count;
+    BYTE padding[64 - sizeof(LONG)];
+} RY2_TableReaders;
+
 int WINAPI RY2_Find();
 int WINAPI RY2_Open(int mode, DWORD uid, DWORD* hid);
 void WINAPI RY2_Close(int handle);
@@ -47,3 +209,12 @@ int WINAPI RY2_Read(int handle, int block_index, char* buffer512);
 int WINAPI RY2_Write(int handle, int block_index, char* buffer512);
 int WINAPI RY2_GetVersion(int handle);
 int WINAPI RY2_Transform(int handle, int len, BYTE* data);
+int WINAPI RY2_TransformBatch(int handle, int count, int* lens, BYTE** datas);
+int WINAPI RY2_ReadBlocks(int handle, DWORD block_mask, char* buffer2560);
+int WINAPI RY2_WriteBlocks(int handle, DWORD block_mask, char* buffer2560);
+int WINAPI RY2_GetWriteStats(int handle, int block_index, RY2_WriteStats* stats);
+int WINAPI RY2_Flush(int handle);
+int WINAPI RY2_ReadIfChanged(int handle, int block_index, DWORD* generation, char* buffer512);
+int WINAPI RY2_WaitBlockChange(int handle, int block_index, DWORD generation, DWORD timeout_ms);
+int WINAPI RY2_MapBlocks(int handle, RY2_BlockMap* map);
+int WINAPI RY2_UnmapBlocks(int handle);
@@ -21,6 +21,19 @@
 #pragma once
 #include <stdint.h>
 
+// Largest number of items the batch functions compress together per pass:
+// the lane count of the widest kernel, which keeps the pass buffers small.
+#define MD5_BATCH_SIZE 16
+
+void MD5_Transform(uint32_t* state, const void* buffer);
+void MD5_TransformOuter(uint32_t* state, const uint32_t* inner);
+void MD5_TransformMany(uint32_t (*state)[4], const uint32_t* const* block, int count);
+void MD5_TransformOuterMany(uint32_t (*state)[4], const uint32_t (*inner)[4], int count);
+int MD5_LaneCount(void);
+
 uint32_t GenUID(const char* seed);
+void GenUIDBatch(int count, const char* const* seeds, uint32_t* uids);
 int Transform(uint32_t uid, uint8_t* data, int len);
+int TransformBatch(uint32_t uid, int count, const int* lens, uint8_t* const* datas, int* results);
 void Transform_Factory(const uint8_t* challenge, uint8_t* response);
+
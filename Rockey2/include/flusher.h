@@ -0,0 +1,36 @@
+/*
+ * This file is part of the Rockey2 EMU project authored by Brian218.
+ *
+ * Copyright (C) 2026 Brian218 (https://github.com/brian218)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#pragma once
+
+/*
+ * Background flusher for write-behind mode. Writers mark data dirty and call
+ * WakeFlusher(); the flusher thread, started on the first wake, then waits
+ * out the commit window so that later writes are merged into the same batch,
+ * and calls the flush callback. The callback runs inside the flush section,
+ * which the core also enters whenever it changes the dongle table or the set
+ * of open dongles. The section is needed with or without write-behind, so
+ * InitFlusher is always called; a NULL callback leaves the thread unused.
+ */
+void InitFlusher(DWORD delay_ms, void (*flush)(void));
+void WakeFlusher(void);
+BOOL StopFlusher(BOOL wait);
+void EnterFlushSection(void);
+void LeaveFlushSection(void);
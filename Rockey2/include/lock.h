@@ -0,0 +1,59 @@
+/*
+ * This file is part of the Rockey2 EMU project authored by Brian218.
+ *
+ * Copyright (C) 2026 Brian218 (https://github.com/brian218)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#pragma once
+
+/*
+ * An inter-process lock living in shared memory. Taking a free lock is a
+ * single compare-and-swap of the owner word with the caller's process ID, so
+ * the uncontended path never enters the kernel. Contended callers sleep on a
+ * futex (Linux) or a named auto-reset event (Windows, ROCKEY2_EVENT%02d_%d) and
+ * wake up periodically to check whether the owning process has died, in
+ * which case the lock is taken over instead of staying wedged. AcquireLock
+ * then returns TRUE, so the caller can repair what the dead owner left
+ * half-written.
+ */
+typedef struct
+{
+    volatile LONG owner;
+    volatile LONG waiters;
+} RY2_Lock;
+
+HANDLE OpenLockEvent(int handle, int lock_index);
+void CloseLockEvent(HANDLE event);
+BOOL AcquireLock(RY2_Lock* lock, HANDLE event);
+void ReleaseLock(RY2_Lock* lock, HANDLE event);
+
+/*
+ * A change notification in shared memory. Raising it bumps the sequence and
+ * wakes every process sleeping in WaitForSignal on the value it had seen: a
+ * futex on Linux, a named manual-reset event on Windows (ROCKEY2_SIGNAL%02d).
+ * Raising costs one atomic increment while nobody waits.
+ */
+typedef struct
+{
+    volatile LONG sequence;
+    volatile LONG waiters;
+} RY2_Signal;
+
+HANDLE OpenSignalEvent(int handle);
+void CloseSignalEvent(HANDLE event);
+void RaiseSignal(RY2_Signal* signal, HANDLE event);
+void WaitForSignal(RY2_Signal* signal, LONG sequence, HANDLE event, DWORD timeout_ms);
@@ -0,0 +1,123 @@
+/*
+ * This file is part of the Rockey2 EMU project authored by Brian218.
+ *
+ * Copyright (C) 2026 Brian218 (https://github.com/brian218)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/*
+ * Multi-buffer MD5 compression kernel, included once per instruction set by
+ * crypto_simd.c. Each vector lane runs the same round sequence as the scalar
+ * MD5_Transform in crypto.c on its own state and block. The includer defines:
+ *
+ *   MD5_LANES_NAME        name of the generic kernel
+ *   MD5_LANES_OUTER_NAME  name of the outer HMAC kernel (see MD5_TransformOuter)
+ *   MD5_LANES_TARGET      function attribute enabling the instruction set
+ *   MD5_LANES_COUNT       number of 32-bit lanes per vector
+ *   MD5_LANES_VEC         vector type
+ *   MD5_LANES_LOAD/STORE/SET1/ADD/AND/OR/XOR/ANDNOT/ROTL  lane-wise ops,
+ *   where ANDNOT(x, y) is ~x & y
+ *
+ * Unoptimized, the unrolled rounds take tens of kilobytes of stack, past the
+ * 4 KB at which MSVC emits a __chkstk call, so Rockey2.vcxproj builds
+ * crypto_simd.c optimized in the Debug configuration too.
+ */
+
+#define MD5_LANES_ROTL_STEP(w,x,g,s,t) w=MD5_LANES_ADD(x,MD5_LANES_ROTL(MD5_LANES_ADD(MD5_LANES_ADD(w,f),MD5_LANES_KM(t,g)),s));
+#define MD5_LANES_R0(w,x,y,z,g,s,t) f=MD5_LANES_OR(MD5_LANES_AND(x,y),MD5_LANES_ANDNOT(x,z));MD5_LANES_ROTL_STEP(w,x,g,s,t)
+#define MD5_LANES_R1(w,x,y,z,g,s,t) f=MD5_LANES_OR(MD5_LANES_AND(z,x),MD5_LANES_ANDNOT(z,y));MD5_LANES_ROTL_STEP(w,x,g,s,t)
+#define MD5_LANES_R2(w,x,y,z,g,s,t) f=MD5_LANES_XOR(MD5_LANES_XOR(x,y),z);MD5_LANES_ROTL_STEP(w,x,g,s,t)
+#define MD5_LANES_R3(w,x,y,z,g,s,t) f=MD5_LANES_XOR(y,MD5_LANES_OR(x,MD5_LANES_XOR(z,ones)));MD5_LANES_ROTL_STEP(w,x,g,s,t)
+
+#define MD5_LANES_KM(t,g) MD5_LANES_ADD(MD5_LANES_SET1(t),m[g])
+
+MD5_LANES_TARGET static void MD5_LANES_NAME(uint32_t (*state)[4], const uint32_t* const* block)
+{
+    uint32_t lanes[MD5_LANES_COUNT];
+    MD5_LANES_VEC m[16];
+    for (int g = 0; g < 16; g++)
+    {
+        for (int l = 0; l < MD5_LANES_COUNT; l++)
+            lanes[l] = block[l][g];
+        m[g] = MD5_LANES_LOAD(lanes);
+    }
+    MD5_LANES_VEC initial[4];
+    for (int j = 0; j < 4; j++)
+    {
+        for (int l = 0; l < MD5_LANES_COUNT; l++)
+            lanes[l] = state[l][j];
+        initial[j] = MD5_LANES_LOAD(lanes);
+    }
+    const MD5_LANES_VEC ones = MD5_LANES_SET1(0xFFFFFFFF);
+    MD5_LANES_VEC a = initial[0];
+    MD5_LANES_VEC b = initial[1];
+    MD5_LANES_VEC c = initial[2];
+    MD5_LANES_VEC d = initial[3];
+    MD5_LANES_VEC f;
+
+    MD5_ROUNDS(MD5_LANES_R0, MD5_LANES_R1, MD5_LANES_R2, MD5_LANES_R3)
+
+    const MD5_LANES_VEC result[4] = { MD5_LANES_ADD(initial[0], a), MD5_LANES_ADD(initial[1], b), MD5_LANES_ADD(initial[2], c), MD5_LANES_ADD(initial[3], d) };
+    for (int j = 0; j < 4; j++)
+    {
+        MD5_LANES_STORE(lanes, result[j]);
+        for (int l = 0; l < MD5_LANES_COUNT; l++)
+            state[l][j] = lanes[l];
+    }
+}
+
+#undef MD5_LANES_KM
+
+#define MD5_LANES_KM(t,g) ((g) < 4 ? MD5_LANES_ADD(MD5_LANES_SET1(t),m[(g) & 3]) : MD5_LANES_SET1((uint32_t)(t + MD5_OUTER_WORD(g))))
+
+MD5_LANES_TARGET static void MD5_LANES_OUTER_NAME(uint32_t (*state)[4], const uint32_t (*inner)[4])
+{
+    uint32_t lanes[MD5_LANES_COUNT];
+    MD5_LANES_VEC m[4];
+    MD5_LANES_VEC initial[4];
+    for (int j = 0; j < 4; j++)
+    {
+        for (int l = 0; l < MD5_LANES_COUNT; l++)
+            lanes[l] = inner[l][j];
+        m[j] = MD5_LANES_LOAD(lanes);
+        for (int l = 0; l < MD5_LANES_COUNT; l++)
+            lanes[l] = state[l][j];
+        initial[j] = MD5_LANES_LOAD(lanes);
+    }
+    const MD5_LANES_VEC ones = MD5_LANES_SET1(0xFFFFFFFF);
+    MD5_LANES_VEC a = initial[0];
+    MD5_LANES_VEC b = initial[1];
+    MD5_LANES_VEC c = initial[2];
+    MD5_LANES_VEC d = initial[3];
+    MD5_LANES_VEC f;
+
+    MD5_ROUNDS(MD5_LANES_R0, MD5_LANES_R1, MD5_LANES_R2, MD5_LANES_R3)
+
+    const MD5_LANES_VEC result[4] = { MD5_LANES_ADD(initial[0], a), MD5_LANES_ADD(initial[1], b), MD5_LANES_ADD(initial[2], c), MD5_LANES_ADD(initial[3], d) };
+    for (int j = 0; j < 4; j++)
+    {
+        MD5_LANES_STORE(lanes, result[j]);
+        for (int l = 0; l < MD5_LANES_COUNT; l++)
+            state[l][j] = lanes[l];
+    }
+}
+
+#undef MD5_LANES_KM
+#undef MD5_LANES_ROTL_STEP
+#undef MD5_LANES_R0
+#undef MD5_LANES_R1
+#undef MD5_LANES_R2
+#undef MD5_LANES_R3
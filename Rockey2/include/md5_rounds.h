@@ -0,0 +1,102 @@
+/*
+ * This file is part of the Rockey2 EMU project authored by Brian218.
+ *
+ * Copyright (C) 2026 Brian218 (https://github.com/brian218)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#pragma once
+
+/*
+ * The 64 MD5 steps as (w, x, y, z, message word, shift, constant), expanded
+ * through the four round macros passed in. Every compression kernel, scalar
+ * or multi-buffer, generic or specialized, is generated from this one list.
+ */
+#define MD5_ROUNDS(R0,R1,R2,R3) \
+    R0(a, b, c, d, 0, 7, 0xD76AA478) \
+    R0(d, a, b, c, 1, 12, 0xE8C7B756) \
+    R0(c, d, a, b, 2, 17, 0x242070DB) \
+    R0(b, c, d, a, 3, 22, 0xC1BDCEEE) \
+    R0(a, b, c, d, 4, 7, 0xF57C0FAF) \
+    R0(d, a, b, c, 5, 12, 0x4787C62A) \
+    R0(c, d, a, b, 6, 17, 0xA8304613) \
+    R0(b, c, d, a, 7, 22, 0xFD469501) \
+    R0(a, b, c, d, 8, 7, 0x698098D8) \
+    R0(d, a, b, c, 9, 12, 0x8B44F7AF) \
+    R0(c, d, a, b, 10, 17, 0xFFFF5BB1) \
+    R0(b, c, d, a, 11, 22, 0x895CD7BE) \
+    R0(a, b, c, d, 12, 7, 0x6B901122) \
+    R0(d, a, b, c, 13, 12, 0xFD987193) \
+    R0(c, d, a, b, 14, 17, 0xA679438E) \
+    R0(b, c, d, a, 15, 22, 0x49B40821) \
+    R1(a, b, c, d, 1, 5, 0xF61E2562) \
+    R1(d, a, b, c, 6, 9, 0xC040B340) \
+    R1(c, d, a, b, 11, 14, 0x265E5A51) \
+    R1(b, c, d, a, 0, 20, 0xE9B6C7AA) \
+    R1(a, b, c, d, 5, 5, 0xD62F105D) \
+    R1(d, a, b, c, 10, 9, 0x02441453) \
+    R1(c, d, a, b, 15, 14, 0xD8A1E681) \
+    R1(b, c, d, a, 4, 20, 0xE7D3FBC8) \
+    R1(a, b, c, d, 9, 5, 0x21E1CDE6) \
+    R1(d, a, b, c, 14, 9, 0xC33707D6) \
+    R1(c, d, a, b, 3, 14, 0xF4D50D87) \
+    R1(b, c, d, a, 8, 20, 0x455A14ED) \
+    R1(a, b, c, d, 13, 5, 0xA9E3E905) \
+    R1(d, a, b, c, 2, 9, 0xFCEFA3F8) \
+    R1(c, d, a, b, 7, 14, 0x676F02D9) \
+    R1(b, c, d, a, 12, 20, 0x8D2A4C8A) \
+    R2(a, b, c, d, 5, 4, 0xFFFA3942) \
+    R2(d, a, b, c, 8, 11, 0x8771F681) \
+    R2(c, d, a, b, 11, 16, 0x6D9D6122) \
+    R2(b, c, d, a, 14, 23, 0xFDE5380C) \
+    R2(a, b, c, d, 1, 4, 0xA4BEEA44) \
+    R2(d, a, b, c, 4, 11, 0x4BDECFA9) \
+    R2(c, d, a, b, 7, 16, 0xF6BB4B60) \
+    R2(b, c, d, a, 10, 23, 0xBEBFBC70) \
+    R2(a, b, c, d, 13, 4, 0x289B7EC6) \
+    R2(d, a, b, c, 0, 11, 0xEAA127FA) \
+    R2(c, d, a, b, 3, 16, 0xD4EF3085) \
+    R2(b, c, d, a, 6, 23, 0x04881D05) \
+    R2(a, b, c, d, 9, 4, 0xD9D4D039) \
+    R2(d, a, b, c, 12, 11, 0xE6DB99E5) \
+    R2(c, d, a, b, 15, 16, 0x1FA27CF8) \
+    R2(b, c, d, a, 2, 23, 0xC4AC5665) \
+    R3(a, b, c, d, 0, 6, 0xF4292244) \
+    R3(d, a, b, c, 7, 10, 0x432AFF97) \
+    R3(c, d, a, b, 14, 15, 0xAB9423A7) \
+    R3(b, c, d, a, 5, 21, 0xFC93A039) \
+    R3(a, b, c, d, 12, 6, 0x655B59C3) \
+    R3(d, a, b, c, 3, 10, 0x8F0CCC92) \
+    R3(c, d, a, b, 10, 15, 0xFFEFF47D) \
+    R3(b, c, d, a, 1, 21, 0x85845DD1) \
+    R3(a, b, c, d, 8, 6, 0x6FA87E4F) \
+    R3(d, a, b, c, 15, 10, 0xFE2CE6E0) \
+    R3(c, d, a, b, 6, 15, 0xA3014314) \
+    R3(b, c, d, a, 13, 21, 0x4E0811A1) \
+    R3(a, b, c, d, 4, 6, 0xF7537E82) \
+    R3(d, a, b, c, 11, 10, 0xBD3AF235) \
+    R3(c, d, a, b, 2, 15, 0x2AD7D2BB) \
+    R3(b, c, d, a, 9, 21, 0xEB86D391)
+
+/*
+ * Message words that are compile-time constants in the HMAC-style passes.
+ * The outer pass compresses the 16-byte inner digest: words 0-3 are live,
+ * word 4 holds the 0x80 terminator and word 14 the bit count (16 + 64) * 8.
+ * The inner pass of a 55-byte message only has a constant bit count
+ * (55 + 64) * 8 in words 14 and 15.
+ */
+#define MD5_OUTER_WORD(g) ((g) == 4 ? 0x80u : (g) == 14 ? 0x280u : 0u)
+#define MD5_INNER55_WORD(g) ((g) == 14 ? 0x3B8u : 0u)
@@ -0,0 +1,326 @@
+/*
+ * This file is part of the Rockey2 EMU project authored by Brian218.
+ *
+ * Copyright (C) 2026 Brian218 (https://github.com/brian218)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#pragma once
+
+/*
+ * The emulator core is written against the Win32 API. On Windows this header
+ * simply pulls in <windows.h>; elsewhere it provides the small subset of Win32
+ * types and calls the core relies on, mapped onto POSIX equivalents, so that
+ * Rockey2.c and crypto.c build unchanged as a shared library.
+ */
+
+#ifdef _WIN32
+
+#include <stdio.h>
+#include <windows.h>
+
+#else
+
+#include <fcntl.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+typedef uint8_t BYTE;
+typedef int32_t BOOL;
+typedef uint32_t DWORD;
+typedef int32_t LONG;
+typedef int32_t LSTATUS;
+typedef uint64_t UINT64;
+typedef int64_t LONGLONG;
+typedef size_t SIZE_T;
+typedef void* HANDLE;
+typedef void* HMODULE;
+typedef void* LPVOID;
+typedef void* PVOID;
+
+#define TRUE 1
+#define FALSE 0
+#define WINAPI
+#define APIENTRY
+#define HEAP_ZERO_MEMORY 0x00000008
+#define INFINITE 0xFFFFFFFF
+#define DLL_PROCESS_DETACH 0
+#define DLL_PROCESS_ATTACH 1
+#define DLL_THREAD_ATTACH 2
+#define DLL_THREAD_DETACH 3
+
+#define lstrcmpi strcasecmp
+
+/*
+ * Unlike snprintf(), _snprintf() may fill all `count` bytes and only appends
+ * the null terminator when there is room for it, which is why the core always
+ * passes `sizeof buffer - 1` into a zero-initialized buffer.
+ */
+static inline int _snprintf(char* buffer, size_t count, const char* format, ...)
+{
+    char temp[512 + 1] = { 0 };
+    va_list args;
+    va_start(args, format);
+    const int length = vsnprintf(temp, sizeof temp, format, args);
+    va_end(args);
+    if (length < 0)
+        return -1;
+    if ((size_t)length < count)
+    {
+        memcpy(buffer, temp, length + 1);
+        return length;
+    }
+    memcpy(buffer, temp, count < sizeof temp - 1 ? count : sizeof temp - 1);
+    return (size_t)length == count ? length : -1;
+}
+
+static inline uint32_t _rotl(uint32_t value, int shift)
+{
+    return (value << shift) | (value >> (32 - shift));
+}
+
+static inline HANDLE GetProcessHeap(void)
+{
+    return (HANDLE)1;
+}
+
+static inline LPVOID HeapAlloc(HANDLE heap, DWORD flags, SIZE_T size)
+{
+    (void)heap;
+    return (flags & HEAP_ZERO_MEMORY) ? calloc(1, size) : malloc(size);
+}
+
+static inline BOOL HeapFree(HANDLE heap, DWORD flags, LPVOID mem)
+{
+    (void)heap;
+    (void)flags;
+    free(mem);
+    return TRUE;
+}
+
+static inline BOOL DisableThreadLibraryCalls(HMODULE module)
+{
+    (void)module;
+    return TRUE;
+}
+
+static inline LONG InterlockedIncrement(volatile LONG* addend)
+{
+    return __atomic_add_fetch(addend, 1, __ATOMIC_SEQ_CST);
+}
+
+static inline LONG InterlockedDecrement(volatile LONG* addend)
+{
+    return __atomic_sub_fetch(addend, 1, __ATOMIC_SEQ_CST);
+}
+
+static inline LONG InterlockedExchange(volatile LONG* target, LONG value)
+{
+    return __atomic_exchange_n(target, value, __ATOMIC_SEQ_CST);
+}
+
+static inline LONG InterlockedOr(volatile LONG* destination, LONG value)
+{
+    return __atomic_fetch_or(destination, value, __ATOMIC_SEQ_CST);
+}
+
+static inline LONG InterlockedAnd(volatile LONG* destination, LONG value)
+{
+    return __atomic_fetch_and(destination, value, __ATOMIC_SEQ_CST);
+}
+
+static inline LONG InterlockedCompareExchange(volatile LONG* destination, LONG exchange, LONG comperand)
+{
+    __atomic_compare_exchange_n(destination, &comperand, exchange, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+    return comperand;
+}
+
+static inline PVOID InterlockedExchangePointer(PVOID volatile* target, PVOID value)
+{
+    return __atomic_exchange_n(target, value, __ATOMIC_SEQ_CST);
+}
+
+static inline LONGLONG InterlockedExchangeAdd64(volatile LONGLONG* addend, LONGLONG value)
+{
+    return __atomic_fetch_add(addend, value, __ATOMIC_SEQ_CST);
+}
+
+static inline LONGLONG InterlockedCompareExchange64(volatile LONGLONG* destination, LONGLONG exchange, LONGLONG comperand)
+{
+    __atomic_compare_exchange_n(destination, &comperand, exchange, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+    return comperand;
+}
+
+#define MemoryBarrier() __atomic_thread_fence(__ATOMIC_SEQ_CST)
+#if defined(__x86_64__) || defined(__i386__)
+#define YieldProcessor() __builtin_ia32_pause()
+#else
+#define YieldProcessor() __atomic_signal_fence(__ATOMIC_SEQ_CST)
+#endif
+
+static inline void Sleep(DWORD milliseconds)
+{
+    usleep(milliseconds * 1000);
+}
+
+static inline DWORD GetTickCount(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (DWORD)(now.tv_sec * 1000 + now.tv_nsec / 1000000);
+}
+
+static inline DWORD GetCurrentProcessId(void)
+{
+    return (DWORD)getpid();
+}
+
+static inline DWORD GetEnvironmentVariable(const char* name, char* buffer, DWORD size)
+{
+    const char* value = getenv(name);
+    if (!value)
+        return 0;
+    const size_t length = strlen(value);
+    if (length >= size)
+        return (DWORD)(length + 1);
+    memcpy(buffer, value, length + 1);
+    return (DWORD)length;
+}
+
+#endif
+
+/*
+ * Named shared memory visible to every process using the emulator, created
+ * zero-filled on first use. Windows backs it with the paging file and keeps it
+ * alive while any view is open; POSIX uses shm_open() under a leading slash.
+ * The returned mapping handle is only meaningful on Windows.
+ */
+static inline void* OpenSharedMemory(const char* name, DWORD size, HANDLE* mapping)
+{
+#ifdef _WIN32
+    *mapping = CreateFileMapping(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0, size, name);
+    if (!*mapping)
+        return NULL;
+    void* view = MapViewOfFile(*mapping, FILE_MAP_ALL_ACCESS, 0, 0, size);
+    if (!view)
+    {
+        CloseHandle(*mapping);
+        *mapping = NULL;
+    }
+    return view;
+#else
+    char shmName[64 + 1] = { 0 };
+    _snprintf(shmName, sizeof shmName - 1, "/%s", name);
+    *mapping = NULL;
+    const int fd = shm_open(shmName, O_RDWR | O_CREAT, 0666);
+    if (fd < 0)
+        return NULL;
+    struct stat shmStat;
+    if (fstat(fd, &shmStat) != 0 || (shmStat.st_size < (off_t)size && ftruncate(fd, size) != 0))
+    {
+        close(fd);
+        return NULL;
+    }
+    void* view = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    return view == MAP_FAILED ? NULL : view;
+#endif
+}
+
+/*
+ * Maps a read-only view of a named shared memory segment that already exists,
+ * so that the memory can be handed out without letting callers write to it.
+ */
+static inline const void* OpenSharedMemoryView(const char* name, DWORD size, HANDLE* mapping)
+{
+#ifdef _WIN32
+    *mapping = OpenFileMapping(FILE_MAP_READ, FALSE, name);
+    if (!*mapping)
+        return NULL;
+    const void* view = MapViewOfFile(*mapping, FILE_MAP_READ, 0, 0, size);
+    if (!view)
+    {
+        CloseHandle(*mapping);
+        *mapping = NULL;
+    }
+    return view;
+#else
+    char shmName[64 + 1] = { 0 };
+    _snprintf(shmName, sizeof shmName - 1, "/%s", name);
+    *mapping = NULL;
+    const int fd = shm_open(shmName, O_RDONLY, 0);
+    if (fd < 0)
+        return NULL;
+    void* view = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    return view == MAP_FAILED ? NULL : view;
+#endif
+}
+
+static inline void CloseSharedMemory(void* view, DWORD size, HANDLE mapping)
+{
+#ifdef _WIN32
+    (void)size;
+    UnmapViewOfFile(view);
+    CloseHandle(mapping);
+#else
+    (void)mapping;
+    munmap(view, size);
+#endif
+}
+
+/*
+ * 32.32 fixed-point ratios, so that clocks are converted without 64-bit
+ * division or full 64-bit products, which x86 takes from C runtime helpers
+ * (_aulldiv, _allmul) that the Windows build does not link.
+ */
+
+// (numerator << 32) / divisor by long division, one bit at a time; meant for setup.
+static inline UINT64 GetFixedRatio(UINT64 numerator, UINT64 divisor)
+{
+    UINT64 quotient = 0;
+    UINT64 remainder = 0;
+    for (int i = 0; i < 96; i++)
+    {
+        remainder = remainder << 1 | numerator >> 63;
+        numerator <<= 1;
+        quotient <<= 1;
+        if (remainder >= divisor)
+        {
+            remainder -= divisor;
+            quotient |= 1;
+        }
+    }
+    return quotient;
+}
+
+// value * ratio >> 32 from 32x32-bit products.
+static inline UINT64 ScaleByFixedRatio(UINT64 value, UINT64 ratio)
+{
+    const DWORD valueLow = (DWORD)value;
+    const DWORD valueHigh = (DWORD)(value >> 32);
+    const DWORD ratioLow = (DWORD)ratio;
+    const DWORD ratioHigh = (DWORD)(ratio >> 32);
+    return ((UINT64)valueHigh * ratioHigh << 32) + (UINT64)valueHigh * ratioLow + (UINT64)valueLow * ratioHigh + ((UINT64)valueLow * ratioLow >> 32);
+}
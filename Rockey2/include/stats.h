@@ -0,0 +1,150 @@
+/*
+ * This file is part of the Rockey2 EMU project authored by Brian218.
+ *
+ * Copyright (C) 2026 Brian218 (https://github.com/brian218)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#pragma once
+
+/*
+ * Optional instrumentation, enabled by ROCKEY2_STATS=1 and read by
+ * tools/ry2stats. Every process using it adds to the same ROCKEY2_STATS
+ * shared-memory segment: per-export call counts and latency histograms, the
+ * time spent waiting for contended dongle locks, storage operations and
+ * bytes, and cache hits. The counters are striped like the table readers: a
+ * thread adds to the stripe its stack address selects, so threads seldom
+ * share a cache line, and a reader sums the stripes. While disabled every
+ * hook costs one test of Stats; building with RY2_NO_STATS removes them,
+ * and call tracing with them.
+ */
+#define RY2_STATS_MAGIC 0x53325952 // "RY2S"
+#define RY2_STATS_VERSION 2
+#define RY2_STATS_STRIPES 16
+#define RY2_STATS_BUCKETS 32 // Bucket b counts calls of 2^b to 2^(b+1) - 1 ns; the last one everything longer
+
+typedef enum
+{
+    RY2_STAT_FIND,
+    RY2_STAT_OPEN,
+    RY2_STAT_CLOSE,
+    RY2_STAT_GENUID,
+    RY2_STAT_READ,
+    RY2_STAT_WRITE,
+    RY2_STAT_READ_BLOCKS,
+    RY2_STAT_WRITE_BLOCKS,
+    RY2_STAT_GET_VERSION,
+    RY2_STAT_TRANSFORM,
+    RY2_STAT_TRANSFORM_BATCH,
+    RY2_STAT_FLUSH,
+    RY2_STAT_READ_IF_CHANGED,
+    RY2_STAT_WAIT_BLOCK_CHANGE,
+    RY2_STAT_GET_WRITE_STATS,
+    RY2_STAT_MAP_BLOCKS,
+    RY2_STAT_UNMAP_BLOCKS,
+    RY2_STAT_EXPORT_COUNT
+} RY2_StatExport;
+
+typedef enum
+{
+    RY2_STAT_LOCK_WAITS, // Acquisitions that found the lock taken
+    RY2_STAT_LOCK_WAIT_NS,
+    RY2_STAT_STORAGE_READS,
+    RY2_STAT_STORAGE_READ_BYTES,
+    RY2_STAT_STORAGE_WRITES,
+    RY2_STAT_STORAGE_WRITE_BYTES,
+    RY2_STAT_STORAGE_NS,
+    RY2_STAT_BLOCK_CACHE_HITS, // Blocks read from the cache or the shared image
+    RY2_STAT_BLOCK_CACHE_MISSES,
+    RY2_STAT_TRANSFORM_CACHE_HITS,
+    RY2_STAT_TRANSFORM_CACHE_MISSES,
+    RY2_STAT_COUNTER_COUNT
+} RY2_StatCounter;
+
+typedef struct
+{
+    volatile LONGLONG calls;
+    volatile LONGLONG totalNs;
+    volatile LONGLONG buckets[RY2_STATS_BUCKETS];
+} RY2_ExportStats;
+
+typedef struct
+{
+    RY2_ExportStats exports[RY2_STAT_EXPORT_COUNT];
+    volatile LONGLONG counters[RY2_STAT_COUNTER_COUNT];
+} RY2_StatsStripe;
+
+typedef struct
+{
+    volatile LONG magic;
+    DWORD version;
+    DWORD reserved[2];
+    RY2_StatsStripe stripes[RY2_STATS_STRIPES];
+} RY2_StatsShared;
+
+#ifdef RY2_NO_STATS
+static inline void InitStats(void)
+{
+}
+
+static inline void ShutdownStats(void)
+{
+}
+
+static inline UINT64 BeginStat(void)
+{
+    return 0;
+}
+
+static inline void EndExportStat(RY2_StatExport export_index, UINT64 started)
+{
+    (void)export_index;
+    (void)started;
+}
+
+static inline void AddStat(RY2_StatCounter counter, LONGLONG value)
+{
+    (void)counter;
+    (void)value;
+}
+#else
+extern RY2_StatsShared* Stats; // NULL while disabled
+extern BOOL Tracing; // See trace.h
+
+void InitStats(void);
+void ShutdownStats(void);
+UINT64 GetStatsTime(void);
+void RecordExportStat(RY2_StatExport export_index, UINT64 started);
+void RecordStat(RY2_StatCounter counter, LONGLONG value);
+
+// The start time of a measured call, or 0 while disabled.
+static inline UINT64 BeginStat(void)
+{
+    return Stats || Tracing ? GetStatsTime() : 0;
+}
+
+static inline void EndExportStat(RY2_StatExport export_index, UINT64 started)
+{
+    if (Stats)
+        RecordExportStat(export_index, started);
+}
+
+static inline void AddStat(RY2_StatCounter counter, LONGLONG value)
+{
+    if (Stats)
+        RecordStat(counter, value);
+}
+#endif
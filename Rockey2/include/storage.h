@@ -0,0 +1,224 @@
+/*
+ * This file is part of the Rockey2 EMU project authored by Brian218.
+ *
+ * Copyright (C) 2026 Brian218 (https://github.com/brian218)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#pragma once
+
+#define RY2_DEFAULT_DONGLES 32 // Dongle limit unless ROCKEY2_MAX_DONGLES says otherwise
+#define RY2_MAX_DONGLES 65536
+#define RY2_BLOCK_COUNT 5
+#define RY2_BLOCK_SIZE 512
+#define RY2_INFO_COUNT 4 // HID, UID, Version, Protection
+#define RY2_BLOCK_MASK(block_index) (1u << (block_index))
+#define RY2_ALL_BLOCKS (RY2_BLOCK_MASK(RY2_BLOCK_COUNT) - 1)
+
+typedef void* RY2_Store;
+
+/*
+ * On-disk layout of the file backend. The whole image is mapped into every
+ * process that uses it, so a block read is a plain copy out of the mapping.
+ * The header and each dongle's index sector (present mask and info values)
+ * are padded to RY2_FILE_ALIGNMENT, so every block sits on a 512-byte
+ * boundary of the file. The present mask records which values have been
+ * written, mirroring a missing registry value: bits 0-4 are Block0-Block4,
+ * bits 8-11 are the info values in the order below.
+ *
+ * The image holds capacity dongles and grows, zero-filled, when a process
+ * with a higher dongle limit maps it. Images of another version are left
+ * alone; tools/ry2image converts them.
+ *
+ * Non-zero checksums seal an image as written by a tool. The index checksum
+ * covers the header and the index sectors, which is all a load reads, and the
+ * library refuses a sealed image that does not match it; the much larger
+ * blocks are only checked by the tool. The library clears both checksums
+ * before its first change to the image.
+ */
+#define RY2_FILE_MAGIC 0x44325952 // "RY2D"
+#define RY2_FILE_VERSION 2
+#define RY2_FILE_ALIGNMENT RY2_BLOCK_SIZE
+#define RY2_FILE_BLOCK_PRESENT(block_index) (1u << (block_index))
+#define RY2_FILE_INFO_PRESENT (((1u << RY2_INFO_COUNT) - 1) << 8)
+
+typedef struct
+{
+    DWORD present;
+    DWORD info[RY2_INFO_COUNT];
+    BYTE reserved[RY2_FILE_ALIGNMENT - (1 + RY2_INFO_COUNT) * sizeof(DWORD)];
+    char blocks[RY2_BLOCK_COUNT][RY2_BLOCK_SIZE];
+} RY2_FileDongle;
+
+typedef struct
+{
+    DWORD magic;
+    DWORD version;
+    DWORD count;
+    DWORD capacity;
+    volatile LONG indexChecksum;
+    volatile LONG blocksChecksum;
+    BYTE reserved[RY2_FILE_ALIGNMENT - 6 * sizeof(DWORD)];
+    RY2_FileDongle dongles[];
+} RY2_FileImage;
+
+#define RY2_FILE_IMAGE_SIZE(capacity) (sizeof(RY2_FileImage) + (SIZE_T)(capacity) * sizeof(RY2_FileDongle))
+
+static inline DWORD HashFileWords(DWORD hash, const void* data, SIZE_T size)
+{
+    const DWORD* words = (const DWORD*)data;
+    for (SIZE_T i = 0; i < size / sizeof(DWORD); i++)
+        hash = (hash ^ words[i]) * 0x01000193; // FNV-1a, a word at a time
+    return hash;
+}
+
+/*
+ * The checksums of the first count dongles of an image. Neither is ever 0,
+ * which means unsealed.
+ */
+static inline DWORD ChecksumFileIndex(const RY2_FileImage* image, DWORD count)
+{
+    DWORD hash = HashFileWords(0x811C9DC5, image, 4 * sizeof(DWORD)); // magic to capacity
+    for (DWORD i = 0; i < count; i++)
+        hash = HashFileWords(hash, &image->dongles[i], (1 + RY2_INFO_COUNT) * sizeof(DWORD));
+    return hash ? hash : 1;
+}
+
+static inline DWORD ChecksumFileBlocks(const RY2_FileImage* image, DWORD count)
+{
+    DWORD hash = 0x811C9DC5;
+    for (DWORD i = 0; i < count; i++)
+        hash = HashFileWords(hash, image->dongles[i].blocks, sizeof image->dongles[i].blocks);
+    return hash ? hash : 1;
+}
+
+/*
+ * On-disk layout of the log backend: one append-only file per dongle, a
+ * header followed by records. A record carries the blocks in its mask and,
+ * with RY2_LOG_INFO, all four info values, info first and then the blocks in
+ * ascending order. A later record overrides the values it carries, so the
+ * current state of a dongle is the log replayed from the start; compaction
+ * replaces the file with one record holding that state.
+ *
+ * Each record is appended with a single write, and its checksum (FNV-1a over
+ * the mask and the payload) lets replay drop a record torn by a crash, so a
+ * multi-value update such as RY2_GenUID is applied entirely or not at all.
+ */
+#define RY2_LOG_MAGIC 0x4C325952 // "RY2L"
+#define RY2_LOG_VERSION 1
+#define RY2_LOG_INFO 0x100
+#define RY2_LOG_RECORD_MAX (sizeof(RY2_LogRecord) + RY2_INFO_COUNT * sizeof(DWORD) + RY2_BLOCK_COUNT * RY2_BLOCK_SIZE)
+
+typedef struct
+{
+    DWORD magic;
+    DWORD version;
+} RY2_LogHeader;
+
+typedef struct
+{
+    DWORD mask;
+    DWORD checksum;
+} RY2_LogRecord;
+
+// Bytes of payload following a record with the given mask.
+static inline DWORD GetLogPayloadSize(DWORD mask)
+{
+    DWORD size = (mask & RY2_LOG_INFO) ? RY2_INFO_COUNT * sizeof(DWORD) : 0;
+    for (int i = 0; i < RY2_BLOCK_COUNT; i++)
+    {
+        if (mask & RY2_BLOCK_MASK(i))
+            size += RY2_BLOCK_SIZE;
+    }
+    return size;
+}
+
+static inline DWORD ChecksumLogRecord(DWORD mask, const void* payload, DWORD size)
+{
+    return HashFileWords(HashFileWords(0x811C9DC5, &mask, sizeof mask), payload, size);
+}
+
+/*
+ * A storage backend persists the emulated dongles. Each dongle is addressed by
+ * an opaque RY2_Store returned from OpenDongle(); a NULL store means the
+ * dongle could not be opened. Info values are always passed in the order
+ * HID, UID, Version, Protection.
+ *
+ * Read functions return FALSE when the value is missing or malformed, which
+ * lets the core apply its self-healing defaults exactly as before.
+ *
+ * HasChanged reports whether the dongle set (the count, or dongles being
+ * added or removed) may have changed since its previous call, which lets
+ * RY2_Find skip rescanning. Its first call returns TRUE and arms the
+ * notification. A NULL HasChanged means the backend cannot tell.
+ *
+ * ReadBlocks and WriteBlocks transfer every block selected by a mask in one
+ * storage operation, with buffers[i] pointing at the data of Block i. ReadBlocks
+ * returns the mask of the blocks actually found. Either may be NULL, in which
+ * case ReadStorageBlocks and WriteStorageBlocks fall back to one ReadBlock or
+ * WriteBlock call per block.
+ *
+ * BeginBatch and EndBatch bracket writes that must reach storage together or
+ * not at all, such as the erase and the new identifiers of RY2_GenUID. The
+ * caller holds every dongle lock the writes need, so no other thread writes
+ * to the store meanwhile. EndBatch returns FALSE if the batch was lost.
+ *
+ * Maintain is called by the flusher thread for every open dongle, inside the
+ * flush section, after the backend has asked for it with WakeFlusher().
+ *
+ * GetIdentity returns a hash of where the backend keeps its dongles, such as
+ * the volume and index of its file, so that per-dongle shared memory left
+ * behind by a process that used other storage is recognized and reloaded.
+ *
+ * BeginBatch, EndBatch, Maintain and GetIdentity may be NULL; without
+ * GetIdentity the backend name alone identifies the storage.
+ */
+typedef struct
+{
+    const char* name;
+    int (*ReadDongleCount)(void);
+    BOOL (*HasChanged)(void);
+    RY2_Store (*OpenDongle)(int handle);
+    void (*CloseDongle)(RY2_Store store);
+    BOOL (*ReadBlock)(RY2_Store store, int block_index, char* buffer512);
+    BOOL (*WriteBlock)(RY2_Store store, int block_index, const char* buffer512);
+    DWORD (*ReadBlocks)(RY2_Store store, DWORD block_mask, char* const buffers[RY2_BLOCK_COUNT]);
+    BOOL (*WriteBlocks)(RY2_Store store, DWORD block_mask, const char* const buffers[RY2_BLOCK_COUNT]);
+    BOOL (*ReadInfo)(RY2_Store store, DWORD* const info[RY2_INFO_COUNT]);
+    BOOL (*WriteInfo)(RY2_Store store, const DWORD* const info[RY2_INFO_COUNT]);
+    void (*BeginBatch)(RY2_Store store);
+    BOOL (*EndBatch)(RY2_Store store);
+    void (*Maintain)(RY2_Store store);
+    void (*Shutdown)(void);
+    DWORD (*GetIdentity)(void);
+} RY2_StorageBackend;
+
+#ifdef _WIN32
+extern const RY2_StorageBackend RegistryStorage;
+#endif
+extern const RY2_StorageBackend FileStorage;
+extern const RY2_StorageBackend LogStorage;
+extern const RY2_StorageBackend SimStorage;
+
+const RY2_StorageBackend* SelectStorageBackend(void);
+BOOL GetStorageSetting(const char* name, char* buffer, DWORD size);
+DWORD GetNumericSetting(const char* name, DWORD defaultValue);
+int GetDongleLimit(void);
+DWORD GetStorageStamp(const RY2_StorageBackend* storage);
+DWORD ReadStorageBlocks(const RY2_StorageBackend* storage, RY2_Store store, DWORD block_mask, char* const buffers[RY2_BLOCK_COUNT]);
+BOOL WriteStorageBlocks(const RY2_StorageBackend* storage, RY2_Store store, DWORD block_mask, const char* const buffers[RY2_BLOCK_COUNT]);
+void BeginStorageBatch(const RY2_StorageBackend* storage, RY2_Store store);
+BOOL EndStorageBatch(const RY2_StorageBackend* storage, RY2_Store store);
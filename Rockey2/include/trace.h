@@ -0,0 +1,107 @@
+/*
+ * This file is part of the Rockey2 EMU project authored by Brian218.
+ *
+ * Copyright (C) 2026 Brian218 (https://github.com/brian218)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#pragma once
+
+/*
+ * Optional call tracing, enabled by ROCKEY2_TRACE=<prefix> and replayed by
+ * tools/ry2replay. Every process writes <prefix>.<process ID>: a header and
+ * one fixed-size record per export call, identified by its RY2_StatExport.
+ * Timestamps come from the statistics clock, which all processes share.
+ *
+ * Calls are queued in bounded lock-free rings, one per stripe as for the
+ * statistics, and the flusher thread appends them to the file; the caller
+ * never waits for I/O. A call that finds its ring full is counted in the
+ * header instead. Block data, transform data and seeds are not recorded:
+ * arguments holds, per export,
+ *
+ *     RY2_Open                 uid, hid (mode -1)     handle is the mode
+ *     RY2_GenUID               isProtect, seed length
+ *     RY2_Read, RY2_Write      block index
+ *     RY2_ReadBlocks/Write...  block mask
+ *     RY2_Transform            len
+ *     RY2_TransformBatch       count
+ *     RY2_ReadIfChanged        block index, generation
+ *     RY2_WaitBlockChange      block index, generation, timeout
+ *     RY2_GetWriteStats        block index
+ */
+#define RY2_TRACE_MAGIC 0x52325952 // "RY2R"
+#define RY2_TRACE_VERSION 1
+
+typedef struct
+{
+    DWORD magic;
+    DWORD version;
+    DWORD processId;
+    DWORD dropped; // Calls lost to a full ring, written when the library unloads
+} RY2_TraceHeader;
+
+typedef struct
+{
+    UINT64 timestamp; // ns
+    DWORD duration; // ns, at most 0xFFFFFFFF
+    DWORD threadId;
+    DWORD exportIndex;
+    int handle;
+    DWORD arguments[3];
+    int result;
+} RY2_TraceRecord;
+
+extern BOOL Tracing; // FALSE while disabled
+
+#ifdef RY2_NO_STATS
+static inline void InitTrace(HANDLE heap)
+{
+    (void)heap;
+}
+
+static inline void ShutdownTrace(HANDLE heap)
+{
+    (void)heap;
+}
+
+static inline void DrainTrace(void)
+{
+}
+
+static inline void EndExportCall(RY2_StatExport export_index, UINT64 started, int handle, DWORD argument0, DWORD argument1, DWORD argument2, int result)
+{
+    (void)export_index;
+    (void)started;
+    (void)handle;
+    (void)argument0;
+    (void)argument1;
+    (void)argument2;
+    (void)result;
+}
+#else
+void InitTrace(HANDLE heap);
+void ShutdownTrace(HANDLE heap);
+void DrainTrace(void);
+void RecordTrace(RY2_StatExport export_index, UINT64 started, int handle, DWORD argument0, DWORD argument1, DWORD argument2, int result);
+
+// Ends the measurement of an export call begun with BeginStat.
+static inline void EndExportCall(RY2_StatExport export_index, UINT64 started, int handle, DWORD argument0, DWORD argument1, DWORD argument2, int result)
+{
+    EndExportStat(export_index, started);
+    if (Tracing)
+        RecordTrace(export_index, started, handle, argument0, argument1, argument2, result);
+}
+#endif
@@ -0,0 +1,58 @@
+/*
+ * This file is part of the Rockey2 EMU project authored by Brian218.
+ *
+ * Copyright (C) 2026 Brian218 (https://github.com/brian218)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#pragma once
+
+/*
+ * Process-wide memoization of Transform(). The result only depends on the
+ * UID, the length and the input bytes, so a direct-mapped table keyed on all
+ * three answers repeated challenges without any MD5 work. Each slot is
+ * guarded by its own sequence number: lookups never take a lock, and an
+ * insert that races with another one on the same slot is simply dropped.
+ *
+ * ROCKEY2_TRANSFORM_CACHE sets the number of slots (rounded down to a power
+ * of two, 0 disables the cache) and ROCKEY2_TRANSFORM_CACHE_FILE names a
+ * file the table is loaded from on attach and saved to on detach.
+ */
+#define RY2_TRANSFORM_CACHE_MAGIC 0x54325952 // "RY2T"
+#define RY2_TRANSFORM_CACHE_VERSION 1
+#define RY2_TRANSFORM_DATA_SIZE 32
+
+typedef struct
+{
+    DWORD uid;
+    DWORD len;
+    BYTE input[RY2_TRANSFORM_DATA_SIZE];
+    BYTE output[RY2_TRANSFORM_DATA_SIZE];
+} RY2_TransformRecord;
+
+typedef struct
+{
+    DWORD magic;
+    DWORD version;
+    DWORD count;
+    DWORD reserved;
+} RY2_TransformFileHeader;
+
+void InitTransformCache(HANDLE heap);
+void ShutdownTransformCache(HANDLE heap);
+int CachedTransform(DWORD uid, BYTE* data, int len);
+int CachedTransformBatch(DWORD uid, int count, const int* lens, BYTE* const* datas, int* results);
+void FlushTransformCache(DWORD uid);
@@ -0,0 +1,260 @@
+/*
+ * This file is part of the Rockey2 EMU project authored by Brian218.
+ *
+ * Copyright (C) 2026 Brian218 (https://github.com/brian218)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#include "platform.h"
+#include "lock.h"
+#include "stats.h"
+
+#ifdef __linux__
+#include <errno.h>
+#include <limits.h>
+#include <signal.h>
+#include <time.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#elif !defined(_WIN32)
+#include <errno.h>
+#include <signal.h>
+#endif
+
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+
+#define RY2_LOCK_SPIN_COUNT 100
+#define RY2_LOCK_OWNER_CHECK_MS 50
+
+static volatile LONG LockOwnerId = 0;
+
+#ifndef _WIN32
+static pthread_once_t LockOwnerOnce = PTHREAD_ONCE_INIT;
+
+static void ResetLockOwnerId(void)
+{
+    LockOwnerId = 0;
+}
+
+static void RegisterLockOwnerReset(void)
+{
+    pthread_atfork(NULL, NULL, ResetLockOwnerId);
+}
+#endif
+
+// getpid() is a system call on POSIX, so the ID is fetched once per process
+// (and again in a forked child).
+static LONG GetLockOwnerId(void)
+{
+    if (!LockOwnerId)
+    {
+#ifndef _WIN32
+        pthread_once(&LockOwnerOnce, RegisterLockOwnerReset);
+#endif
+        LockOwnerId = (LONG)GetCurrentProcessId();
+    }
+    return LockOwnerId;
+}
+
+static BOOL IsOwnerAlive(LONG owner)
+{
+#ifdef _WIN32
+    HANDLE process = OpenProcess(SYNCHRONIZE, FALSE, (DWORD)owner);
+    if (!process)
+        return GetLastError() != ERROR_INVALID_PARAMETER;
+    const BOOL alive = WaitForSingleObject(process, 0) == WAIT_TIMEOUT;
+    CloseHandle(process);
+    return alive;
+#else
+    return kill((pid_t)owner, 0) == 0 || errno != ESRCH;
+#endif
+}
+
+// Returns TRUE when the full owner check period passed without a wakeup.
+static BOOL WaitForRelease(RY2_Lock* lock, LONG owner, HANDLE event)
+{
+#if defined(_WIN32)
+    (void)lock;
+    (void)owner;
+    return WaitForSingleObject(event, RY2_LOCK_OWNER_CHECK_MS) == WAIT_TIMEOUT;
+#elif defined(__linux__)
+    const struct timespec timeout = { 0, RY2_LOCK_OWNER_CHECK_MS * 1000000L };
+    (void)event;
+    return syscall(SYS_futex, &lock->owner, FUTEX_WAIT, owner, &timeout, NULL, 0) != 0 && errno == ETIMEDOUT;
+#else
+    static const int pollCount = RY2_LOCK_OWNER_CHECK_MS;
+    (void)event;
+    for (int i = 0; i < pollCount; i++)
+    {
+        usleep(1000);
+        if (lock->owner != owner)
+            return FALSE;
+    }
+    return TRUE;
+#endif
+}
+
+static void WakeWaiter(RY2_Lock* lock, HANDLE event)
+{
+#if defined(_WIN32)
+    (void)lock;
+    SetEvent(event);
+#elif defined(__linux__)
+    (void)event;
+    syscall(SYS_futex, &lock->owner, FUTEX_WAKE, 1, NULL, NULL, 0);
+#else
+    (void)lock;
+    (void)event;
+#endif
+}
+
+HANDLE OpenLockEvent(int handle, int lock_index)
+{
+#ifdef _WIN32
+    char eventName[20 + 1] = { 0 }; // ROCKEY2_EVENT65535_0 + '\0'
+    _snprintf(eventName, sizeof eventName - 1, "ROCKEY2_EVENT%02d_%d", handle, lock_index);
+    return CreateEvent(NULL, FALSE, FALSE, eventName);
+#else
+    // Futexes are addressed by the lock word itself; any non-NULL value will do.
+    (void)handle;
+    (void)lock_index;
+    return (HANDLE)1;
+#endif
+}
+
+void CloseLockEvent(HANDLE event)
+{
+#ifdef _WIN32
+    CloseHandle(event);
+#else
+    (void)event;
+#endif
+}
+
+static void RecordLockWait(UINT64 started)
+{
+    AddStat(RY2_STAT_LOCK_WAITS, 1);
+    if (started)
+        AddStat(RY2_STAT_LOCK_WAIT_NS, (LONGLONG)(BeginStat() - started)); // BeginStat() is the current time
+}
+
+// Returns TRUE when the lock was taken over from an owner that died holding it.
+BOOL AcquireLock(RY2_Lock* lock, HANDLE event)
+{
+    const LONG self = GetLockOwnerId();
+    UINT64 started = 0;
+    for (int i = 0; i < RY2_LOCK_SPIN_COUNT; i++)
+    {
+        if (InterlockedCompareExchange(&lock->owner, self, 0) == 0)
+        {
+            if (i > 0)
+                RecordLockWait(started);
+            return FALSE;
+        }
+        // Only contended acquisitions are measured, from the first failed attempt.
+        if (i == 0)
+            started = BeginStat();
+        YieldProcessor();
+    }
+    InterlockedIncrement(&lock->waiters);
+    BOOL takenOver = FALSE;
+    for (;;)
+    {
+        const LONG owner = InterlockedCompareExchange(&lock->owner, self, 0);
+        if (owner == 0)
+            break;
+        // The owner word still names the same process after a full wait
+        // period; if that process is gone, take the lock over from it.
+        if (WaitForRelease(lock, owner, event) && lock->owner == owner && !IsOwnerAlive(owner)
+            && InterlockedCompareExchange(&lock->owner, self, owner) == owner)
+        {
+            takenOver = TRUE;
+            break;
+        }
+    }
+    InterlockedDecrement(&lock->waiters);
+    RecordLockWait(started);
+    return takenOver;
+}
+
+void ReleaseLock(RY2_Lock* lock, HANDLE event)
+{
+    InterlockedExchange(&lock->owner, 0);
+    if (lock->waiters > 0)
+        WakeWaiter(lock, event);
+}
+
+HANDLE OpenSignalEvent(int handle)
+{
+#ifdef _WIN32
+    char eventName[19 + 1] = { 0 }; // ROCKEY2_SIGNAL65535 + '\0'
+    _snprintf(eventName, sizeof eventName - 1, "ROCKEY2_SIGNAL%02d", handle);
+    return CreateEvent(NULL, TRUE, FALSE, eventName);
+#else
+    (void)handle;
+    return (HANDLE)1;
+#endif
+}
+
+void CloseSignalEvent(HANDLE event)
+{
+    CloseLockEvent(event);
+}
+
+void RaiseSignal(RY2_Signal* signal, HANDLE event)
+{
+    InterlockedIncrement(&signal->sequence);
+    if (signal->waiters <= 0)
+        return;
+#if defined(_WIN32)
+    SetEvent(event);
+#elif defined(__linux__)
+    (void)event;
+    syscall(SYS_futex, &signal->sequence, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+#else
+    (void)event;
+#endif
+}
+
+/*
+ * Sleeps until the sequence moves away from the given value, or for at most
+ * timeout_ms; it may also return early, so callers recheck their condition.
+ * On Windows the event stays set after a change until a waiter that finds
+ * it set with the sequence unchanged resets it. A change hidden that way
+ * from a waiter that had not started sleeping yet costs it one timeout.
+ */
+void WaitForSignal(RY2_Signal* signal, LONG sequence, HANDLE event, DWORD timeout_ms)
+{
+    InterlockedIncrement(&signal->waiters);
+    if (signal->sequence == sequence)
+    {
+#if defined(_WIN32)
+        if (WaitForSingleObject(event, timeout_ms) == WAIT_OBJECT_0 && signal->sequence == sequence)
+            ResetEvent(event);
+#elif defined(__linux__)
+        const struct timespec timeout = { timeout_ms / 1000, (timeout_ms % 1000) * 1000000L };
+        (void)event;
+        syscall(SYS_futex, &signal->sequence, FUTEX_WAIT, sequence, &timeout, NULL, 0);
+#else
+        (void)event;
+        for (DWORD i = 0; i < timeout_ms && signal->sequence == sequence; i++)
+            usleep(1000);
+#endif
+    }
+    InterlockedDecrement(&signal->waiters);
+}
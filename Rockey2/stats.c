@@ -0,0 +1,112 @@
+/*
+ * This file is part of the Rockey2 EMU project authored by Brian218.
+ *
+ * Copyright (C) 2026 Brian218 (https://github.com/brian218)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#include "platform.h"
+#include "storage.h"
+#include "stats.h"
+
+#ifndef RY2_NO_STATS
+
+RY2_StatsShared* Stats = NULL;
+static HANDLE StatsMapping = NULL;
+#ifdef _WIN32
+static UINT64 TickScale = 0; // Nanoseconds per counter tick, 32.32 fixed point
+#endif
+
+void InitStats(void)
+{
+#ifdef _WIN32
+    LARGE_INTEGER frequency; // Also needed by the call tracing
+    if (!QueryPerformanceFrequency(&frequency) || frequency.QuadPart <= 0)
+        frequency.QuadPart = 1000000000;
+    TickScale = GetFixedRatio(1000000000, (UINT64)frequency.QuadPart);
+#endif
+    char setting[1 + 1] = { 0 };
+    if (!GetStorageSetting("ROCKEY2_STATS", setting, sizeof setting) || setting[0] != '1')
+        return;
+    RY2_StatsShared* stats = (RY2_StatsShared*)OpenSharedMemory("ROCKEY2_STATS", sizeof(RY2_StatsShared), &StatsMapping);
+    if (!stats)
+        return;
+    // The first process stamps the segment; a build with another layout stays out.
+    if (InterlockedCompareExchange(&stats->magic, RY2_STATS_MAGIC, 0) == 0)
+        stats->version = RY2_STATS_VERSION;
+    else
+    {
+        for (int i = 0; i < 1000 && !stats->version; i++)
+            Sleep(0);
+    }
+    if (stats->magic != RY2_STATS_MAGIC || stats->version != RY2_STATS_VERSION)
+    {
+        CloseSharedMemory(stats, sizeof(RY2_StatsShared), StatsMapping);
+        StatsMapping = NULL;
+        return;
+    }
+    Stats = stats;
+}
+
+void ShutdownStats(void)
+{
+    if (!Stats)
+        return;
+    RY2_StatsShared* stats = Stats;
+    Stats = NULL;
+    CloseSharedMemory(stats, sizeof(RY2_StatsShared), StatsMapping);
+    StatsMapping = NULL;
+}
+
+UINT64 GetStatsTime(void)
+{
+#ifdef _WIN32
+    LARGE_INTEGER counter;
+    QueryPerformanceCounter(&counter);
+    return ScaleByFixedRatio((UINT64)counter.QuadPart, TickScale);
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (UINT64)now.tv_sec * 1000000000 + (UINT64)now.tv_nsec;
+#endif
+}
+
+// The stripe of the calling thread, chosen like the table reader stripes.
+static RY2_StatsStripe* GetStatsStripe(void)
+{
+    const BYTE stackMarker = 0;
+    const SIZE_T stripe = (((SIZE_T)&stackMarker >> 16) * 0x9E3779B1) >> 8;
+    return &Stats->stripes[stripe % RY2_STATS_STRIPES];
+}
+
+void RecordExportStat(RY2_StatExport export_index, UINT64 started)
+{
+    const UINT64 elapsed = GetStatsTime() - started;
+    int bucket = 0;
+    while (bucket < RY2_STATS_BUCKETS - 1 && elapsed >> (bucket + 1))
+        bucket++;
+    RY2_ExportStats* stats = &GetStatsStripe()->exports[export_index];
+    InterlockedExchangeAdd64(&stats->calls, 1);
+    InterlockedExchangeAdd64(&stats->totalNs, (LONGLONG)elapsed);
+    InterlockedExchangeAdd64(&stats->buckets[bucket], 1);
+}
+
+void RecordStat(RY2_StatCounter counter, LONGLONG value)
+{
+    InterlockedExchangeAdd64(&GetStatsStripe()->counters[counter], value);
+}
+
+#endif
@@ -0,0 +1,235 @@
+/*
+ * This file is part of the Rockey2 EMU project authored by Brian218.
+ *
+ * Copyright (C) 2026 Brian218 (https://github.com/brian218)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#include "platform.h"
+#include "storage.h"
+#include "stats.h"
+
+static const RY2_StorageBackend* const StorageBackends[] =
+{
+#ifdef _WIN32
+    &RegistryStorage,
+#endif
+    &FileStorage,
+    &LogStorage,
+    &SimStorage
+};
+
+BOOL GetStorageSetting(const char* name, char* buffer, DWORD size)
+{
+    const DWORD length = GetEnvironmentVariable(name, buffer, size);
+    if (length == 0 || length >= size)
+    {
+        buffer[0] = '\0';
+        return FALSE;
+    }
+    return TRUE;
+}
+
+DWORD GetNumericSetting(const char* name, DWORD defaultValue)
+{
+    char buffer[10 + 1] = { 0 }; // 4294967295 + '\0'
+    if (!GetStorageSetting(name, buffer, sizeof buffer))
+        return defaultValue;
+    DWORD value = 0;
+    for (int i = 0; buffer[i]; i++)
+    {
+        if (buffer[i] < '0' || buffer[i] > '9')
+            return defaultValue;
+        value = value * 10 + (buffer[i] - '0');
+    }
+    return value;
+}
+
+// The highest dongle count a backend accepts, from ROCKEY2_MAX_DONGLES.
+int GetDongleLimit(void)
+{
+    const DWORD limit = GetNumericSetting("ROCKEY2_MAX_DONGLES", RY2_DEFAULT_DONGLES);
+    if (limit == 0)
+        return RY2_DEFAULT_DONGLES;
+    return limit > RY2_MAX_DONGLES ? RY2_MAX_DONGLES : (int)limit;
+}
+
+/*
+ * The identity of the selected storage, stamped into the per-dongle shared
+ * memory. Never 0, which a fresh segment holds.
+ */
+DWORD GetStorageStamp(const RY2_StorageBackend* storage)
+{
+    DWORD hash = 0x811C9DC5;
+    for (const char* c = storage->name; *c; c++)
+        hash = (hash ^ (BYTE)*c) * 0x01000193;
+    if (storage->GetIdentity)
+    {
+        const DWORD identity = storage->GetIdentity();
+        hash = HashFileWords(hash, &identity, sizeof identity);
+    }
+    return hash ? hash : 1;
+}
+
+DWORD ReadStorageBlocks(const RY2_StorageBackend* storage, RY2_Store store, DWORD block_mask, char* const buffers[RY2_BLOCK_COUNT])
+{
+    if (storage->ReadBlocks)
+        return storage->ReadBlocks(store, block_mask, buffers);
+    DWORD readMask = 0;
+    for (int i = 0; i < RY2_BLOCK_COUNT; i++)
+    {
+        if ((block_mask & RY2_BLOCK_MASK(i)) && storage->ReadBlock(store, i, buffers[i]))
+            readMask |= RY2_BLOCK_MASK(i);
+    }
+    return readMask;
+}
+
+BOOL WriteStorageBlocks(const RY2_StorageBackend* storage, RY2_Store store, DWORD block_mask, const char* const buffers[RY2_BLOCK_COUNT])
+{
+    if (storage->WriteBlocks)
+        return storage->WriteBlocks(store, block_mask, buffers);
+    BOOL success = TRUE;
+    for (int i = 0; i < RY2_BLOCK_COUNT; i++)
+    {
+        if ((block_mask & RY2_BLOCK_MASK(i)) && !storage->WriteBlock(store, i, buffers[i]))
+            success = FALSE;
+    }
+    return success;
+}
+
+void BeginStorageBatch(const RY2_StorageBackend* storage, RY2_Store store)
+{
+    if (storage->BeginBatch)
+        storage->BeginBatch(store);
+}
+
+BOOL EndStorageBatch(const RY2_StorageBackend* storage, RY2_Store store)
+{
+    return storage->EndBatch ? storage->EndBatch(store) : TRUE;
+}
+
+#ifndef RY2_NO_STATS
+/*
+ * While statistics are enabled the selected backend is wrapped by one that
+ * counts the operations, bytes and time of every block and info transfer.
+ */
+static const RY2_StorageBackend* MeasuredBackend = NULL;
+static RY2_StorageBackend MeasuredStorage;
+
+static void AddStorageStats(RY2_StatCounter operations, RY2_StatCounter bytes, LONGLONG size, UINT64 started)
+{
+    AddStat(operations, 1);
+    AddStat(bytes, size);
+    AddStat(RY2_STAT_STORAGE_NS, (LONGLONG)(GetStatsTime() - started));
+}
+
+static LONGLONG GetBlocksSize(DWORD block_mask)
+{
+    LONGLONG size = 0;
+    for (int i = 0; i < RY2_BLOCK_COUNT; i++)
+    {
+        if (block_mask & RY2_BLOCK_MASK(i))
+            size += RY2_BLOCK_SIZE;
+    }
+    return size;
+}
+
+static BOOL ReadMeasuredBlock(RY2_Store store, int block_index, char* buffer512)
+{
+    const UINT64 started = BeginStat();
+    const BOOL success = MeasuredBackend->ReadBlock(store, block_index, buffer512);
+    AddStorageStats(RY2_STAT_STORAGE_READS, RY2_STAT_STORAGE_READ_BYTES, success ? RY2_BLOCK_SIZE : 0, started);
+    return success;
+}
+
+static BOOL WriteMeasuredBlock(RY2_Store store, int block_index, const char* buffer512)
+{
+    const UINT64 started = BeginStat();
+    const BOOL success = MeasuredBackend->WriteBlock(store, block_index, buffer512);
+    AddStorageStats(RY2_STAT_STORAGE_WRITES, RY2_STAT_STORAGE_WRITE_BYTES, RY2_BLOCK_SIZE, started);
+    return success;
+}
+
+static DWORD ReadMeasuredBlocks(RY2_Store store, DWORD block_mask, char* const buffers[RY2_BLOCK_COUNT])
+{
+    const UINT64 started = BeginStat();
+    const DWORD readMask = MeasuredBackend->ReadBlocks(store, block_mask, buffers);
+    AddStorageStats(RY2_STAT_STORAGE_READS, RY2_STAT_STORAGE_READ_BYTES, GetBlocksSize(readMask), started);
+    return readMask;
+}
+
+static BOOL WriteMeasuredBlocks(RY2_Store store, DWORD block_mask, const char* const buffers[RY2_BLOCK_COUNT])
+{
+    const UINT64 started = BeginStat();
+    const BOOL success = MeasuredBackend->WriteBlocks(store, block_mask, buffers);
+    AddStorageStats(RY2_STAT_STORAGE_WRITES, RY2_STAT_STORAGE_WRITE_BYTES, GetBlocksSize(block_mask), started);
+    return success;
+}
+
+static BOOL ReadMeasuredInfo(RY2_Store store, DWORD* const info[RY2_INFO_COUNT])
+{
+    const UINT64 started = BeginStat();
+    const BOOL success = MeasuredBackend->ReadInfo(store, info);
+    AddStorageStats(RY2_STAT_STORAGE_READS, RY2_STAT_STORAGE_READ_BYTES, success ? RY2_INFO_COUNT * sizeof(DWORD) : 0, started);
+    return success;
+}
+
+static BOOL WriteMeasuredInfo(RY2_Store store, const DWORD* const info[RY2_INFO_COUNT])
+{
+    const UINT64 started = BeginStat();
+    const BOOL success = MeasuredBackend->WriteInfo(store, info);
+    AddStorageStats(RY2_STAT_STORAGE_WRITES, RY2_STAT_STORAGE_WRITE_BYTES, RY2_INFO_COUNT * sizeof(DWORD), started);
+    return success;
+}
+
+static const RY2_StorageBackend* MeasureStorageBackend(const RY2_StorageBackend* backend)
+{
+    if (!Stats)
+        return backend;
+    MeasuredBackend = backend;
+    MeasuredStorage = *backend;
+    MeasuredStorage.ReadBlock = ReadMeasuredBlock;
+    MeasuredStorage.WriteBlock = WriteMeasuredBlock;
+    // A missing multi-block call stays missing, so the fallback runs through the wrappers above.
+    if (backend->ReadBlocks)
+        MeasuredStorage.ReadBlocks = ReadMeasuredBlocks;
+    if (backend->WriteBlocks)
+        MeasuredStorage.WriteBlocks = WriteMeasuredBlocks;
+    MeasuredStorage.ReadInfo = ReadMeasuredInfo;
+    MeasuredStorage.WriteInfo = WriteMeasuredInfo;
+    return &MeasuredStorage;
+}
+#else
+static const RY2_StorageBackend* MeasureStorageBackend(const RY2_StorageBackend* backend)
+{
+    return backend;
+}
+#endif
+
+// Must be called after InitStats.
+const RY2_StorageBackend* SelectStorageBackend(void)
+{
+    char backendName[15 + 1] = { 0 };
+    if (GetStorageSetting("ROCKEY2_STORAGE", backendName, sizeof backendName))
+    {
+        for (SIZE_T i = 0; i < sizeof StorageBackends / sizeof(RY2_StorageBackend*); i++)
+        {
+            if (lstrcmpi(backendName, StorageBackends[i]->name) == 0)
+                return MeasureStorageBackend(StorageBackends[i]);
+        }
+    }
+    return MeasureStorageBackend(StorageBackends[0]);
+}
@@ -0,0 +1,431 @@
+/*
+ * This file is part of the Rockey2 EMU project authored by Brian218.
+ *
+ * Copyright (C) 2026 Brian218 (https://github.com/brian218)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#include "platform.h"
+#include "storage.h"
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+
+static const char* DefaultFilePath = "Rockey2.dat";
+static char FilePath[260 + 1] = { 0 }; // MAX_PATH + '\0'
+#ifdef __linux__
+static int FileWatch = -1;
+#endif
+
+/*
+ * One mapping of the image file. A file renamed over the path gets a view of
+ * its own; the old view stays mapped until the library is unloaded, since a
+ * call in another thread may still be reading through it.
+ */
+typedef struct RY2_FileView
+{
+    RY2_FileImage* image;
+    DWORD capacity;
+    DWORD identity; // See GetFileIdentity
+#ifdef _WIN32
+    HANDLE mapping;
+#else
+    UINT64 device;
+    UINT64 inode;
+#endif
+    struct RY2_FileView* retired;
+} RY2_FileView;
+
+static RY2_FileView* volatile FileView = NULL;
+
+// The number of dongles an image holds, or 0 if it is not a valid image.
+static DWORD GetImageCapacity(const RY2_FileImage* image)
+{
+    if (image->magic != RY2_FILE_MAGIC || image->version != RY2_FILE_VERSION || !image->capacity)
+        return 0;
+    return image->capacity > RY2_MAX_DONGLES ? RY2_MAX_DONGLES : image->capacity;
+}
+
+// An image of another version must be converted, not formatted or grown.
+static BOOL IsOtherImageVersion(const RY2_FileImage* image)
+{
+    return image->magic == RY2_FILE_MAGIC && image->version != RY2_FILE_VERSION;
+}
+
+/*
+ * A sealed image must match its index checksum. A process that starts
+ * changing the image meanwhile clears the checksum first, which also settles
+ * the check.
+ */
+static BOOL IsImageSealIntact(const RY2_FileView* view)
+{
+    const RY2_FileImage* image = view->image;
+    const DWORD checksum = (DWORD)image->indexChecksum;
+    if (!checksum || ChecksumFileIndex(image, image->count < view->capacity ? image->count : view->capacity) == checksum)
+        return TRUE;
+    MemoryBarrier();
+    return !image->indexChecksum;
+}
+
+// Called before every change to the image.
+static void UnsealFileImage(RY2_FileImage* image)
+{
+    if (image->indexChecksum || image->blocksChecksum)
+    {
+        InterlockedExchange(&image->indexChecksum, 0);
+        InterlockedExchange(&image->blocksChecksum, 0);
+    }
+}
+
+/*
+ * Maps enough of the file for the larger of its own capacity and the dongle
+ * limit, growing it if needed. *empty tells whether the file had no data.
+ */
+static BOOL MapFileImage(const char* path, RY2_FileView* view, BOOL* empty)
+{
+    RY2_FileImage header = { 0 };
+#ifdef _WIN32
+    HANDLE file = CreateFile(path, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+        return FALSE;
+    DWORD bytesRead = 0;
+    if (!ReadFile(file, &header, sizeof header, &bytesRead, NULL))
+        bytesRead = 0;
+    *empty = bytesRead == 0;
+    if (IsOtherImageVersion(&header))
+    {
+        CloseHandle(file);
+        return FALSE;
+    }
+    BY_HANDLE_FILE_INFORMATION info;
+    if (GetFileInformationByHandle(file, &info))
+    {
+        const DWORD identity[3] = { info.dwVolumeSerialNumber, info.nFileIndexHigh, info.nFileIndexLow };
+        view->identity = HashFileWords(0x811C9DC5, identity, sizeof identity);
+    }
+    view->capacity = GetImageCapacity(&header);
+    if (view->capacity < (DWORD)GetDongleLimit())
+        view->capacity = (DWORD)GetDongleLimit();
+    // The mapping grows a short file to the full image size, zero-filled.
+    view->mapping = CreateFileMapping(file, NULL, PAGE_READWRITE, 0, (DWORD)RY2_FILE_IMAGE_SIZE(view->capacity), NULL);
+    CloseHandle(file);
+    if (!view->mapping)
+        return FALSE;
+    view->image = (RY2_FileImage*)MapViewOfFile(view->mapping, FILE_MAP_ALL_ACCESS, 0, 0, RY2_FILE_IMAGE_SIZE(view->capacity));
+    if (!view->image)
+    {
+        CloseHandle(view->mapping);
+        view->mapping = NULL;
+    }
+    return view->image != NULL;
+#else
+    const int fd = open(path, O_RDWR | O_CREAT, 0666);
+    if (fd < 0)
+        return FALSE;
+    const ssize_t bytesRead = pread(fd, &header, sizeof header, 0);
+    *empty = bytesRead <= 0;
+    if (IsOtherImageVersion(&header))
+    {
+        close(fd);
+        return FALSE;
+    }
+    view->capacity = GetImageCapacity(&header);
+    if (view->capacity < (DWORD)GetDongleLimit())
+        view->capacity = (DWORD)GetDongleLimit();
+    const SIZE_T imageSize = RY2_FILE_IMAGE_SIZE(view->capacity);
+    struct stat fileStat;
+    if (fstat(fd, &fileStat) != 0 || (fileStat.st_size < (off_t)imageSize && ftruncate(fd, imageSize) != 0))
+    {
+        close(fd);
+        return FALSE;
+    }
+    view->device = (UINT64)fileStat.st_dev;
+    view->inode = (UINT64)fileStat.st_ino;
+    const DWORD identity[4] = { (DWORD)view->device, (DWORD)(view->device >> 32), (DWORD)view->inode, (DWORD)(view->inode >> 32) };
+    view->identity = HashFileWords(0x811C9DC5, identity, sizeof identity);
+    void* image = mmap(NULL, imageSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    view->image = image == MAP_FAILED ? NULL : (RY2_FileImage*)image;
+    return view->image != NULL;
+#endif
+}
+
+static void UnmapFileView(RY2_FileView* view)
+{
+#ifdef _WIN32
+    FlushViewOfFile(view->image, 0);
+    UnmapViewOfFile(view->image);
+    CloseHandle(view->mapping);
+#else
+    msync(view->image, RY2_FILE_IMAGE_SIZE(view->capacity), MS_ASYNC);
+    munmap(view->image, RY2_FILE_IMAGE_SIZE(view->capacity));
+#endif
+    HeapFree(GetProcessHeap(), 0, view);
+}
+
+// Maps the file now at the path and makes it a valid image, or returns NULL.
+static RY2_FileView* OpenFileView(void)
+{
+    RY2_FileView* view = (RY2_FileView*)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(RY2_FileView));
+    if (!view)
+        return NULL;
+    BOOL empty = FALSE;
+    if (!MapFileImage(FilePath, view, &empty))
+    {
+        HeapFree(GetProcessHeap(), 0, view);
+        return NULL;
+    }
+    RY2_FileImage* image = view->image;
+    if (GetImageCapacity(image) && !IsImageSealIntact(view))
+    {
+        UnmapFileView(view);
+        return NULL;
+    }
+    // A fresh or foreign file is formatted as an empty image with no dongles.
+    if (!GetImageCapacity(image))
+    {
+        // A new file is already zero-filled; only foreign data needs clearing.
+        if (!empty)
+            memset(image, 0, RY2_FILE_IMAGE_SIZE(view->capacity));
+        image->magic = RY2_FILE_MAGIC;
+        image->version = RY2_FILE_VERSION;
+    }
+    if (GetImageCapacity(image) < view->capacity || !image->capacity)
+    {
+        UnsealFileImage(image);
+        image->capacity = view->capacity;
+    }
+    return view;
+}
+
+static BOOL LoadFileImage(void)
+{
+    if (FileView)
+        return TRUE;
+    if (!GetStorageSetting("ROCKEY2_STORAGE_FILE", FilePath, sizeof FilePath))
+        _snprintf(FilePath, sizeof FilePath - 1, "%s", DefaultFilePath);
+    FileView = OpenFileView();
+    return FileView != NULL;
+}
+
+#ifndef _WIN32
+/*
+ * Maps the file again if another one was renamed over the path, as
+ * ry2image and ry2provision do. Windows refuses to replace a mapped file,
+ * so it never happens there.
+ */
+static void RemapFileImage(void)
+{
+    struct stat fileStat;
+    if (stat(FilePath, &fileStat) != 0 || ((UINT64)fileStat.st_dev == FileView->device && (UINT64)fileStat.st_ino == FileView->inode))
+        return;
+    RY2_FileView* view = OpenFileView();
+    if (!view)
+        return;
+    view->retired = FileView;
+    InterlockedExchangePointer((PVOID volatile*)&FileView, view);
+}
+#endif
+
+/*
+ * Another process may have grown the image beyond this mapping; its extra
+ * dongles stay invisible here until the library is reloaded.
+ */
+static int ReadFileDongleCount(void)
+{
+    if (!LoadFileImage())
+        return 0;
+    const RY2_FileView* view = FileView;
+    RY2_FileImage* image = view->image;
+    if (image->count > GetImageCapacity(image))
+    {
+        UnsealFileImage(image);
+        image->count = 0;
+    }
+    return (int)(image->count < view->capacity ? image->count : view->capacity);
+}
+
+/*
+ * Writes through the mapping raise no inotify events, so only other programs
+ * rewriting the file are reported. A file renamed over the path shows up as
+ * the mapped one losing its link; it is then mapped in turn and watched
+ * instead. Elsewhere every call reports a change and checks the path for a
+ * new file; a rescan of the mapped image is only memory reads anyway.
+ */
+static BOOL HasFileDonglesChanged(void)
+{
+#ifdef _WIN32
+    return TRUE;
+#else
+    if (!LoadFileImage())
+        return TRUE;
+#ifdef __linux__
+    if (FileWatch >= 0)
+    {
+        char events[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+        BOOL changed = FALSE;
+        BOOL unlinked = FALSE;
+        ssize_t length;
+        while ((length = read(FileWatch, events, sizeof events)) > 0)
+        {
+            changed = TRUE;
+            for (ssize_t offset = 0; offset < length; )
+            {
+                const struct inotify_event* event = (const struct inotify_event*)(events + offset);
+                if (event->mask & (IN_ATTRIB | IN_DELETE_SELF | IN_MOVE_SELF))
+                    unlinked = TRUE;
+                offset += sizeof(struct inotify_event) + event->len;
+            }
+        }
+        if (!unlinked)
+            return changed;
+        close(FileWatch);
+    }
+    // Watched before the path is checked, so that a file renamed over it
+    // right after the check is still reported.
+    FileWatch = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (FileWatch >= 0 && inotify_add_watch(FileWatch, FilePath, IN_MODIFY | IN_ATTRIB | IN_DELETE_SELF | IN_MOVE_SELF) < 0)
+    {
+        close(FileWatch);
+        FileWatch = -1;
+    }
+#endif
+    RemapFileImage();
+    return TRUE;
+#endif
+}
+
+static RY2_Store OpenFileDongle(int handle)
+{
+    if (!LoadFileImage() || handle < 0)
+        return NULL;
+    const RY2_FileView* view = FileView;
+    if ((DWORD)handle >= view->capacity)
+        return NULL;
+    return (RY2_Store)&view->image->dongles[handle];
+}
+
+static void CloseFileDongle(RY2_Store store)
+{
+    (void)store;
+}
+
+static BOOL ReadFileBlock(RY2_Store store, int block_index, char* buffer512)
+{
+    const RY2_FileDongle* dongle = (const RY2_FileDongle*)store;
+    if (!(dongle->present & RY2_FILE_BLOCK_PRESENT(block_index)))
+        return FALSE;
+    memcpy(buffer512, dongle->blocks[block_index], RY2_BLOCK_SIZE);
+    return TRUE;
+}
+
+static BOOL WriteFileBlock(RY2_Store store, int block_index, const char* buffer512)
+{
+    RY2_FileDongle* dongle = (RY2_FileDongle*)store;
+    UnsealFileImage(FileView->image);
+    memcpy(dongle->blocks[block_index], buffer512, RY2_BLOCK_SIZE);
+    // Different blocks are written concurrently under their own locks.
+    InterlockedOr((volatile LONG*)&dongle->present, RY2_FILE_BLOCK_PRESENT(block_index));
+    return TRUE;
+}
+
+static DWORD ReadFileBlocks(RY2_Store store, DWORD block_mask, char* const buffers[RY2_BLOCK_COUNT])
+{
+    const RY2_FileDongle* dongle = (const RY2_FileDongle*)store;
+    const DWORD readMask = block_mask & dongle->present & RY2_ALL_BLOCKS;
+    for (int i = 0; i < RY2_BLOCK_COUNT; i++)
+    {
+        if (readMask & RY2_BLOCK_MASK(i))
+            memcpy(buffers[i], dongle->blocks[i], RY2_BLOCK_SIZE);
+    }
+    return readMask;
+}
+
+static BOOL WriteFileBlocks(RY2_Store store, DWORD block_mask, const char* const buffers[RY2_BLOCK_COUNT])
+{
+    RY2_FileDongle* dongle = (RY2_FileDongle*)store;
+    UnsealFileImage(FileView->image);
+    for (int i = 0; i < RY2_BLOCK_COUNT; i++)
+    {
+        if (block_mask & RY2_BLOCK_MASK(i))
+            memcpy(dongle->blocks[i], buffers[i], RY2_BLOCK_SIZE);
+    }
+    InterlockedOr((volatile LONG*)&dongle->present, block_mask & RY2_ALL_BLOCKS);
+    return TRUE;
+}
+
+static BOOL ReadFileInfo(RY2_Store store, DWORD* const info[RY2_INFO_COUNT])
+{
+    const RY2_FileDongle* dongle = (const RY2_FileDongle*)store;
+    const BOOL success = (dongle->present & RY2_FILE_INFO_PRESENT) == RY2_FILE_INFO_PRESENT;
+    for (int i = 0; i < RY2_INFO_COUNT; i++)
+        *info[i] = (dongle->present & (1u << (8 + i))) ? dongle->info[i] : 0;
+    return success;
+}
+
+static BOOL WriteFileInfo(RY2_Store store, const DWORD* const info[RY2_INFO_COUNT])
+{
+    RY2_FileDongle* dongle = (RY2_FileDongle*)store;
+    UnsealFileImage(FileView->image);
+    for (int i = 0; i < RY2_INFO_COUNT; i++)
+        dongle->info[i] = *info[i];
+    InterlockedOr((volatile LONG*)&dongle->present, RY2_FILE_INFO_PRESENT);
+    return TRUE;
+}
+
+// The volume and index of the mapped file, so a file replaced under the same path differs.
+static DWORD GetFileIdentity(void)
+{
+    return LoadFileImage() ? FileView->identity : 0;
+}
+
+static void ShutdownFileStorage(void)
+{
+#ifdef __linux__
+    if (FileWatch >= 0)
+    {
+        close(FileWatch);
+        FileWatch = -1;
+    }
+#endif
+    while (FileView)
+    {
+        RY2_FileView* view = FileView;
+        FileView = view->retired;
+        UnmapFileView(view);
+    }
+}
+
+const RY2_StorageBackend FileStorage =
+{
+    "file",
+    ReadFileDongleCount,
+    HasFileDonglesChanged,
+    OpenFileDongle,
+    CloseFileDongle,
+    ReadFileBlock,
+    WriteFileBlock,
+    ReadFileBlocks,
+    WriteFileBlocks,
+    ReadFileInfo,
+    WriteFileInfo,
+    NULL,
+    NULL,
+    NULL,
+    ShutdownFileStorage,
+    GetFileIdentity
+};
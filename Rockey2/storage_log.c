@@ -0,0 +1,754 @@
+/*
+ * This file is part of the Rockey2 EMU project authored by Brian218.
+ *
+ * Copyright (C) 2026 Brian218 (https://github.com/brian218)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#include "platform.h"
+#include "storage.h"
+#include "flusher.h"
+
+#ifndef _WIN32
+#include <errno.h>
+#include <sys/file.h>
+#endif
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+
+#define RY2_LOG_COMPACT_SIZE (256 * 1024) // Log size that triggers a compaction
+#define RY2_LOG_READ_SIZE (16 * 1024)
+
+#ifdef _WIN32
+typedef HANDLE RY2_LogFile;
+#define RY2_NO_LOG_FILE INVALID_HANDLE_VALUE
+#else
+typedef int RY2_LogFile;
+#define RY2_NO_LOG_FILE -1
+#endif
+
+/*
+ * The open log of a dongle and the values it holds, replayed up to replayed.
+ * Reads are served from these values once the tail written by other
+ * processes has been replayed. busy serializes the threads of this process
+ * using the store, around file I/O only; other processes are kept apart by
+ * a lock on the file, shared by appends and exclusive for recovery and
+ * compaction. replayBuffer, used under busy as well, keeps the reads of a
+ * replay off the stack.
+ */
+typedef struct
+{
+    int handle;
+    RY2_LogFile file;
+    UINT64 replayed;
+    volatile LONG busy;
+    BOOL inBatch;
+    DWORD present;
+    DWORD batchMask;
+    DWORD info[RY2_INFO_COUNT];
+    DWORD batchInfo[RY2_INFO_COUNT];
+    char blocks[RY2_BLOCK_COUNT][RY2_BLOCK_SIZE];
+    char batchBlocks[RY2_BLOCK_COUNT][RY2_BLOCK_SIZE];
+    char replayBuffer[RY2_LOG_READ_SIZE];
+} RY2_LogDongle;
+
+static const char* DefaultLogDirectory = "Rockey2.logs";
+static char LogDirectory[260 + 1] = { 0 }; // MAX_PATH + '\0'
+static BOOL LogSync = TRUE;
+#ifdef _WIN32
+static HANDLE LogWatch = INVALID_HANDLE_VALUE;
+#endif
+#ifdef __linux__
+static int LogWatch = -1;
+#endif
+
+static BOOL LoadLogSettings(void)
+{
+    if (LogDirectory[0])
+        return TRUE;
+    if (!GetStorageSetting("ROCKEY2_STORAGE_LOG", LogDirectory, sizeof LogDirectory))
+        _snprintf(LogDirectory, sizeof LogDirectory - 1, "%s", DefaultLogDirectory);
+    char logSync[1 + 1] = { 0 };
+    // Every record is flushed unless ROCKEY2_LOG_SYNC=0 opts out.
+    LogSync = !(GetStorageSetting("ROCKEY2_LOG_SYNC", logSync, sizeof logSync) && logSync[0] == '0');
+#ifdef _WIN32
+    CreateDirectory(LogDirectory, NULL);
+#else
+    mkdir(LogDirectory, 0777);
+#endif
+    return TRUE;
+}
+
+static void GetLogPath(int handle, const char* suffix, char* path, SIZE_T size)
+{
+    _snprintf(path, size - 1, "%s/Dongle%02d.log%s", LogDirectory, handle, suffix);
+}
+
+#ifdef _WIN32
+static RY2_LogFile OpenLogFile(const char* path)
+{
+    return CreateFile(path, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+}
+
+static void CloseLogFile(RY2_LogFile file)
+{
+    CloseHandle(file);
+}
+
+static BOOL LogFileExists(const char* path)
+{
+    return GetFileAttributes(path) != INVALID_FILE_ATTRIBUTES;
+}
+
+// The size of the file, and whether compaction has replaced it by a new one.
+static BOOL StatLogFile(RY2_LogFile file, UINT64* size, BOOL* retired)
+{
+    FILE_STANDARD_INFO info;
+    if (!GetFileInformationByHandleEx(file, FileStandardInfo, &info, sizeof info))
+        return FALSE;
+    *size = (UINT64)info.EndOfFile.QuadPart;
+    *retired = info.DeletePending || info.NumberOfLinks == 0;
+    return TRUE;
+}
+
+static DWORD ReadLogFile(RY2_LogFile file, UINT64 offset, void* buffer, DWORD size)
+{
+    OVERLAPPED position = { 0 };
+    position.Offset = (DWORD)offset;
+    position.OffsetHigh = (DWORD)(offset >> 32);
+    DWORD bytesRead = 0;
+    return ReadFile(file, buffer, size, &bytesRead, &position) ? bytesRead : 0;
+}
+
+// A single write at the end of the file, atomic with respect to other appenders.
+static BOOL AppendLogFile(RY2_LogFile file, const void* data, DWORD size)
+{
+    OVERLAPPED position = { 0 };
+    position.Offset = 0xFFFFFFFF;
+    position.OffsetHigh = 0xFFFFFFFF;
+    DWORD bytesWritten = 0;
+    return WriteFile(file, data, size, &bytesWritten, &position) && bytesWritten == size;
+}
+
+static void LockLogFile(RY2_LogFile file, BOOL exclusive)
+{
+    OVERLAPPED position = { 0 };
+    LockFileEx(file, exclusive ? LOCKFILE_EXCLUSIVE_LOCK : 0, 0, 1, 0, &position);
+}
+
+static void UnlockLogFile(RY2_LogFile file)
+{
+    OVERLAPPED position = { 0 };
+    UnlockFileEx(file, 0, 1, 0, &position);
+}
+
+static void TruncateLogFile(RY2_LogFile file, UINT64 size)
+{
+    FILE_END_OF_FILE_INFO info;
+    info.EndOfFile.QuadPart = (LONGLONG)size;
+    SetFileInformationByHandle(file, FileEndOfFileInfo, &info, sizeof info);
+}
+
+static void SyncLogFile(RY2_LogFile file)
+{
+    FlushFileBuffers(file);
+}
+
+static BOOL ReplaceLogFile(const char* source, const char* target)
+{
+    return MoveFileEx(source, target, MOVEFILE_REPLACE_EXISTING);
+}
+
+static void DeleteLogFile(const char* path)
+{
+    DeleteFile(path);
+}
+#else
+static RY2_LogFile OpenLogFile(const char* path)
+{
+    return open(path, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0666);
+}
+
+static void CloseLogFile(RY2_LogFile file)
+{
+    close(file);
+}
+
+static BOOL LogFileExists(const char* path)
+{
+    struct stat fileStat;
+    return stat(path, &fileStat) == 0;
+}
+
+static BOOL StatLogFile(RY2_LogFile file, UINT64* size, BOOL* retired)
+{
+    struct stat fileStat;
+    if (fstat(file, &fileStat) != 0)
+        return FALSE;
+    *size = (UINT64)fileStat.st_size;
+    *retired = fileStat.st_nlink == 0;
+    return TRUE;
+}
+
+static DWORD ReadLogFile(RY2_LogFile file, UINT64 offset, void* buffer, DWORD size)
+{
+    const ssize_t bytesRead = pread(file, buffer, size, (off_t)offset);
+    return bytesRead > 0 ? (DWORD)bytesRead : 0;
+}
+
+// O_APPEND makes a single write atomic with respect to other appenders.
+static BOOL AppendLogFile(RY2_LogFile file, const void* data, DWORD size)
+{
+    return write(file, data, size) == (ssize_t)size;
+}
+
+static void LockLogFile(RY2_LogFile file, BOOL exclusive)
+{
+    while (flock(file, exclusive ? LOCK_EX : LOCK_SH) != 0 && errno == EINTR)
+        ;
+}
+
+static void UnlockLogFile(RY2_LogFile file)
+{
+    flock(file, LOCK_UN);
+}
+
+static void TruncateLogFile(RY2_LogFile file, UINT64 size)
+{
+    if (ftruncate(file, (off_t)size) != 0)
+        return;
+}
+
+static void SyncLogFile(RY2_LogFile file)
+{
+#ifdef __APPLE__
+    fsync(file);
+#else
+    fdatasync(file);
+#endif
+}
+
+static BOOL ReplaceLogFile(const char* source, const char* target)
+{
+    return rename(source, target) == 0;
+}
+
+static void DeleteLogFile(const char* path)
+{
+    unlink(path);
+}
+#endif
+
+static void EnterLog(RY2_LogDongle* log)
+{
+    while (InterlockedCompareExchange(&log->busy, 1, 0) != 0)
+        Sleep(0);
+}
+
+static void LeaveLog(RY2_LogDongle* log)
+{
+    InterlockedExchange(&log->busy, 0);
+}
+
+static void ApplyLogRecord(RY2_LogDongle* log, DWORD mask, const char* payload)
+{
+    if (mask & RY2_LOG_INFO)
+    {
+        memcpy(log->info, payload, sizeof log->info);
+        payload += sizeof log->info;
+    }
+    for (int i = 0; i < RY2_BLOCK_COUNT; i++)
+    {
+        if (mask & RY2_BLOCK_MASK(i))
+        {
+            memcpy(log->blocks[i], payload, RY2_BLOCK_SIZE);
+            payload += RY2_BLOCK_SIZE;
+        }
+    }
+    log->present |= mask;
+}
+
+/*
+ * Opens the current file of the log and replays it from the start. A new
+ * file gets its header; a file that is not a log is refused.
+ */
+static BOOL ReopenLog(RY2_LogDongle* log)
+{
+    if (log->file != RY2_NO_LOG_FILE)
+        CloseLogFile(log->file);
+    char path[260 + 1] = { 0 }; // MAX_PATH + '\0'
+    GetLogPath(log->handle, "", path, sizeof path);
+    log->file = OpenLogFile(path);
+    log->present = 0;
+    log->replayed = sizeof(RY2_LogHeader);
+    if (log->file == RY2_NO_LOG_FILE)
+        return FALSE;
+    RY2_LogHeader header = { 0 };
+    if (ReadLogFile(log->file, 0, &header, sizeof header) == 0)
+    {
+        LockLogFile(log->file, TRUE);
+        if (ReadLogFile(log->file, 0, &header, sizeof header) == 0)
+        {
+            header.magic = RY2_LOG_MAGIC;
+            header.version = RY2_LOG_VERSION;
+            AppendLogFile(log->file, &header, sizeof header);
+        }
+        UnlockLogFile(log->file);
+    }
+    if (header.magic != RY2_LOG_MAGIC || header.version != RY2_LOG_VERSION)
+    {
+        CloseLogFile(log->file);
+        log->file = RY2_NO_LOG_FILE;
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/*
+ * Applies the records appended since the last replay. A record that is cut
+ * short or fails its checksum is either still being written by another
+ * process or was torn by a crash. Holding the file exclusively tells them
+ * apart, since appends hold it shared: with exclusive set (or once it has
+ * been taken) a bad record is torn and is cut off the log.
+ */
+static BOOL ReplayLog(RY2_LogDongle* log, BOOL exclusive)
+{
+    BOOL locked = FALSE;
+    for (;;)
+    {
+        UINT64 size = 0;
+        BOOL retired = FALSE;
+        if (log->file == RY2_NO_LOG_FILE || !StatLogFile(log->file, &size, &retired))
+            return FALSE;
+        if (retired)
+        {
+            if (locked)
+                UnlockLogFile(log->file);
+            locked = FALSE;
+            if (!ReopenLog(log))
+                return FALSE;
+            continue;
+        }
+        char* buffer = log->replayBuffer;
+        DWORD length = 0;
+        DWORD used = 0;
+        while (log->replayed < size)
+        {
+            const DWORD wanted = size - log->replayed < sizeof log->replayBuffer ? (DWORD)(size - log->replayed) : (DWORD)sizeof log->replayBuffer;
+            length = ReadLogFile(log->file, log->replayed, buffer, wanted);
+            used = 0;
+            while (length - used >= sizeof(RY2_LogRecord))
+            {
+                const RY2_LogRecord* record = (const RY2_LogRecord*)(buffer + used);
+                const DWORD payloadSize = GetLogPayloadSize(record->mask);
+                if ((record->mask & ~(RY2_ALL_BLOCKS | RY2_LOG_INFO)) || length - used - sizeof *record < payloadSize)
+                    break;
+                if (ChecksumLogRecord(record->mask, record + 1, payloadSize) != record->checksum)
+                    break;
+                ApplyLogRecord(log, record->mask, (const char*)(record + 1));
+                used += sizeof *record + payloadSize;
+            }
+            log->replayed += used;
+            // Stop at a bad record, or one that does not fit in the rest of the file.
+            if (used == 0 || (used < length && length < sizeof log->replayBuffer))
+                break;
+        }
+        if (log->replayed >= size)
+            break;
+        if (!exclusive && !locked)
+        {
+            LockLogFile(log->file, TRUE);
+            locked = TRUE;
+            continue;
+        }
+        TruncateLogFile(log->file, log->replayed);
+        break;
+    }
+    if (locked)
+        UnlockLogFile(log->file);
+    return TRUE;
+}
+
+// Lays out a record of the given values in record and returns its size.
+static DWORD BuildLogRecord(char* record, DWORD mask, const DWORD* info, const char* const* buffers)
+{
+    char* payload = record + sizeof(RY2_LogRecord);
+    DWORD size = 0;
+    if (mask & RY2_LOG_INFO)
+    {
+        memcpy(payload, info, RY2_INFO_COUNT * sizeof(DWORD));
+        size += RY2_INFO_COUNT * sizeof(DWORD);
+    }
+    for (int i = 0; i < RY2_BLOCK_COUNT; i++)
+    {
+        if (mask & RY2_BLOCK_MASK(i))
+        {
+            memcpy(payload + size, buffers[i], RY2_BLOCK_SIZE);
+            size += RY2_BLOCK_SIZE;
+        }
+    }
+    ((RY2_LogRecord*)record)->mask = mask;
+    ((RY2_LogRecord*)record)->checksum = ChecksumLogRecord(mask, payload, size);
+    return sizeof(RY2_LogRecord) + size;
+}
+
+// Appends one record and replays it back together with anything before it.
+static BOOL AppendLog(RY2_LogDongle* log, DWORD mask, const DWORD* info, const char* const* buffers)
+{
+    char record[RY2_LOG_RECORD_MAX];
+    const DWORD size = BuildLogRecord(record, mask, info, buffers);
+    BOOL success = FALSE;
+    for (;;)
+    {
+        if (log->file == RY2_NO_LOG_FILE && !ReopenLog(log))
+            return FALSE;
+        UINT64 fileSize = 0;
+        BOOL retired = FALSE;
+        LockLogFile(log->file, FALSE);
+        if (StatLogFile(log->file, &fileSize, &retired) && retired)
+        {
+            // Compacted meanwhile: append to the new file instead.
+            UnlockLogFile(log->file);
+            ReopenLog(log);
+            continue;
+        }
+        success = AppendLogFile(log->file, record, size);
+        if (success && LogSync)
+            SyncLogFile(log->file);
+        UnlockLogFile(log->file);
+        if (fileSize + size > RY2_LOG_COMPACT_SIZE)
+            WakeFlusher();
+        break;
+    }
+    return ReplayLog(log, FALSE) && success;
+}
+
+static int ReadLogDongleCount(void)
+{
+    if (!LoadLogSettings())
+        return 0;
+    const int limit = GetDongleLimit();
+    int count = 0;
+    for (; count < limit; count++)
+    {
+        char path[260 + 1] = { 0 }; // MAX_PATH + '\0'
+        GetLogPath(count, "", path, sizeof path);
+        if (!LogFileExists(path))
+            break;
+    }
+    return count;
+}
+
+/*
+ * The dongle set is the run of DongleNN.log files from Dongle00, so only
+ * files appearing or disappearing in the directory count as a change.
+ * Compaction renames a new file into place, which costs one extra rescan.
+ */
+static BOOL HasLogDonglesChanged(void)
+{
+    LoadLogSettings();
+#ifdef _WIN32
+    if (LogWatch == INVALID_HANDLE_VALUE)
+    {
+        LogWatch = FindFirstChangeNotification(LogDirectory, FALSE, FILE_NOTIFY_CHANGE_FILE_NAME);
+        return TRUE;
+    }
+    if (WaitForSingleObject(LogWatch, 0) != WAIT_OBJECT_0)
+        return FALSE;
+    FindNextChangeNotification(LogWatch);
+    return TRUE;
+#elif defined(__linux__)
+    if (LogWatch < 0)
+    {
+        LogWatch = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (LogWatch >= 0 && inotify_add_watch(LogWatch, LogDirectory, IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO) < 0)
+        {
+            close(LogWatch);
+            LogWatch = -1;
+        }
+        return TRUE;
+    }
+    char events[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    BOOL changed = FALSE;
+    ssize_t length;
+    while ((length = read(LogWatch, events, sizeof events)) > 0)
+    {
+        for (ssize_t offset = 0; offset < length; )
+        {
+            const struct inotify_event* event = (const struct inotify_event*)(events + offset);
+            const SIZE_T nameLength = event->len ? strlen(event->name) : 0;
+            // Temporary files of a compaction come and go without changing the set.
+            if (nameLength < 4 || strcmp(event->name + nameLength - 4, ".tmp") != 0)
+                changed = TRUE;
+            offset += sizeof *event + event->len;
+        }
+    }
+    return changed;
+#else
+    return TRUE;
+#endif
+}
+
+static RY2_Store OpenLogDongle(int handle)
+{
+    if (!LoadLogSettings() || handle < 0)
+        return NULL;
+    RY2_LogDongle* log = (RY2_LogDongle*)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(RY2_LogDongle));
+    if (!log)
+        return NULL;
+    log->handle = handle;
+    log->file = RY2_NO_LOG_FILE;
+    if (!ReopenLog(log) || !ReplayLog(log, FALSE))
+    {
+        if (log->file != RY2_NO_LOG_FILE)
+            CloseLogFile(log->file);
+        HeapFree(GetProcessHeap(), 0, log);
+        return NULL;
+    }
+    return (RY2_Store)log;
+}
+
+static void CloseLogDongle(RY2_Store store)
+{
+    RY2_LogDongle* log = (RY2_LogDongle*)store;
+    if (log->file != RY2_NO_LOG_FILE)
+        CloseLogFile(log->file);
+    HeapFree(GetProcessHeap(), 0, log);
+}
+
+static DWORD ReadLogBlocks(RY2_Store store, DWORD block_mask, char* const buffers[RY2_BLOCK_COUNT])
+{
+    RY2_LogDongle* log = (RY2_LogDongle*)store;
+    EnterLog(log);
+    ReplayLog(log, FALSE);
+    const DWORD readMask = block_mask & (log->present | log->batchMask) & RY2_ALL_BLOCKS;
+    for (int i = 0; i < RY2_BLOCK_COUNT; i++)
+    {
+        if (readMask & RY2_BLOCK_MASK(i))
+            memcpy(buffers[i], (log->batchMask & RY2_BLOCK_MASK(i)) ? log->batchBlocks[i] : log->blocks[i], RY2_BLOCK_SIZE);
+    }
+    LeaveLog(log);
+    return readMask;
+}
+
+// Inside a batch, writes are collected into the record EndBatch appends.
+static BOOL WriteLogBlocks(RY2_Store store, DWORD block_mask, const char* const buffers[RY2_BLOCK_COUNT])
+{
+    RY2_LogDongle* log = (RY2_LogDongle*)store;
+    EnterLog(log);
+    BOOL success = TRUE;
+    if (log->inBatch)
+    {
+        for (int i = 0; i < RY2_BLOCK_COUNT; i++)
+        {
+            if (block_mask & RY2_BLOCK_MASK(i))
+                memcpy(log->batchBlocks[i], buffers[i], RY2_BLOCK_SIZE);
+        }
+        log->batchMask |= block_mask & RY2_ALL_BLOCKS;
+    }
+    else
+        success = AppendLog(log, block_mask & RY2_ALL_BLOCKS, NULL, buffers);
+    LeaveLog(log);
+    return success;
+}
+
+static BOOL ReadLogBlock(RY2_Store store, int block_index, char* buffer512)
+{
+    char* buffers[RY2_BLOCK_COUNT] = { NULL };
+    buffers[block_index] = buffer512;
+    return ReadLogBlocks(store, RY2_BLOCK_MASK(block_index), buffers) != 0;
+}
+
+static BOOL WriteLogBlock(RY2_Store store, int block_index, const char* buffer512)
+{
+    const char* buffers[RY2_BLOCK_COUNT] = { NULL };
+    buffers[block_index] = buffer512;
+    return WriteLogBlocks(store, RY2_BLOCK_MASK(block_index), buffers);
+}
+
+static BOOL ReadLogInfo(RY2_Store store, DWORD* const info[RY2_INFO_COUNT])
+{
+    RY2_LogDongle* log = (RY2_LogDongle*)store;
+    EnterLog(log);
+    ReplayLog(log, FALSE);
+    const DWORD* values = (log->batchMask & RY2_LOG_INFO) ? log->batchInfo : log->info;
+    const BOOL success = ((log->present | log->batchMask) & RY2_LOG_INFO) != 0;
+    for (int i = 0; i < RY2_INFO_COUNT; i++)
+        *info[i] = success ? values[i] : 0;
+    LeaveLog(log);
+    return success;
+}
+
+static BOOL WriteLogInfo(RY2_Store store, const DWORD* const info[RY2_INFO_COUNT])
+{
+    RY2_LogDongle* log = (RY2_LogDongle*)store;
+    DWORD values[RY2_INFO_COUNT];
+    for (int i = 0; i < RY2_INFO_COUNT; i++)
+        values[i] = *info[i];
+    EnterLog(log);
+    BOOL success = TRUE;
+    if (log->inBatch)
+    {
+        memcpy(log->batchInfo, values, sizeof values);
+        log->batchMask |= RY2_LOG_INFO;
+    }
+    else
+        success = AppendLog(log, RY2_LOG_INFO, values, NULL);
+    LeaveLog(log);
+    return success;
+}
+
+static void BeginLogBatch(RY2_Store store)
+{
+    RY2_LogDongle* log = (RY2_LogDongle*)store;
+    EnterLog(log);
+    log->inBatch = TRUE;
+    LeaveLog(log);
+}
+
+static BOOL EndLogBatch(RY2_Store store)
+{
+    RY2_LogDongle* log = (RY2_LogDongle*)store;
+    EnterLog(log);
+    BOOL success = TRUE;
+    if (log->batchMask)
+    {
+        const char* buffers[RY2_BLOCK_COUNT];
+        for (int i = 0; i < RY2_BLOCK_COUNT; i++)
+            buffers[i] = log->batchBlocks[i];
+        success = AppendLog(log, log->batchMask, log->batchInfo, buffers);
+    }
+    log->inBatch = FALSE;
+    log->batchMask = 0;
+    LeaveLog(log);
+    return success;
+}
+
+/*
+ * Rewrites a log that has grown past RY2_LOG_COMPACT_SIZE as a single record
+ * of its current values. The new file is complete before it is renamed over
+ * the old one, so a crash leaves one or the other; processes still using the
+ * old file notice that it lost its name and reopen the log.
+ */
+static void CompactLog(RY2_Store store)
+{
+    RY2_LogDongle* log = (RY2_LogDongle*)store;
+    EnterLog(log);
+    UINT64 size = 0;
+    BOOL retired = FALSE;
+    if (log->file == RY2_NO_LOG_FILE || log->inBatch || !StatLogFile(log->file, &size, &retired) || retired || size <= RY2_LOG_COMPACT_SIZE)
+    {
+        LeaveLog(log);
+        return;
+    }
+    LockLogFile(log->file, TRUE);
+    // Another process may have compacted it while this one waited.
+    if (StatLogFile(log->file, &size, &retired) && !retired && size > RY2_LOG_COMPACT_SIZE && ReplayLog(log, TRUE))
+    {
+        char path[260 + 1] = { 0 }; // MAX_PATH + '\0'
+        char tempPath[264 + 1] = { 0 }; // MAX_PATH + ".tmp" + '\0'
+        GetLogPath(log->handle, "", path, sizeof path);
+        GetLogPath(log->handle, ".tmp", tempPath, sizeof tempPath);
+        const RY2_LogFile temp = OpenLogFile(tempPath);
+        if (temp != RY2_NO_LOG_FILE)
+        {
+            TruncateLogFile(temp, 0);
+            const RY2_LogHeader header = { RY2_LOG_MAGIC, RY2_LOG_VERSION };
+            BOOL success = AppendLogFile(temp, &header, sizeof header);
+            if (success && log->present)
+            {
+                const char* buffers[RY2_BLOCK_COUNT];
+                for (int i = 0; i < RY2_BLOCK_COUNT; i++)
+                    buffers[i] = log->blocks[i];
+                char record[RY2_LOG_RECORD_MAX];
+                const DWORD recordSize = BuildLogRecord(record, log->present, log->info, buffers);
+                success = AppendLogFile(temp, record, recordSize);
+            }
+            if (success)
+                SyncLogFile(temp);
+            CloseLogFile(temp);
+            if (!success || !ReplaceLogFile(tempPath, path))
+                DeleteLogFile(tempPath);
+        }
+    }
+    UnlockLogFile(log->file);
+    // Picks up the new file, or the old one again if the rename failed.
+    ReopenLog(log);
+    ReplayLog(log, FALSE);
+    LeaveLog(log);
+}
+
+// The volume and index of the log directory, whatever path names it.
+static DWORD GetLogIdentity(void)
+{
+    LoadLogSettings();
+#ifdef _WIN32
+    HANDLE directory = CreateFile(LogDirectory, 0, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS, NULL);
+    if (directory == INVALID_HANDLE_VALUE)
+        return 0;
+    BY_HANDLE_FILE_INFORMATION info;
+    const BOOL found = GetFileInformationByHandle(directory, &info);
+    CloseHandle(directory);
+    if (!found)
+        return 0;
+    const DWORD identity[3] = { info.dwVolumeSerialNumber, info.nFileIndexHigh, info.nFileIndexLow };
+    return HashFileWords(0x811C9DC5, identity, sizeof identity);
+#else
+    struct stat directoryStat;
+    if (stat(LogDirectory, &directoryStat) != 0)
+        return 0;
+    const DWORD identity[4] = { (DWORD)directoryStat.st_dev, (DWORD)((UINT64)directoryStat.st_dev >> 32), (DWORD)directoryStat.st_ino, (DWORD)((UINT64)directoryStat.st_ino >> 32) };
+    return HashFileWords(0x811C9DC5, identity, sizeof identity);
+#endif
+}
+
+static void ShutdownLogStorage(void)
+{
+#ifdef _WIN32
+    if (LogWatch != INVALID_HANDLE_VALUE)
+    {
+        FindCloseChangeNotification(LogWatch);
+        LogWatch = INVALID_HANDLE_VALUE;
+    }
+#elif defined(__linux__)
+    if (LogWatch >= 0)
+    {
+        close(LogWatch);
+        LogWatch = -1;
+    }
+#endif
+}
+
+const RY2_StorageBackend LogStorage =
+{
+    "log",
+    ReadLogDongleCount,
+    HasLogDonglesChanged,
+    OpenLogDongle,
+    CloseLogDongle,
+    ReadLogBlock,
+    WriteLogBlock,
+    ReadLogBlocks,
+    WriteLogBlocks,
+    ReadLogInfo,
+    WriteLogInfo,
+    BeginLogBatch,
+    EndLogBatch,
+    CompactLog,
+    ShutdownLogStorage,
+    GetLogIdentity
+};
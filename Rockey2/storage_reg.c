@@ -0,0 +1,355 @@
+/*
+ * This file is part of the Rockey2 EMU project authored by Brian218.
+ *
+ * Copyright (C) 2026 Brian218 (https://github.com/brian218)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#ifdef _WIN32
+
+#include "platform.h"
+#include "storage.h"
+
+static const HKEY RegRootKey = HKEY_CURRENT_USER;
+static const char* RegSubKey = "Software\\Rockey2\\Dongles";
+static const char* RegBlockName = "Block%d";
+static const char* RegBlocksName = "Blocks";
+static const char* const RegInfoNames[RY2_INFO_COUNT] = { "HID", "UID", "Version", "Protection" };
+
+static int ReadRegDongleCountValue(void)
+{
+    const char* RegValueName = "Count";
+    int dongleCount = 0;
+    HKEY regKey = NULL;
+    if ((RegCreateKeyEx(RegRootKey, RegSubKey, 0, NULL, REG_OPTION_NON_VOLATILE, KEY_WOW64_64KEY | KEY_READ | KEY_WRITE, NULL, &regKey, NULL) == ERROR_SUCCESS ||
+        RegOpenKeyEx(RegRootKey, RegSubKey, 0, KEY_WOW64_64KEY | KEY_READ, &regKey) == ERROR_SUCCESS) && regKey)
+    {
+        DWORD regType = REG_DWORD;
+        DWORD regSize = sizeof(DWORD);
+        LSTATUS regStatus = RegQueryValueEx(regKey, RegValueName, NULL, &regType, (LPBYTE)&dongleCount, &regSize);
+        if (!(regStatus == ERROR_SUCCESS && regType == REG_DWORD && regSize == sizeof(DWORD)) || dongleCount < 0 || dongleCount > GetDongleLimit())
+        {
+            dongleCount = 0;
+            regType = REG_DWORD;
+            regSize = sizeof(DWORD);
+            regStatus = RegSetValueEx(regKey, RegValueName, 0, regType, (const LPBYTE)&dongleCount, regSize);
+        }
+        RegCloseKey(regKey);
+    }
+    return dongleCount;
+}
+
+static HKEY RegWatchKey = NULL;
+static HANDLE RegChangeEvent = NULL;
+static BOOL RegConfigHashed = FALSE;
+static DWORD RegConfigHash = 0;
+
+// Watches the Dongles key and its subtree, so that edits inside a DongleNN key are seen too.
+static BOOL WatchRegDongles(void)
+{
+    if (!RegWatchKey && RegOpenKeyEx(RegRootKey, RegSubKey, 0, KEY_WOW64_64KEY | KEY_NOTIFY, &RegWatchKey) != ERROR_SUCCESS)
+    {
+        RegWatchKey = NULL;
+        return FALSE;
+    }
+    if (!RegChangeEvent)
+        RegChangeEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+    return RegChangeEvent && RegNotifyChangeKeyValue(RegWatchKey, TRUE, REG_NOTIFY_CHANGE_NAME | REG_NOTIFY_CHANGE_LAST_SET, RegChangeEvent, TRUE) == ERROR_SUCCESS;
+}
+
+static DWORD HashRegValue(DWORD hash, const BYTE* data, DWORD size)
+{
+    for (DWORD i = 0; i < size; i++)
+        hash = (hash ^ data[i]) * 16777619; // FNV-1a
+    return hash;
+}
+
+/*
+ * Hashes Count and the info values of every DongleNN key, all that a rescan
+ * reads. Block writes, including the emulator's own, leave it unchanged, so
+ * they do not trigger rescans although they signal the watch.
+ */
+static DWORD HashRegConfig(void)
+{
+    DWORD hash = 2166136261;
+    HKEY regKey = NULL;
+    if (RegOpenKeyEx(RegRootKey, RegSubKey, 0, KEY_WOW64_64KEY | KEY_READ, &regKey) != ERROR_SUCCESS)
+        return hash;
+    DWORD dongleCount = 0;
+    DWORD regType = REG_DWORD;
+    DWORD regSize = sizeof(DWORD);
+    if (RegQueryValueEx(regKey, "Count", NULL, &regType, (LPBYTE)&dongleCount, &regSize) != ERROR_SUCCESS || regType != REG_DWORD || regSize != sizeof(DWORD))
+        dongleCount = 0;
+    hash = HashRegValue(hash, (const BYTE*)&dongleCount, sizeof dongleCount);
+    for (int i = 0; i < (int)dongleCount && i < GetDongleLimit(); i++)
+    {
+        char regKeyPath[11 + 1] = { 0 }; // Dongle65535 + '\0'
+        _snprintf(regKeyPath, sizeof regKeyPath - 1, "Dongle%02d", i);
+        HKEY dongleKey = NULL;
+        if (RegOpenKeyEx(regKey, regKeyPath, 0, KEY_WOW64_64KEY | KEY_READ, &dongleKey) != ERROR_SUCCESS)
+            continue;
+        for (int j = 0; j < RY2_INFO_COUNT; j++)
+        {
+            DWORD value = 0;
+            regType = REG_DWORD;
+            regSize = sizeof(DWORD);
+            if (RegQueryValueEx(dongleKey, RegInfoNames[j], NULL, &regType, (LPBYTE)&value, &regSize) != ERROR_SUCCESS || regType != REG_DWORD || regSize != sizeof(DWORD))
+                value = 0;
+            hash = HashRegValue(hash, (const BYTE*)&value, sizeof value);
+        }
+        RegCloseKey(dongleKey);
+    }
+    RegCloseKey(regKey);
+    return hash;
+}
+
+static BOOL HasRegDonglesChanged(void)
+{
+    if (RegWatchKey && RegChangeEvent && WaitForSingleObject(RegChangeEvent, 0) == WAIT_TIMEOUT)
+        return FALSE;
+    // Re-armed before the hash is taken, so a change during the scan is not missed.
+    const BOOL watched = WatchRegDongles();
+    const DWORD hash = HashRegConfig();
+    if (watched && RegConfigHashed && hash == RegConfigHash)
+        return FALSE;
+    RegConfigHash = hash;
+    RegConfigHashed = watched;
+    return TRUE;
+}
+
+/*
+ * An opened dongle key. hasBlocks caches whether the key has the contiguous
+ * "Blocks" value: -1 until the first access probes it, then FALSE or TRUE, so
+ * dongles still on BlockN do not pay an extra query per block access. It only
+ * becomes TRUE afterwards, when this process writes the value; a dongle
+ * migrated by another process is noticed when the key is next opened.
+ */
+typedef struct
+{
+    HKEY key;
+    volatile LONG hasBlocks;
+} RY2_RegDongle;
+
+static RY2_Store OpenRegDongleKey(int handle)
+{
+    char regKeyPath[36 + 1] = { 0 }; // Software\Rockey2\Dongles\Dongle65535 + '\0'
+    HKEY regKey = NULL;
+    _snprintf(regKeyPath, sizeof regKeyPath - 1, "%s\\Dongle%02d", RegSubKey, handle);
+    if (RegCreateKeyEx(RegRootKey, regKeyPath, 0, NULL, REG_OPTION_NON_VOLATILE, KEY_WOW64_64KEY | KEY_READ | KEY_WRITE, NULL, &regKey, NULL) != ERROR_SUCCESS &&
+        RegOpenKeyEx(RegRootKey, regKeyPath, 0, KEY_WOW64_64KEY | KEY_READ, &regKey) != ERROR_SUCCESS)
+        return NULL;
+    RY2_RegDongle* reg = (RY2_RegDongle*)HeapAlloc(GetProcessHeap(), 0, sizeof(RY2_RegDongle));
+    if (!reg)
+    {
+        RegCloseKey(regKey);
+        return NULL;
+    }
+    reg->key = regKey;
+    reg->hasBlocks = -1;
+    return (RY2_Store)reg;
+}
+
+static void CloseRegDongleKey(RY2_Store store)
+{
+    RY2_RegDongle* reg = (RY2_RegDongle*)store;
+    RegCloseKey(reg->key);
+    HeapFree(GetProcessHeap(), 0, reg);
+}
+
+static BOOL ReadRegBlockValue(RY2_Store store, int block_index, char* buffer512)
+{
+    char regName[6 + 1] = { 0 }; // Block0 + '\0'
+    _snprintf(regName, sizeof regName - 1, RegBlockName, block_index);
+    DWORD regType = REG_BINARY;
+    DWORD regSize = RY2_BLOCK_SIZE;
+    LSTATUS regStatus = RegQueryValueEx(((RY2_RegDongle*)store)->key, regName, NULL, &regType, (LPBYTE)buffer512, &regSize);
+    return regStatus == ERROR_SUCCESS && regType == REG_BINARY && regSize == RY2_BLOCK_SIZE;
+}
+
+static BOOL WriteRegBlockValue(RY2_Store store, int block_index, const char* buffer512)
+{
+    char regName[6 + 1] = { 0 }; // Block0 + '\0'
+    _snprintf(regName, sizeof regName - 1, RegBlockName, block_index);
+    DWORD regType = REG_BINARY;
+    DWORD regSize = RY2_BLOCK_SIZE;
+    LSTATUS regStatus = RegSetValueEx(((RY2_RegDongle*)store)->key, regName, 0, regType, (const LPBYTE)buffer512, regSize);
+    return regStatus == ERROR_SUCCESS /* && regType == REG_BINARY && regSize == 512 */;
+}
+
+/*
+ * Contiguous layout: all five blocks in one 2560-byte "Blocks" value, so a
+ * vectored read or write is a single registry call. Once a dongle has the
+ * value it is authoritative and every block access goes through it. Dongles
+ * without it keep the per-block BlockN values until written with
+ * ROCKEY2_CONTIGUOUS_BLOCKS=1, which migrates them on their next write.
+ */
+static BOOL UseContiguousBlocks(void)
+{
+    static LONG contiguousBlocks = -1;
+    if (contiguousBlocks < 0)
+    {
+        char setting[1 + 1] = { 0 };
+        contiguousBlocks = GetStorageSetting("ROCKEY2_CONTIGUOUS_BLOCKS", setting, sizeof setting) && setting[0] == '1';
+    }
+    return contiguousBlocks;
+}
+
+static BOOL ReadRegBlocksValue(RY2_RegDongle* reg, char (*image)[RY2_BLOCK_SIZE])
+{
+    if (!reg->hasBlocks)
+        return FALSE;
+    DWORD regType = REG_BINARY;
+    DWORD regSize = RY2_BLOCK_COUNT * RY2_BLOCK_SIZE;
+    LSTATUS regStatus = RegQueryValueEx(reg->key, RegBlocksName, NULL, &regType, (LPBYTE)image, &regSize);
+    // Only a missing value is cached; a write racing the probe has already set TRUE.
+    if (reg->hasBlocks < 0)
+        InterlockedCompareExchange(&reg->hasBlocks, regStatus != ERROR_FILE_NOT_FOUND, -1);
+    return regStatus == ERROR_SUCCESS && regType == REG_BINARY && regSize == RY2_BLOCK_COUNT * RY2_BLOCK_SIZE;
+}
+
+static DWORD ReadRegBlocks(RY2_Store store, DWORD block_mask, char* const buffers[RY2_BLOCK_COUNT])
+{
+    char image[RY2_BLOCK_COUNT][RY2_BLOCK_SIZE];
+    const BOOL hasImage = ReadRegBlocksValue((RY2_RegDongle*)store, image);
+    DWORD readMask = 0;
+    for (int i = 0; i < RY2_BLOCK_COUNT; i++)
+    {
+        if (!(block_mask & RY2_BLOCK_MASK(i)))
+            continue;
+        if (hasImage)
+            memcpy(buffers[i], image[i], RY2_BLOCK_SIZE);
+        else if (!ReadRegBlockValue(store, i, buffers[i]))
+            continue;
+        readMask |= RY2_BLOCK_MASK(i);
+    }
+    return readMask;
+}
+
+static BOOL WriteRegBlocks(RY2_Store store, DWORD block_mask, const char* const buffers[RY2_BLOCK_COUNT])
+{
+    RY2_RegDongle* reg = (RY2_RegDongle*)store;
+    char image[RY2_BLOCK_COUNT][RY2_BLOCK_SIZE];
+    const BOOL contiguous = UseContiguousBlocks();
+    // A full write in contiguous mode replaces the whole value without reading it.
+    const BOOL hasImage = ((block_mask & RY2_ALL_BLOCKS) == RY2_ALL_BLOCKS && contiguous) || ReadRegBlocksValue(reg, image);
+    if (!hasImage && !contiguous)
+    {
+        BOOL success = TRUE;
+        for (int i = 0; i < RY2_BLOCK_COUNT; i++)
+        {
+            if ((block_mask & RY2_BLOCK_MASK(i)) && !WriteRegBlockValue(store, i, buffers[i]))
+                success = FALSE;
+        }
+        return success;
+    }
+    for (int i = 0; i < RY2_BLOCK_COUNT; i++)
+    {
+        if (block_mask & RY2_BLOCK_MASK(i))
+            memcpy(image[i], buffers[i], RY2_BLOCK_SIZE);
+        else if (!hasImage && !ReadRegBlockValue(store, i, image[i])) // Migrating from BlockN
+            memset(image[i], 0xFF, RY2_BLOCK_SIZE);
+    }
+    LSTATUS regStatus = RegSetValueEx(reg->key, RegBlocksName, 0, REG_BINARY, (const LPBYTE)image, sizeof image);
+    if (regStatus != ERROR_SUCCESS)
+        return FALSE;
+    InterlockedExchange(&reg->hasBlocks, TRUE);
+    return TRUE;
+}
+
+static BOOL ReadRegBlock(RY2_Store store, int block_index, char* buffer512)
+{
+    char* buffers[RY2_BLOCK_COUNT] = { NULL };
+    buffers[block_index] = buffer512;
+    return ReadRegBlocks(store, RY2_BLOCK_MASK(block_index), buffers) != 0;
+}
+
+static BOOL WriteRegBlock(RY2_Store store, int block_index, const char* buffer512)
+{
+    const char* buffers[RY2_BLOCK_COUNT] = { NULL };
+    buffers[block_index] = buffer512;
+    return WriteRegBlocks(store, RY2_BLOCK_MASK(block_index), buffers);
+}
+
+static BOOL ReadRegInfoValue(RY2_Store store, DWORD* const info[RY2_INFO_COUNT])
+{
+    BOOL success = TRUE;
+    for (int i = 0; i < RY2_INFO_COUNT; i++)
+    {
+        DWORD regType = REG_DWORD;
+        DWORD regSize = sizeof(DWORD);
+        LSTATUS regStatus = RegQueryValueEx(((RY2_RegDongle*)store)->key, RegInfoNames[i], NULL, &regType, (LPBYTE)info[i], &regSize);
+        if (!(regStatus == ERROR_SUCCESS && regType == REG_DWORD && regSize == sizeof(DWORD)))
+        {
+            if (success)
+                success = FALSE;
+            *info[i] = 0;
+        }
+    }
+    return success;
+}
+
+static BOOL WriteRegInfoValue(RY2_Store store, const DWORD* const info[RY2_INFO_COUNT])
+{
+    BOOL success = TRUE;
+    for (int i = 0; i < RY2_INFO_COUNT; i++)
+    {
+        DWORD regType = REG_DWORD;
+        DWORD regSize = sizeof(DWORD);
+        LSTATUS regStatus = RegSetValueEx(((RY2_RegDongle*)store)->key, RegInfoNames[i], 0, regType, (const LPBYTE)info[i], regSize);
+        if (!(regStatus == ERROR_SUCCESS /* && regType == REG_DWORD && regSize == sizeof(DWORD) */))
+        {
+            if (success)
+                success = FALSE;
+        }
+    }
+    return success;
+}
+
+static void ShutdownRegStorage(void)
+{
+    if (RegWatchKey)
+    {
+        RegCloseKey(RegWatchKey);
+        RegWatchKey = NULL;
+    }
+    if (RegChangeEvent)
+    {
+        CloseHandle(RegChangeEvent);
+        RegChangeEvent = NULL;
+    }
+}
+
+const RY2_StorageBackend RegistryStorage =
+{
+    "registry",
+    ReadRegDongleCountValue,
+    HasRegDonglesChanged,
+    OpenRegDongleKey,
+    CloseRegDongleKey,
+    ReadRegBlock,
+    WriteRegBlock,
+    ReadRegBlocks,
+    WriteRegBlocks,
+    ReadRegInfoValue,
+    WriteRegInfoValue,
+    NULL,
+    NULL,
+    NULL,
+    ShutdownRegStorage,
+    NULL
+};
+
+#endif
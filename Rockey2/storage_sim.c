@@ -0,0 +1,443 @@
+/*
+ * This file is part of the Rockey2 EMU project authored by Brian218.
+ *
+ * Copyright (C) 2026 Brian218 (https://github.com/brian218)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/*
+ * The simulated backend keeps its dongles in the ROCKEY2_SIM shared-memory
+ * segment, laid out as a file image, and delays or fails every block and info
+ * transfer as its latency profiles say. It exists to measure how the caches
+ * and write-behind mode hide a slow storage from the callers.
+ *
+ * A profile is one or more terms joined by '+', whose delays add up:
+ *
+ *     fixed:<us>                   always <us>
+ *     uniform:<min us>,<max us>    evenly spread over the range
+ *     lognormal:<median us>,<sigma> a long-tailed delay
+ *     stall:<period ms>,<ms>       the first <ms> of every period block
+ *     fail:<percent>               the operation fails
+ *
+ * Numbers are at most 1000000, with up to three decimals. The draws come
+ * from a counter-based generator seeded by ROCKEY2_SIM_SEED, so the n-th
+ * read or write of a process always draws the same delay. The library links
+ * no C runtime on Windows, so all of it is integer arithmetic, kept to 32-bit
+ * divisions and 32x32-bit products for x86.
+ */
+
+#include "platform.h"
+#include "storage.h"
+
+#define RY2_SIM_MAX_DELAY_NS 10000000000ull // Caps the tail of a lognormal term
+
+typedef struct
+{
+    DWORD fixedNs;
+    DWORD uniformMinNs;
+    DWORD uniformMaxNs;
+    DWORD medianNs;
+    LONG sigmaLog2e; // sigma * log2(e) in 16.16
+    DWORD stallPeriodMs;
+    DWORD stallMs;
+    DWORD failPerMillion;
+    DWORD stream; // Keeps the draws of the profiles apart
+    volatile LONG draws;
+} RY2_SimProfile;
+
+static RY2_FileImage* SimImage = NULL;
+static HANDLE SimMapping = NULL;
+static DWORD SimImageSize = 0;
+static DWORD SimCapacity = 0;
+static BOOL SimWatched = FALSE;
+static DWORD SimSeed = 0;
+static RY2_SimProfile SimReads = { 0 };
+static RY2_SimProfile SimWrites = { 0 };
+#ifdef _WIN32
+static UINT64 SimTicksPerNs = 0; // 32.32 fixed point
+#endif
+
+// Parses a decimal number with up to three decimals, in thousandths.
+static BOOL ParseSimNumber(const char** cursor, DWORD* thousandths)
+{
+    const char* p = *cursor;
+    DWORD value = 0;
+    if (*p < '0' || *p > '9')
+        return FALSE;
+    for (; *p >= '0' && *p <= '9'; p++)
+    {
+        value = value * 10 + (*p - '0');
+        if (value > 1000000) // Keeps the arithmetic below in range
+            return FALSE;
+    }
+    value *= 1000;
+    if (*p == '.')
+    {
+        DWORD scale = 1000;
+        for (p++; *p >= '0' && *p <= '9'; p++)
+        {
+            scale /= 10;
+            value += (*p - '0') * scale;
+        }
+    }
+    *cursor = p;
+    *thousandths = value;
+    return TRUE;
+}
+
+// Parses <number>[,<number>] into as many values as the term takes.
+static BOOL ParseSimArguments(const char** cursor, DWORD* values, int count)
+{
+    for (int i = 0; i < count; i++)
+    {
+        if (i && *(*cursor)++ != ',')
+            return FALSE;
+        if (!ParseSimNumber(cursor, &values[i]))
+            return FALSE;
+    }
+    return TRUE;
+}
+
+static BOOL MatchSimTerm(const char** cursor, const char* name)
+{
+    const char* p = *cursor;
+    for (; *name; name++, p++)
+    {
+        if (*p != *name)
+            return FALSE;
+    }
+    *cursor = p;
+    return TRUE;
+}
+
+// A malformed profile is ignored as a whole, leaving the operations undelayed.
+static void LoadSimProfile(const char* name, RY2_SimProfile* profile, DWORD stream)
+{
+    char setting[127 + 1] = { 0 };
+    RY2_SimProfile parsed = { 0 };
+    parsed.stream = stream;
+    if (!GetStorageSetting(name, setting, sizeof setting))
+        return;
+    const char* cursor = setting;
+    for (;;)
+    {
+        DWORD values[2] = { 0 };
+        if (MatchSimTerm(&cursor, "fixed:") && ParseSimArguments(&cursor, values, 1))
+            parsed.fixedNs = values[0];
+        else if (MatchSimTerm(&cursor, "uniform:") && ParseSimArguments(&cursor, values, 2) && values[0] <= values[1])
+        {
+            parsed.uniformMinNs = values[0];
+            parsed.uniformMaxNs = values[1];
+        }
+        else if (MatchSimTerm(&cursor, "lognormal:") && ParseSimArguments(&cursor, values, 2))
+        {
+            // A sigma beyond 1000 saturates all but the median draws anyway.
+            const DWORD sigmaMilli = values[1] < 1000000 ? values[1] : 1000000;
+            parsed.medianNs = values[0];
+            parsed.sigmaLog2e = (LONG)(sigmaMilli * 94 + sigmaMilli * 548 / 1000); // log2(e) = 94548 / 65536
+        }
+        else if (MatchSimTerm(&cursor, "stall:") && ParseSimArguments(&cursor, values, 2) && values[0] >= 1000 && values[1] <= values[0])
+        {
+            parsed.stallPeriodMs = values[0] / 1000;
+            parsed.stallMs = values[1] / 1000;
+        }
+        else if (MatchSimTerm(&cursor, "fail:") && ParseSimArguments(&cursor, values, 1) && values[0] <= 100000)
+            parsed.failPerMillion = values[0] * 10;
+        else
+            return;
+        if (!*cursor)
+            break;
+        if (*cursor++ != '+')
+            return;
+    }
+    *profile = parsed;
+}
+
+static DWORD MixSim(DWORD x)
+{
+    x ^= x >> 16;
+    x *= 0x7FEB352D;
+    x ^= x >> 15;
+    x *= 0x846CA68B;
+    return x ^ (x >> 16);
+}
+
+/*
+ * The j-th 32-bit draw of the given operation, a hash of the seed and the
+ * position, so no state is shared between the threads. The mixer is a
+ * bijection, so the first 2^28 operations of a stream never repeat a draw.
+ */
+static DWORD DrawSim(const RY2_SimProfile* profile, LONG operation, DWORD j)
+{
+    return MixSim(((DWORD)operation << 4 | j) ^ MixSim(SimSeed ^ profile->stream * 0x9E3779B9));
+}
+
+/*
+ * median * e^(sigma * z) for a standard normal z, approximated in 16.16
+ * fixed point: z as a sum of twelve uniform draws minus six, and the power
+ * of two with a polynomial for the fraction of the exponent.
+ */
+static UINT64 DrawLognormalNs(const RY2_SimProfile* profile, LONG operation)
+{
+    LONG z = -6 * 65536;
+    for (DWORD j = 0; j < 12; j++)
+        z += (LONG)(DrawSim(profile, operation, 2 + j) >> 16);
+    // The shifts of the signed exponent floor it, leaving a positive fraction.
+    const LONGLONG exponent = (LONGLONG)profile->sigmaLog2e * z >> 16;
+    LONG whole = (LONG)(exponent >> 16);
+    const DWORD fraction = (DWORD)exponent & 0xFFFF;
+    DWORD power = 630;
+    power = 3638 + (DWORD)((UINT64)power * fraction >> 16);
+    power = 15743 + (DWORD)((UINT64)power * fraction >> 16);
+    power = 45426 + (DWORD)((UINT64)power * fraction >> 16);
+    power = 65536 + (DWORD)((UINT64)power * fraction >> 16);
+    UINT64 delay = (UINT64)profile->medianNs * power >> 16;
+    for (; whole < 0 && delay; whole++)
+        delay >>= 1;
+    for (; whole > 0 && delay < RY2_SIM_MAX_DELAY_NS; whole--)
+        delay <<= 1;
+    return delay < RY2_SIM_MAX_DELAY_NS ? delay : RY2_SIM_MAX_DELAY_NS;
+}
+
+static void SleepSimNs(UINT64 delay)
+{
+#ifdef _WIN32
+    // Sleep has millisecond granularity at best; the rest is spun.
+    LARGE_INTEGER now, until;
+    QueryPerformanceCounter(&now);
+    until.QuadPart = now.QuadPart + (LONGLONG)ScaleByFixedRatio(delay, SimTicksPerNs);
+    // delay >> 20 undercounts the milliseconds by 5%, which the spin makes up.
+    if (delay >= 2000000)
+        Sleep((DWORD)(delay >> 20) - 1);
+    do
+    {
+        YieldProcessor();
+        QueryPerformanceCounter(&now);
+    } while (now.QuadPart < until.QuadPart);
+#else
+    struct timespec remaining = { (time_t)(delay / 1000000000), (long)(delay % 1000000000) };
+    while (nanosleep(&remaining, &remaining) != 0)
+    {
+    }
+#endif
+}
+
+/*
+ * Delays the calling thread as the profile says and tells whether the
+ * operation should fail. A stall window is taken from the system clock, so
+ * it hits every process at once, like a storage device that stops.
+ */
+static BOOL SimulateOperation(RY2_SimProfile* profile)
+{
+    const LONG operation = InterlockedIncrement(&profile->draws);
+    UINT64 delay = profile->fixedNs;
+    if (profile->uniformMaxNs)
+        delay += profile->uniformMinNs + ((UINT64)(profile->uniformMaxNs - profile->uniformMinNs) * DrawSim(profile, operation, 1) >> 32);
+    if (profile->medianNs)
+        delay += DrawLognormalNs(profile, operation);
+    if (profile->stallMs)
+    {
+        const DWORD phase = GetTickCount() % profile->stallPeriodMs;
+        if (phase < profile->stallMs)
+            delay += (UINT64)(profile->stallMs - phase) * 1000000;
+    }
+    if (delay)
+        SleepSimNs(delay);
+    return !profile->failPerMillion || (UINT64)DrawSim(profile, operation, 0) * 1000000 >> 32 >= profile->failPerMillion;
+}
+
+/*
+ * The first process formats the segment with ROCKEY2_SIM_DONGLES dongles
+ * (default 1, at most the dongle limit), each as RY2_GenUID leaves it with
+ * made-up identifiers. The set keeps its size while any process maps it.
+ */
+static void FormatSimImage(RY2_FileImage* image, DWORD count)
+{
+    for (DWORD i = 0; i < count; i++)
+    {
+        RY2_FileDongle* dongle = &image->dongles[i];
+        dongle->info[0] = 0x53000000 + i; // HID
+        dongle->info[1] = 0x55000000 + i; // UID
+        dongle->info[2] = 1; // Version
+        memset(dongle->blocks, 0xFF, sizeof dongle->blocks);
+        dongle->present = RY2_FILE_INFO_PRESENT | RY2_ALL_BLOCKS;
+    }
+    image->capacity = count;
+    image->count = count;
+    MemoryBarrier();
+    image->version = RY2_FILE_VERSION;
+}
+
+static BOOL LoadSimImage(void)
+{
+    if (SimImage)
+        return TRUE;
+    DWORD count = GetNumericSetting("ROCKEY2_SIM_DONGLES", 1);
+    if (count > (DWORD)GetDongleLimit())
+        count = (DWORD)GetDongleLimit();
+    const DWORD imageSize = (DWORD)RY2_FILE_IMAGE_SIZE(count);
+    RY2_FileImage* image = (RY2_FileImage*)OpenSharedMemory("ROCKEY2_SIM", imageSize, &SimMapping);
+    if (!image)
+        return FALSE;
+    if (InterlockedCompareExchange((volatile LONG*)&image->magic, RY2_FILE_MAGIC, 0) == 0)
+        FormatSimImage(image, count);
+    else
+    {
+        for (int i = 0; i < 1000 && !image->version; i++)
+            Sleep(0);
+    }
+    if (image->magic != RY2_FILE_MAGIC || image->version != RY2_FILE_VERSION)
+    {
+        CloseSharedMemory(image, imageSize, SimMapping);
+        SimMapping = NULL;
+        return FALSE;
+    }
+    // Another process may have formatted a smaller set.
+    SimCapacity = image->count < count ? image->count : count;
+    SimSeed = GetNumericSetting("ROCKEY2_SIM_SEED", 1);
+    LoadSimProfile("ROCKEY2_SIM_READ", &SimReads, 1);
+    LoadSimProfile("ROCKEY2_SIM_WRITE", &SimWrites, 2);
+#ifdef _WIN32
+    LARGE_INTEGER frequency;
+    if (QueryPerformanceFrequency(&frequency))
+        SimTicksPerNs = GetFixedRatio((UINT64)frequency.QuadPart, 1000000000);
+#endif
+    SimImageSize = imageSize;
+    SimImage = image;
+    return TRUE;
+}
+
+static int ReadSimDongleCount(void)
+{
+    return LoadSimImage() ? (int)SimCapacity : 0;
+}
+
+// Only the first call reports a change; the set never changes afterwards.
+static BOOL HasSimDonglesChanged(void)
+{
+    const BOOL changed = !SimWatched;
+    SimWatched = TRUE;
+    return changed;
+}
+
+static RY2_Store OpenSimDongle(int handle)
+{
+    if (!LoadSimImage() || handle < 0 || (DWORD)handle >= SimCapacity)
+        return NULL;
+    return (RY2_Store)&SimImage->dongles[handle];
+}
+
+static void CloseSimDongle(RY2_Store store)
+{
+    (void)store;
+}
+
+static DWORD ReadSimBlocks(RY2_Store store, DWORD block_mask, char* const buffers[RY2_BLOCK_COUNT])
+{
+    const RY2_FileDongle* dongle = (const RY2_FileDongle*)store;
+    if (!SimulateOperation(&SimReads))
+        return 0;
+    const DWORD readMask = block_mask & dongle->present & RY2_ALL_BLOCKS;
+    for (int i = 0; i < RY2_BLOCK_COUNT; i++)
+    {
+        if (readMask & RY2_BLOCK_MASK(i))
+            memcpy(buffers[i], dongle->blocks[i], RY2_BLOCK_SIZE);
+    }
+    return readMask;
+}
+
+static BOOL WriteSimBlocks(RY2_Store store, DWORD block_mask, const char* const buffers[RY2_BLOCK_COUNT])
+{
+    RY2_FileDongle* dongle = (RY2_FileDongle*)store;
+    if (!SimulateOperation(&SimWrites))
+        return FALSE;
+    for (int i = 0; i < RY2_BLOCK_COUNT; i++)
+    {
+        if (block_mask & RY2_BLOCK_MASK(i))
+            memcpy(dongle->blocks[i], buffers[i], RY2_BLOCK_SIZE);
+    }
+    InterlockedOr((volatile LONG*)&dongle->present, block_mask & RY2_ALL_BLOCKS);
+    return TRUE;
+}
+
+static BOOL ReadSimBlock(RY2_Store store, int block_index, char* buffer512)
+{
+    char* buffers[RY2_BLOCK_COUNT] = { NULL };
+    buffers[block_index] = buffer512;
+    return ReadSimBlocks(store, RY2_BLOCK_MASK(block_index), buffers) != 0;
+}
+
+static BOOL WriteSimBlock(RY2_Store store, int block_index, const char* buffer512)
+{
+    const char* buffers[RY2_BLOCK_COUNT] = { NULL };
+    buffers[block_index] = buffer512;
+    return WriteSimBlocks(store, RY2_BLOCK_MASK(block_index), buffers);
+}
+
+/*
+ * A failed read still returns the stored values: the core then rewrites them
+ * as its self-healing defaults, which costs a write but keeps the identity.
+ */
+static BOOL ReadSimInfo(RY2_Store store, DWORD* const info[RY2_INFO_COUNT])
+{
+    const RY2_FileDongle* dongle = (const RY2_FileDongle*)store;
+    const BOOL success = SimulateOperation(&SimReads) && (dongle->present & RY2_FILE_INFO_PRESENT) == RY2_FILE_INFO_PRESENT;
+    for (int i = 0; i < RY2_INFO_COUNT; i++)
+        *info[i] = (dongle->present & (1u << (8 + i))) ? dongle->info[i] : 0;
+    return success;
+}
+
+static BOOL WriteSimInfo(RY2_Store store, const DWORD* const info[RY2_INFO_COUNT])
+{
+    RY2_FileDongle* dongle = (RY2_FileDongle*)store;
+    if (!SimulateOperation(&SimWrites))
+        return FALSE;
+    for (int i = 0; i < RY2_INFO_COUNT; i++)
+        dongle->info[i] = *info[i];
+    InterlockedOr((volatile LONG*)&dongle->present, RY2_FILE_INFO_PRESENT);
+    return TRUE;
+}
+
+static void ShutdownSimStorage(void)
+{
+    if (!SimImage)
+        return;
+    CloseSharedMemory(SimImage, SimImageSize, SimMapping);
+    SimImage = NULL;
+    SimMapping = NULL;
+    SimCapacity = 0;
+    SimWatched = FALSE;
+}
+
+const RY2_StorageBackend SimStorage =
+{
+    "sim",
+    ReadSimDongleCount,
+    HasSimDonglesChanged,
+    OpenSimDongle,
+    CloseSimDongle,
+    ReadSimBlock,
+    WriteSimBlock,
+    ReadSimBlocks,
+    WriteSimBlocks,
+    ReadSimInfo,
+    WriteSimInfo,
+    NULL,
+    NULL,
+    NULL,
+    ShutdownSimStorage,
+    NULL
+};
@@ -0,0 +1,294 @@
+/*
+ * This file is part of the Rockey2 EMU project authored by Brian218.
+ *
+ * Copyright (C) 2026 Brian218 (https://github.com/brian218)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#include "platform.h"
+#include "storage.h"
+#include "flusher.h"
+#include "stats.h"
+#include "trace.h"
+
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+BOOL Tracing = FALSE;
+
+#ifndef RY2_NO_STATS
+
+#define RY2_TRACE_STRIPES 16
+#define RY2_TRACE_SLOTS 16384 // Per stripe, a power of two
+#define RY2_TRACE_CHUNK 256 // Records written to the file at once
+
+#ifdef _WIN32
+typedef HANDLE RY2_TraceFile;
+#define RY2_NO_TRACE_FILE INVALID_HANDLE_VALUE
+#else
+typedef int RY2_TraceFile;
+#define RY2_NO_TRACE_FILE -1
+#endif
+
+/*
+ * A bounded multi-producer ring: a slot is free for position p while its
+ * sequence is p, and holds the record of p once its sequence is p + 1. The
+ * producers claim positions by advancing head; only the flusher (or the
+ * unloading library) advances tail, inside the flush section.
+ */
+typedef struct
+{
+    volatile LONG sequence;
+    RY2_TraceRecord record;
+} RY2_TraceSlot;
+
+typedef struct
+{
+    volatile LONG head;
+    LONG tail;
+    RY2_TraceSlot slots[RY2_TRACE_SLOTS];
+} RY2_TraceStripe;
+
+static RY2_TraceStripe* TraceStripes = NULL;
+static RY2_TraceRecord* TraceChunk = NULL; // Allocated after the stripes; used only by DrainTrace
+static RY2_TraceFile TraceFile = RY2_NO_TRACE_FILE;
+static char TracePrefix[260 + 1] = { 0 }; // MAX_PATH + '\0'
+static volatile LONG TraceDropped = 0;
+
+#ifdef _WIN32
+static RY2_TraceFile CreateTraceFile(const char* path)
+{
+    return CreateFile(path, GENERIC_WRITE, FILE_SHARE_READ, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+}
+
+static void CloseTraceFile(RY2_TraceFile file)
+{
+    CloseHandle(file);
+}
+
+static void WriteTraceFile(RY2_TraceFile file, const void* data, DWORD size)
+{
+    DWORD bytesWritten = 0;
+    WriteFile(file, data, size, &bytesWritten, NULL);
+}
+
+static void RewriteTraceHeader(RY2_TraceFile file, const RY2_TraceHeader* header)
+{
+    OVERLAPPED position = { 0 };
+    DWORD bytesWritten = 0;
+    WriteFile(file, header, sizeof *header, &bytesWritten, &position);
+}
+
+#define GetTraceThreadId() GetCurrentThreadId()
+#else
+static RY2_TraceFile CreateTraceFile(const char* path)
+{
+    return open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+}
+
+static void CloseTraceFile(RY2_TraceFile file)
+{
+    close(file);
+}
+
+static void WriteTraceFile(RY2_TraceFile file, const void* data, DWORD size)
+{
+    if (write(file, data, size) != (ssize_t)size)
+        return;
+}
+
+static void RewriteTraceHeader(RY2_TraceFile file, const RY2_TraceHeader* header)
+{
+    if (pwrite(file, header, sizeof *header, 0) != (ssize_t)sizeof *header)
+        return;
+}
+
+// Thread IDs cost a system call here, so every thread fetches its own once.
+static __thread DWORD TraceThreadId = 0;
+
+static DWORD GetTraceThreadId(void)
+{
+    if (!TraceThreadId)
+    {
+#ifdef __linux__
+        TraceThreadId = (DWORD)syscall(SYS_gettid);
+#else
+        TraceThreadId = (DWORD)(SIZE_T)pthread_self();
+#endif
+    }
+    return TraceThreadId;
+}
+#endif
+
+static void ResetTraceStripes(void)
+{
+    for (int s = 0; s < RY2_TRACE_STRIPES; s++)
+    {
+        RY2_TraceStripe* stripe = &TraceStripes[s];
+        stripe->head = 0;
+        stripe->tail = 0;
+        for (int i = 0; i < RY2_TRACE_SLOTS; i++)
+            stripe->slots[i].sequence = i;
+    }
+}
+
+// Creates the trace file of the current process, <prefix>.<process ID>.
+static BOOL OpenTrace(void)
+{
+    char path[260 + 1 + 10 + 1] = { 0 }; // MAX_PATH + '.' + 4294967295 + '\0'
+    const DWORD processId = GetCurrentProcessId();
+    _snprintf(path, sizeof path - 1, "%s.%u", TracePrefix, (unsigned)processId);
+    TraceFile = CreateTraceFile(path);
+    if (TraceFile == RY2_NO_TRACE_FILE)
+        return FALSE;
+    const RY2_TraceHeader header = { RY2_TRACE_MAGIC, RY2_TRACE_VERSION, processId, 0 };
+    WriteTraceFile(TraceFile, &header, sizeof header);
+    return TRUE;
+}
+
+#ifndef _WIN32
+// A forked child starts a trace of its own; the parent writes what it queued.
+static void ResetTraceAfterFork(void)
+{
+    TraceThreadId = 0;
+    if (!Tracing)
+        return;
+    CloseTraceFile(TraceFile);
+    TraceDropped = 0;
+    ResetTraceStripes();
+    Tracing = OpenTrace();
+}
+#endif
+
+void InitTrace(HANDLE heap)
+{
+    if (!GetStorageSetting("ROCKEY2_TRACE", TracePrefix, sizeof TracePrefix) || !TracePrefix[0])
+        return;
+    TraceStripes = (RY2_TraceStripe*)HeapAlloc(heap, 0, RY2_TRACE_STRIPES * sizeof(RY2_TraceStripe) + RY2_TRACE_CHUNK * sizeof(RY2_TraceRecord));
+    if (!TraceStripes)
+        return;
+    TraceChunk = (RY2_TraceRecord*)(TraceStripes + RY2_TRACE_STRIPES);
+    ResetTraceStripes();
+    if (!OpenTrace())
+    {
+        HeapFree(heap, 0, TraceStripes);
+        TraceStripes = NULL;
+        TraceChunk = NULL;
+        return;
+    }
+#ifndef _WIN32
+    pthread_atfork(NULL, NULL, ResetTraceAfterFork);
+#endif
+    Tracing = TRUE;
+}
+
+// Appends the queued records to the file; called inside the flush section.
+void DrainTrace(void)
+{
+    if (!TraceStripes || TraceFile == RY2_NO_TRACE_FILE)
+        return;
+    RY2_TraceRecord* chunk = TraceChunk;
+    DWORD count = 0;
+    for (int s = 0; s < RY2_TRACE_STRIPES; s++)
+    {
+        RY2_TraceStripe* stripe = &TraceStripes[s];
+        for (;;)
+        {
+            RY2_TraceSlot* slot = &stripe->slots[stripe->tail & (RY2_TRACE_SLOTS - 1)];
+            if (slot->sequence != stripe->tail + 1)
+                break;
+            MemoryBarrier();
+            chunk[count++] = slot->record;
+            MemoryBarrier();
+            slot->sequence = stripe->tail + RY2_TRACE_SLOTS;
+            stripe->tail++;
+            if (count == RY2_TRACE_CHUNK)
+            {
+                WriteTraceFile(TraceFile, chunk, count * sizeof chunk[0]);
+                count = 0;
+            }
+        }
+    }
+    if (count)
+        WriteTraceFile(TraceFile, chunk, count * sizeof chunk[0]);
+}
+
+// Called with the flusher stopped: writes what is left and the final header.
+void ShutdownTrace(HANDLE heap)
+{
+    if (!Tracing)
+        return;
+    Tracing = FALSE;
+    DrainTrace();
+    const RY2_TraceHeader header = { RY2_TRACE_MAGIC, RY2_TRACE_VERSION, GetCurrentProcessId(), (DWORD)TraceDropped };
+    RewriteTraceHeader(TraceFile, &header);
+    CloseTraceFile(TraceFile);
+    TraceFile = RY2_NO_TRACE_FILE;
+    HeapFree(heap, 0, TraceStripes);
+    TraceStripes = NULL;
+    TraceChunk = NULL;
+}
+
+// The stripe of the calling thread, chosen like the statistics stripes.
+static RY2_TraceStripe* GetTraceStripe(void)
+{
+    const BYTE stackMarker = 0;
+    const SIZE_T stripe = (((SIZE_T)&stackMarker >> 16) * 0x9E3779B1) >> 8;
+    return &TraceStripes[stripe % RY2_TRACE_STRIPES];
+}
+
+void RecordTrace(RY2_StatExport export_index, UINT64 started, int handle, DWORD argument0, DWORD argument1, DWORD argument2, int result)
+{
+    const UINT64 elapsed = GetStatsTime() - started;
+    RY2_TraceStripe* stripe = GetTraceStripe();
+    RY2_TraceSlot* slot;
+    LONG position;
+    for (;;)
+    {
+        position = stripe->head;
+        slot = &stripe->slots[position & (RY2_TRACE_SLOTS - 1)];
+        const LONG lag = (LONG)((DWORD)slot->sequence - (DWORD)position);
+        if (lag == 0 && InterlockedCompareExchange(&stripe->head, position + 1, position) == position)
+            break;
+        if (lag < 0)
+        {
+            // The flusher has fallen a whole ring behind; the caller never waits for it.
+            InterlockedIncrement(&TraceDropped);
+            return;
+        }
+    }
+    RY2_TraceRecord* record = &slot->record;
+    record->timestamp = started;
+    record->duration = elapsed > 0xFFFFFFFF ? 0xFFFFFFFF : (DWORD)elapsed;
+    record->threadId = GetTraceThreadId();
+    record->exportIndex = (DWORD)export_index;
+    record->handle = handle;
+    record->arguments[0] = argument0;
+    record->arguments[1] = argument1;
+    record->arguments[2] = argument2;
+    record->result = result;
+    MemoryBarrier();
+    slot->sequence = position + 1;
+    // Drain at every quarter ring, well before the producers catch up with the flusher.
+    if (!(position & (RY2_TRACE_SLOTS / 4 - 1)))
+        WakeFlusher();
+}
+
+#endif
@@ -0,0 +1,310 @@
+/*
+ * This file is part of the Rockey2 EMU project authored by Brian218.
+ *
+ * Copyright (C) 2026 Brian218 (https://github.com/brian218)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#include "platform.h"
+#include "storage.h"
+#include "crypto.h"
+#include "transform_cache.h"
+#include "stats.h"
+
+#define RY2_TRANSFORM_CACHE_DEFAULT_SLOTS 0
+#define RY2_TRANSFORM_CACHE_MAX_SLOTS 0x100000
+
+typedef struct
+{
+    volatile LONG sequence;
+    RY2_TransformRecord record;
+} RY2_TransformSlot;
+
+static RY2_TransformSlot* Slots = NULL;
+static DWORD SlotMask = 0;
+
+static DWORD HashBytes(DWORD hash, const BYTE* data, SIZE_T size)
+{
+    for (SIZE_T i = 0; i < size; i++)
+        hash = (hash ^ data[i]) * 0x01000193; // FNV-1a
+    return hash;
+}
+
+static RY2_TransformSlot* FindSlot(DWORD uid, const BYTE* data, int len)
+{
+    DWORD hash = HashBytes(0x811C9DC5, (const BYTE*)&uid, sizeof uid);
+    hash = HashBytes(hash, (const BYTE*)&len, sizeof len);
+    hash = HashBytes(hash, data, len);
+    // FNV-1a mixes poorly into the low bits used as the slot index.
+    hash ^= hash >> 16;
+    hash *= 0x85EBCA6B;
+    hash ^= hash >> 13;
+    return &Slots[hash & SlotMask];
+}
+
+static BOOL ClaimSlot(RY2_TransformSlot* slot, LONG* sequence)
+{
+    *sequence = slot->sequence;
+    return !(*sequence & 1) && InterlockedCompareExchange(&slot->sequence, *sequence + 1, *sequence) == *sequence;
+}
+
+static void ReleaseSlot(RY2_TransformSlot* slot, LONG sequence)
+{
+    MemoryBarrier();
+    InterlockedExchange(&slot->sequence, sequence + 2);
+}
+
+static BOOL LookupTransform(DWORD uid, BYTE* data, int len)
+{
+    const RY2_TransformSlot* slot = FindSlot(uid, data, len);
+    const LONG sequence = slot->sequence;
+    if (sequence & 1)
+        return FALSE;
+    MemoryBarrier();
+    RY2_TransformRecord record;
+    memcpy(&record, &slot->record, sizeof record);
+    MemoryBarrier();
+    if (slot->sequence != sequence || record.uid != uid || record.len != (DWORD)len || memcmp(record.input, data, len) != 0)
+        return FALSE;
+    memcpy(data, record.output, len);
+    return TRUE;
+}
+
+static void InsertTransform(const RY2_TransformRecord* record)
+{
+    RY2_TransformSlot* slot = FindSlot(record->uid, record->input, (int)record->len);
+    LONG sequence;
+    if (!ClaimSlot(slot, &sequence))
+        return;
+    MemoryBarrier();
+    memcpy(&slot->record, record, sizeof *record);
+    ReleaseSlot(slot, sequence);
+}
+
+static DWORD ChecksumRecords(const RY2_TransformRecord* records, DWORD count)
+{
+    return HashBytes(0x811C9DC5, (const BYTE*)records, count * sizeof(RY2_TransformRecord));
+}
+
+static BOOL IsValidRecord(const RY2_TransformRecord* record)
+{
+    return record->len > 0 && record->len <= RY2_TRANSFORM_DATA_SIZE;
+}
+
+#ifdef _WIN32
+static BOOL ReadCacheFile(HANDLE file, void* buffer, DWORD size)
+{
+    DWORD bytesRead = 0;
+    return ReadFile(file, buffer, size, &bytesRead, NULL) && bytesRead == size;
+}
+
+static BOOL WriteCacheFile(HANDLE file, const void* buffer, DWORD size)
+{
+    DWORD bytesWritten = 0;
+    return WriteFile(file, buffer, size, &bytesWritten, NULL) && bytesWritten == size;
+}
+#else
+static BOOL ReadCacheFile(int fd, void* buffer, DWORD size)
+{
+    return read(fd, buffer, size) == (ssize_t)size;
+}
+
+static BOOL WriteCacheFile(int fd, const void* buffer, DWORD size)
+{
+    return write(fd, buffer, size) == (ssize_t)size;
+}
+#endif
+
+static void LoadCacheFile(HANDLE heap, const char* path)
+{
+#ifdef _WIN32
+    HANDLE file = CreateFile(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+        return;
+#else
+    const int file = open(path, O_RDONLY);
+    if (file < 0)
+        return;
+#endif
+    RY2_TransformFileHeader header;
+    if (ReadCacheFile(file, &header, sizeof header) && header.magic == RY2_TRANSFORM_CACHE_MAGIC && header.version == RY2_TRANSFORM_CACHE_VERSION &&
+        header.count > 0 && header.count <= RY2_TRANSFORM_CACHE_MAX_SLOTS)
+    {
+        RY2_TransformRecord* records = (RY2_TransformRecord*)HeapAlloc(heap, 0, header.count * sizeof(RY2_TransformRecord));
+        if (records)
+        {
+            if (ReadCacheFile(file, records, header.count * sizeof(RY2_TransformRecord)) && ChecksumRecords(records, header.count) == header.reserved)
+            {
+                for (DWORD i = 0; i < header.count; i++)
+                {
+                    if (IsValidRecord(&records[i]))
+                        InsertTransform(&records[i]);
+                }
+            }
+            HeapFree(heap, 0, records);
+        }
+    }
+#ifdef _WIN32
+    CloseHandle(file);
+#else
+    close(file);
+#endif
+}
+
+static void SaveCacheFile(HANDLE heap, const char* path)
+{
+    RY2_TransformRecord* records = (RY2_TransformRecord*)HeapAlloc(heap, 0, (SlotMask + 1) * sizeof(RY2_TransformRecord));
+    if (!records)
+        return;
+    RY2_TransformFileHeader header = { RY2_TRANSFORM_CACHE_MAGIC, RY2_TRANSFORM_CACHE_VERSION, 0, 0 };
+    for (DWORD i = 0; i <= SlotMask; i++)
+    {
+        if (IsValidRecord(&Slots[i].record))
+            records[header.count++] = Slots[i].record;
+    }
+    header.reserved = ChecksumRecords(records, header.count);
+#ifdef _WIN32
+    HANDLE file = CreateFile(path, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file != INVALID_HANDLE_VALUE)
+    {
+        if (WriteCacheFile(file, &header, sizeof header))
+            WriteCacheFile(file, records, header.count * sizeof(RY2_TransformRecord));
+        CloseHandle(file);
+    }
+#else
+    const int file = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (file >= 0)
+    {
+        if (WriteCacheFile(file, &header, sizeof header))
+            WriteCacheFile(file, records, header.count * sizeof(RY2_TransformRecord));
+        close(file);
+    }
+#endif
+    HeapFree(heap, 0, records);
+}
+
+void InitTransformCache(HANDLE heap)
+{
+    DWORD slotCount = GetNumericSetting("ROCKEY2_TRANSFORM_CACHE", RY2_TRANSFORM_CACHE_DEFAULT_SLOTS);
+    if (slotCount > RY2_TRANSFORM_CACHE_MAX_SLOTS)
+        slotCount = RY2_TRANSFORM_CACHE_MAX_SLOTS;
+    while (slotCount & (slotCount - 1))
+        slotCount &= slotCount - 1;
+    if (slotCount == 0)
+        return;
+    Slots = (RY2_TransformSlot*)HeapAlloc(heap, HEAP_ZERO_MEMORY, slotCount * sizeof(RY2_TransformSlot));
+    if (!Slots)
+        return;
+    SlotMask = slotCount - 1;
+    char filePath[260 + 1] = { 0 }; // MAX_PATH + '\0'
+    if (GetStorageSetting("ROCKEY2_TRANSFORM_CACHE_FILE", filePath, sizeof filePath))
+        LoadCacheFile(heap, filePath);
+}
+
+void ShutdownTransformCache(HANDLE heap)
+{
+    if (!Slots)
+        return;
+    char filePath[260 + 1] = { 0 }; // MAX_PATH + '\0'
+    if (GetStorageSetting("ROCKEY2_TRANSFORM_CACHE_FILE", filePath, sizeof filePath))
+        SaveCacheFile(heap, filePath);
+    HeapFree(heap, 0, Slots);
+    Slots = NULL;
+    SlotMask = 0;
+}
+
+int CachedTransform(DWORD uid, BYTE* data, int len)
+{
+    if (!Slots || len <= 0 || len > RY2_TRANSFORM_DATA_SIZE)
+        return Transform(uid, data, len);
+    if (LookupTransform(uid, data, len))
+    {
+        AddStat(RY2_STAT_TRANSFORM_CACHE_HITS, 1);
+        return 0;
+    }
+    AddStat(RY2_STAT_TRANSFORM_CACHE_MISSES, 1);
+    RY2_TransformRecord record = { uid, (DWORD)len, { 0 }, { 0 } };
+    memcpy(record.input, data, len);
+    const int ret = Transform(uid, data, len);
+    if (ret == 0)
+    {
+        memcpy(record.output, data, len);
+        InsertTransform(&record);
+    }
+    return ret;
+}
+
+void FlushTransformCache(DWORD uid)
+{
+    if (!Slots)
+        return;
+    for (DWORD i = 0; i <= SlotMask; i++)
+    {
+        LONG sequence;
+        if (Slots[i].record.uid != uid || !ClaimSlot(&Slots[i], &sequence))
+            continue;
+        if (Slots[i].record.uid == uid)
+            Slots[i].record.len = 0;
+        ReleaseSlot(&Slots[i], sequence);
+    }
+}
+
+int CachedTransformBatch(DWORD uid, int count, const int* lens, BYTE* const* datas, int* results)
+{
+    if (!Slots)
+        return TransformBatch(uid, count, lens, datas, results);
+    int ret = 0;
+    for (int base = 0; base < count; base += MD5_BATCH_SIZE)
+    {
+        const int n = count - base < MD5_BATCH_SIZE ? count - base : MD5_BATCH_SIZE;
+        RY2_TransformRecord records[MD5_BATCH_SIZE];
+        int missLens[MD5_BATCH_SIZE];
+        BYTE* missDatas[MD5_BATCH_SIZE];
+        int missCount = 0;
+        for (int k = base; k < base + n; k++)
+        {
+            const int len = lens[k];
+            const int result = (len <= 0 || len > RY2_TRANSFORM_DATA_SIZE) ? Transform(uid, datas[k], len) : 0;
+            if (results)
+                results[k] = result;
+            if (result)
+            {
+                if (!ret)
+                    ret = result;
+                continue;
+            }
+            if (LookupTransform(uid, datas[k], len))
+            {
+                AddStat(RY2_STAT_TRANSFORM_CACHE_HITS, 1);
+                continue;
+            }
+            records[missCount].uid = uid;
+            records[missCount].len = (DWORD)len;
+            memcpy(records[missCount].input, datas[k], len);
+            missLens[missCount] = len;
+            missDatas[missCount] = datas[k];
+            missCount++;
+        }
+        AddStat(RY2_STAT_TRANSFORM_CACHE_MISSES, missCount);
+        TransformBatch(uid, missCount, missLens, missDatas, NULL);
+        for (int k = 0; k < missCount; k++)
+        {
+            memcpy(records[k].output, missDatas[k], missLens[k]);
+            InsertTransform(&records[k]);
+        }
+    }
+    return ret;
+}
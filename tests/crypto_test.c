@@ -0,0 +1,159 @@
+/*
+ * This file is part of the Rockey2 EMU project authored by Brian218.
+ *
+ * Copyright (C) 2026 Brian218 (https://github.com/brian218)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/*
+ * Known-answer tests of the crypto kernels, run by make test: fixed vectors
+ * for each entry point, then the specialized and batch paths against the
+ * generic kernel over a spread of keys and messages. crypto.c is included
+ * directly so that its internal kernels can be checked too.
+ */
+
+#include <stdio.h>
+#include "../Rockey2/crypto.c"
+
+static int Failures = 0;
+
+static void Check(const char* name, int passed)
+{
+    printf("%-36s %s\n", name, passed ? "ok" : "FAILED");
+    if (!passed)
+        Failures++;
+}
+
+/*
+ * The HMAC passes through the generic kernel with explicit padding, as
+ * computed before the specialized kernels existed.
+ */
+static void GenericHMAC55(uint32_t* state_ipad, uint32_t* state_opad, const uint8_t* message)
+{
+    uint32_t inner[16] = { 0 };
+    uint32_t outer[16] = { 0 };
+    memcpy(inner, message, 55);
+    MD5_Pad_HMAC((uint8_t*)inner, 55);
+    MD5_Transform(state_ipad, inner);
+    memcpy(outer, state_ipad, 16);
+    MD5_Pad_HMAC((uint8_t*)outer, 16);
+    MD5_Transform(state_opad, outer);
+}
+
+static void TestVectors(void)
+{
+    static const struct
+    {
+        const char* seed;
+        uint32_t uid;
+    } uidVectors[] =
+    {
+        { "", 0xD465B752 },
+        { "seed", 0x822D5FD7 },
+        { "Rockey2", 0xEA12BBA9 },
+        { "0123456789012345678901234567890123456789012345678901234567890123", 0x60EAFEEB }
+    };
+    static const uint8_t transform32[32] =
+    {
+        0x2F, 0x4B, 0xD2, 0x19, 0xF1, 0x91, 0xC2, 0x96, 0xD4, 0xEC, 0x9F, 0x14, 0x79, 0x85, 0x00, 0xD2,
+        0x7D, 0x08, 0xA6, 0x47, 0x4F, 0xF4, 0x87, 0x91, 0xD3, 0xFD, 0x7C, 0x83, 0x64, 0x0C, 0x6D, 0x2A
+    };
+    static const uint8_t transform5[5] = { 0x82, 0x70, 0x73, 0x5A, 0xBA };
+    static const uint8_t factory[16] =
+    {
+        0xA7, 0x17, 0x64, 0xC0, 0xF8, 0x69, 0x09, 0xEF, 0xEE, 0xC4, 0x69, 0x48, 0xF3, 0x70, 0x96, 0xFA
+    };
+
+    int passed = 1;
+    for (int i = 0; i < (int)(sizeof uidVectors / sizeof uidVectors[0]); i++)
+        passed &= GenUID(uidVectors[i].seed) == uidVectors[i].uid;
+    Check("GenUID vectors", passed);
+
+    const char* seeds[sizeof uidVectors / sizeof uidVectors[0]];
+    uint32_t uids[sizeof uidVectors / sizeof uidVectors[0]];
+    for (int i = 0; i < (int)(sizeof uidVectors / sizeof uidVectors[0]); i++)
+        seeds[i] = uidVectors[i].seed;
+    GenUIDBatch((int)(sizeof uidVectors / sizeof uidVectors[0]), seeds, uids);
+    passed = 1;
+    for (int i = 0; i < (int)(sizeof uidVectors / sizeof uidVectors[0]); i++)
+        passed &= uids[i] == uidVectors[i].uid;
+    Check("GenUIDBatch vectors", passed);
+
+    uint8_t data[55];
+    for (int i = 0; i < 32; i++)
+        data[i] = (uint8_t)i;
+    Check("Transform 32-byte vector", Transform(0x822D5FD7, data, 32) == 0 && memcmp(data, transform32, 32) == 0);
+    for (int i = 0; i < 5; i++)
+        data[i] = (uint8_t)(0xA5 ^ (i * 7));
+    Check("Transform 5-byte vector", Transform(0, data, 5) == 0 && memcmp(data, transform5, 5) == 0);
+    uint8_t response[16];
+    for (int i = 0; i < 55; i++)
+        data[i] = (uint8_t)(i * 3 + 1);
+    Transform_Factory(data, response);
+    Check("Transform_Factory vector", memcmp(response, factory, 16) == 0);
+}
+
+static void TestKernelsAgree(void)
+{
+    uint32_t x = 0x9E3779B9;
+    uint8_t data[55];
+    uint8_t messages[MD5_BATCH_SIZE][32];
+    uint8_t* batch[MD5_BATCH_SIZE];
+    int lens[MD5_BATCH_SIZE];
+    int hmacPassed = 1;
+    int batchPassed = 1;
+    for (int round = 0; round < 64; round++)
+    {
+        uint32_t key[8];
+        for (int j = 0; j < 8; j++)
+            key[j] = x = x * 1664525 + 1013904223;
+        for (int i = 0; i < 55; i++)
+            data[i] = (uint8_t)((x = x * 1664525 + 1013904223) >> 24);
+        uint32_t fast[8];
+        uint32_t slow[8];
+        memcpy(fast, key, sizeof key);
+        memcpy(slow, key, sizeof key);
+        MD5_HMAC55(fast, fast + 4, data);
+        GenericHMAC55(slow, slow + 4, data);
+        hmacPassed &= memcmp(fast, slow, sizeof fast) == 0;
+
+        for (int k = 0; k < MD5_BATCH_SIZE; k++)
+        {
+            lens[k] = 1 + (k + round) % 32;
+            memcpy(messages[k], data + k % 23, 32);
+            batch[k] = messages[k];
+        }
+        batchPassed &= TransformBatch(key[0], MD5_BATCH_SIZE, lens, batch, NULL) == 0;
+        for (int k = 0; k < MD5_BATCH_SIZE; k++)
+        {
+            uint8_t single[32];
+            memcpy(single, data + k % 23, 32);
+            Transform(key[0], single, lens[k]);
+            batchPassed &= memcmp(single, messages[k], lens[k]) == 0;
+        }
+    }
+    Check("MD5_HMAC55 against generic kernel", hmacPassed);
+    Check("TransformBatch against Transform", batchPassed);
+}
+
+int main(void)
+{
+    printf("MD5 lanes: %d\n", MD5_LaneCount());
+    TestVectors();
+    TestKernelsAgree();
+    printf("%s\n", Failures ? "FAILED" : "all passed");
+    return Failures ? 1 : 0;
+}
@@ -0,0 +1,628 @@
+/*
+ * This file is part of the Rockey2 EMU project authored by Brian218.
+ *
+ * Copyright (C) 2026 Brian218 (https://github.com/brian218)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/*
+ * Benchmarks the RY2_* exports and the crypto kernels of libRockey2.so:
+ *
+ *     ry2bench [-t threads] [-p processes] [-d dongles] [-w percent]
+ *              [-s seconds] [-f image] [-l library] [-j] [benchmark...]
+ *
+ * -t and -p take comma-separated lists and every combination is run. Each
+ * run forks its worker processes, which load the library only after the
+ * benchmark has written a fresh image of the requested number of dongles
+ * and pointed the file backend at it; other ROCKEY2_* settings are passed
+ * through, so their effect can be measured. Every operation is timed on its
+ * own into a log-linear histogram in memory shared by all workers, from
+ * which the percentiles are taken. POSIX only (fork and dlopen).
+ */
+
+#include <dlfcn.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include "platform.h"
+#include "storage.h"
+
+#define BENCH_MAX_LIST 16
+#define BENCH_MAX_WORKERS 256
+#define BENCH_SUB_BUCKETS 16 // Histogram buckets per power of two: under 7% error
+#define BENCH_BUCKETS (64 * BENCH_SUB_BUCKETS)
+#define BENCH_HID_BASE 0x42000000
+#define BENCH_UID_BASE 0x55000000
+
+typedef int (*RY2_FindFunc)(void);
+typedef int (*RY2_OpenFunc)(int mode, DWORD uid, DWORD* hid);
+typedef int (*RY2_GenUIDFunc)(int handle, DWORD* uid, char* seed, int isProtect);
+typedef int (*RY2_BlockFunc)(int handle, int block_index, char* buffer512);
+typedef int (*RY2_GetVersionFunc)(int handle);
+typedef int (*RY2_TransformFunc)(int handle, int len, BYTE* data);
+typedef void (*MD5_TransformFunc)(uint32_t* state, const void* buffer);
+typedef uint32_t (*GenUIDFunc)(const char* seed);
+typedef int (*TransformFunc)(uint32_t uid, uint8_t* data, int len);
+typedef void (*Transform_FactoryFunc)(const uint8_t* challenge, uint8_t* response);
+
+// The library entry points, resolved in each worker process.
+static struct
+{
+    RY2_FindFunc Find;
+    RY2_OpenFunc Open;
+    RY2_GenUIDFunc GenUID;
+    RY2_BlockFunc Read;
+    RY2_BlockFunc Write;
+    RY2_GetVersionFunc GetVersion;
+    RY2_TransformFunc Transform;
+    MD5_TransformFunc MD5_Transform;
+    GenUIDFunc GenUID_Kernel;
+    TransformFunc Transform_Kernel;
+    Transform_FactoryFunc Transform_Factory;
+} Api;
+
+typedef struct
+{
+    UINT64 ops;
+    UINT64 errors;
+    UINT64 totalNs;
+    UINT64 histogram[BENCH_BUCKETS];
+} WorkerResult;
+
+// Shared by the parent and every worker process of a run.
+typedef struct
+{
+    volatile LONG ready;
+    volatile LONG go;
+    volatile LONG failed;
+    UINT64 deadline;
+    UINT64 start;
+    UINT64 end[BENCH_MAX_WORKERS];
+    WorkerResult results[BENCH_MAX_WORKERS];
+} RunState;
+
+typedef struct Benchmark Benchmark;
+
+typedef struct
+{
+    RunState* run;
+    const Benchmark* benchmark;
+    WorkerResult* result;
+    int index;
+    const int* handles;
+    DWORD random;
+    UINT64 counter;
+    char buffer[RY2_BLOCK_SIZE];
+    BYTE data[64];
+    uint32_t state[4];
+} Worker;
+
+struct Benchmark
+{
+    const char* name;
+    int (*op)(Worker* worker);
+};
+
+static int DongleCount = 4;
+static int WritePercent = 10;
+static double Seconds = 1.0;
+static UINT64 TimerOverhead = 0;
+
+static UINT64 Now(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (UINT64)now.tv_sec * 1000000000 + (UINT64)now.tv_nsec;
+}
+
+static DWORD NextRandom(Worker* worker)
+{
+    DWORD x = worker->random; // xorshift32
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return worker->random = x;
+}
+
+static int RandomHandle(Worker* worker)
+{
+    return worker->handles[NextRandom(worker) % DongleCount];
+}
+
+static int RandomBlock(Worker* worker)
+{
+    return (int)(NextRandom(worker) % RY2_BLOCK_COUNT);
+}
+
+static int OpFind(Worker* worker)
+{
+    (void)worker;
+    return Api.Find() == DongleCount ? 0 : 1;
+}
+
+static int OpOpen(Worker* worker)
+{
+    DWORD hid = BENCH_HID_BASE + NextRandom(worker) % DongleCount;
+    return Api.Open(-1, 0, &hid) < 0;
+}
+
+static int OpGetVersion(Worker* worker)
+{
+    return Api.GetVersion(RandomHandle(worker)) < 0;
+}
+
+static int OpRead(Worker* worker)
+{
+    return Api.Read(RandomHandle(worker), RandomBlock(worker), worker->buffer) != 0;
+}
+
+// Every write changes the block, or the library would skip it.
+static int OpWrite(Worker* worker)
+{
+    const UINT64 stamp = ((UINT64)worker->index << 48) | ++worker->counter;
+    memcpy(worker->buffer, &stamp, sizeof stamp);
+    return Api.Write(RandomHandle(worker), RandomBlock(worker), worker->buffer) != 0;
+}
+
+static int OpMix(Worker* worker)
+{
+    return (int)(NextRandom(worker) % 100) < WritePercent ? OpWrite(worker) : OpRead(worker);
+}
+
+static int OpTransform(Worker* worker)
+{
+    worker->data[0] = (BYTE)++worker->counter;
+    return Api.Transform(RandomHandle(worker), 32, worker->data) != 0;
+}
+
+static int OpGenUID(Worker* worker)
+{
+    char seed[16 + 1] = { 0 }; // "bench" + 10 digits + '\0'
+    _snprintf(seed, sizeof seed - 1, "bench%u", (unsigned)++worker->counter);
+    DWORD uid = 0;
+    return Api.GenUID(RandomHandle(worker), &uid, seed, 0) != 0;
+}
+
+static int OpMD5(Worker* worker)
+{
+    Api.MD5_Transform(worker->state, worker->data);
+    return 0;
+}
+
+static int OpGenUIDKernel(Worker* worker)
+{
+    char seed[16 + 1] = { 0 }; // "bench" + 10 digits + '\0'
+    _snprintf(seed, sizeof seed - 1, "bench%u", (unsigned)++worker->counter);
+    worker->state[0] += Api.GenUID_Kernel(seed);
+    return 0;
+}
+
+static int OpTransformKernel(Worker* worker)
+{
+    worker->data[0] = (BYTE)++worker->counter;
+    return Api.Transform_Kernel(BENCH_UID_BASE, worker->data, 32) != 0;
+}
+
+static int OpFactory(Worker* worker)
+{
+    worker->data[0] = (BYTE)++worker->counter;
+    Api.Transform_Factory(worker->data, (uint8_t*)worker->state);
+    return 0;
+}
+
+// In the order they run when none are named; genuid last, as it erases the blocks.
+static const Benchmark Benchmarks[] =
+{
+    { "md5", OpMD5 },
+    { "genuid-kernel", OpGenUIDKernel },
+    { "transform-kernel", OpTransformKernel },
+    { "factory", OpFactory },
+    { "find", OpFind },
+    { "open", OpOpen },
+    { "getversion", OpGetVersion },
+    { "read", OpRead },
+    { "write", OpWrite },
+    { "mix", OpMix },
+    { "transform", OpTransform },
+    { "genuid", OpGenUID },
+};
+
+#define BENCHMARK_COUNT ((int)(sizeof Benchmarks / sizeof Benchmarks[0]))
+
+static int GetBucket(UINT64 ns)
+{
+    if (ns < BENCH_SUB_BUCKETS)
+        return (int)ns;
+    const int exponent = 63 - __builtin_clzll(ns); // at least 4
+    return (exponent - 3) * BENCH_SUB_BUCKETS + (int)((ns >> (exponent - 4)) & (BENCH_SUB_BUCKETS - 1));
+}
+
+// The middle of a bucket's range.
+static UINT64 GetBucketValue(int bucket)
+{
+    if (bucket < BENCH_SUB_BUCKETS)
+        return (UINT64)bucket;
+    const int exponent = bucket / BENCH_SUB_BUCKETS + 3;
+    const UINT64 low = (UINT64)(BENCH_SUB_BUCKETS + bucket % BENCH_SUB_BUCKETS) << (exponent - 4);
+    return low + ((UINT64)1 << (exponent - 4)) / 2;
+}
+
+// The cheapest back-to-back pair of clock reads, taken off every sample.
+static UINT64 MeasureTimerOverhead(void)
+{
+    UINT64 best = ~(UINT64)0;
+    for (int i = 0; i < 10000; i++)
+    {
+        const UINT64 t0 = Now();
+        const UINT64 t1 = Now();
+        if (t1 - t0 < best)
+            best = t1 - t0;
+    }
+    return best;
+}
+
+static BOOL LoadRockey2(const char* path)
+{
+    void* library = dlopen(path, RTLD_NOW);
+    if (!library)
+    {
+        fprintf(stderr, "ry2bench: %s\n", dlerror());
+        return FALSE;
+    }
+    Api.Find = (RY2_FindFunc)dlsym(library, "RY2_Find");
+    Api.Open = (RY2_OpenFunc)dlsym(library, "RY2_Open");
+    Api.GenUID = (RY2_GenUIDFunc)dlsym(library, "RY2_GenUID");
+    Api.Read = (RY2_BlockFunc)dlsym(library, "RY2_Read");
+    Api.Write = (RY2_BlockFunc)dlsym(library, "RY2_Write");
+    Api.GetVersion = (RY2_GetVersionFunc)dlsym(library, "RY2_GetVersion");
+    Api.Transform = (RY2_TransformFunc)dlsym(library, "RY2_Transform");
+    Api.MD5_Transform = (MD5_TransformFunc)dlsym(library, "MD5_Transform");
+    Api.GenUID_Kernel = (GenUIDFunc)dlsym(library, "GenUID");
+    Api.Transform_Kernel = (TransformFunc)dlsym(library, "Transform");
+    Api.Transform_Factory = (Transform_FactoryFunc)dlsym(library, "Transform_Factory");
+    if (!Api.Find || !Api.Open || !Api.GenUID || !Api.Read || !Api.Write || !Api.GetVersion || !Api.Transform ||
+        !Api.MD5_Transform || !Api.GenUID_Kernel || !Api.Transform_Kernel || !Api.Transform_Factory)
+    {
+        fprintf(stderr, "ry2bench: %s lacks an entry point\n", path);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+static void* RunWorker(void* parameter)
+{
+    Worker* worker = (Worker*)parameter;
+    RunState* run = worker->run;
+    WorkerResult* result = worker->result;
+    InterlockedIncrement(&run->ready);
+    while (!run->go)
+        YieldProcessor();
+    const UINT64 deadline = run->deadline;
+    UINT64 t0 = Now();
+    do
+    {
+        const int error = worker->benchmark->op(worker);
+        const UINT64 t1 = Now();
+        const UINT64 ns = t1 - t0 > TimerOverhead ? t1 - t0 - TimerOverhead : 0;
+        result->ops++;
+        result->errors += error != 0;
+        result->totalNs += ns;
+        result->histogram[GetBucket(ns)]++;
+        t0 = t1;
+    } while (t0 < deadline);
+    run->end[worker->index] = t0;
+    return NULL;
+}
+
+// The body of a worker process: threads workers starting at index first.
+static int RunProcess(RunState* run, const Benchmark* benchmark, const char* library, int first, int threads)
+{
+    int handles[RY2_MAX_DONGLES > 4096 ? 4096 : RY2_MAX_DONGLES];
+    BOOL success = LoadRockey2(library) && Api.Find() == DongleCount;
+    for (int i = 0; success && i < DongleCount; i++)
+    {
+        DWORD hid = BENCH_HID_BASE + i;
+        handles[i] = Api.Open(-1, 0, &hid);
+        success = handles[i] >= 0;
+    }
+    if (!success)
+    {
+        fprintf(stderr, "ry2bench: the library did not find the %d benchmark dongles\n", DongleCount);
+        InterlockedExchange(&run->failed, 1);
+        for (int i = 0; i < threads; i++)
+            InterlockedIncrement(&run->ready);
+        return 1;
+    }
+    Worker* workers = (Worker*)calloc(threads, sizeof(Worker));
+    pthread_t* threadIds = (pthread_t*)calloc(threads, sizeof(pthread_t));
+    if (!workers || !threadIds)
+        return 1;
+    for (int i = 0; i < threads; i++)
+    {
+        workers[i].run = run;
+        workers[i].benchmark = benchmark;
+        workers[i].result = &run->results[first + i];
+        workers[i].index = first + i;
+        workers[i].handles = handles;
+        workers[i].random = 0x9E3779B9 ^ (DWORD)(first + i) * 0x85EBCA6B;
+        memset(workers[i].buffer, 0x5A, sizeof workers[i].buffer);
+        pthread_create(&threadIds[i], NULL, RunWorker, &workers[i]);
+    }
+    for (int i = 0; i < threads; i++)
+        pthread_join(threadIds[i], NULL);
+    free(threadIds);
+    free(workers);
+    return 0;
+}
+
+static void Report(const Benchmark* benchmark, const RunState* run, int threads, int processes, BOOL json)
+{
+    const int workers = threads * processes;
+    WorkerResult total = { 0 };
+    UINT64 end = run->start;
+    for (int i = 0; i < workers; i++)
+    {
+        const WorkerResult* result = &run->results[i];
+        total.ops += result->ops;
+        total.errors += result->errors;
+        total.totalNs += result->totalNs;
+        for (int b = 0; b < BENCH_BUCKETS; b++)
+            total.histogram[b] += result->histogram[b];
+        if (run->end[i] > end)
+            end = run->end[i];
+    }
+    const double wallNs = (double)(end - run->start);
+    const double nsPerOp = total.ops ? (double)total.totalNs / total.ops : 0;
+    const double opsPerSecond = wallNs > 0 ? total.ops * 1e9 / wallNs : 0;
+    const double quantiles[3] = { 0.5, 0.99, 0.999 };
+    UINT64 percentiles[3] = { 0 };
+    for (int q = 0; q < 3; q++)
+    {
+        const UINT64 rank = (UINT64)(quantiles[q] * total.ops + 0.5);
+        UINT64 seen = 0;
+        for (int b = 0; b < BENCH_BUCKETS; b++)
+        {
+            seen += total.histogram[b];
+            if (seen >= rank && seen)
+            {
+                percentiles[q] = GetBucketValue(b);
+                break;
+            }
+        }
+    }
+    if (json)
+        printf("{\"benchmark\":\"%s\",\"threads\":%d,\"processes\":%d,\"dongles\":%d,\"write_percent\":%d,"
+            "\"ops\":%llu,\"errors\":%llu,\"ns_per_op\":%.1f,\"ops_per_second\":%.0f,"
+            "\"p50_ns\":%llu,\"p99_ns\":%llu,\"p999_ns\":%llu}\n",
+            benchmark->name, threads, processes, DongleCount, WritePercent,
+            (unsigned long long)total.ops, (unsigned long long)total.errors, nsPerOp, opsPerSecond,
+            (unsigned long long)percentiles[0], (unsigned long long)percentiles[1], (unsigned long long)percentiles[2]);
+    else
+        printf("%-16s %7d %5d %12llu %10.1f %12.0f %9llu %9llu %9llu %7llu\n",
+            benchmark->name, threads, processes, (unsigned long long)total.ops, nsPerOp, opsPerSecond,
+            (unsigned long long)percentiles[0], (unsigned long long)percentiles[1], (unsigned long long)percentiles[2],
+            (unsigned long long)total.errors);
+    fflush(stdout);
+}
+
+static BOOL RunBenchmark(const Benchmark* benchmark, const char* library, int threads, int processes, BOOL json)
+{
+    RunState* run = (RunState*)mmap(NULL, sizeof(RunState), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (run == MAP_FAILED)
+        return FALSE;
+    fflush(stdout);
+    pid_t children[BENCH_MAX_WORKERS];
+    int started = 0;
+    for (; started < processes; started++)
+    {
+        children[started] = fork();
+        if (children[started] == 0)
+            _exit(RunProcess(run, benchmark, library, started * threads, threads));
+        if (children[started] < 0)
+            break;
+    }
+    BOOL success = started == processes;
+    while (success && run->ready < threads * processes)
+        usleep(1000);
+    success = success && !run->failed;
+    run->start = Now();
+    run->deadline = run->start + (UINT64)(Seconds * 1e9);
+    MemoryBarrier();
+    // Workers of a failed run stop after their first operation.
+    if (!success)
+        run->deadline = 0;
+    InterlockedExchange(&run->go, 1);
+    for (int i = 0; i < started; i++)
+    {
+        int status = 0;
+        waitpid(children[i], &status, 0);
+        success = success && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    }
+    if (success)
+        Report(benchmark, run, threads, processes, json);
+    munmap(run, sizeof(RunState));
+    return success;
+}
+
+// A fresh image of DongleCount dongles with distinct HIDs and UIDs, blocks erased.
+static BOOL WriteBenchImage(const char* path)
+{
+    const DWORD capacity = DongleCount > RY2_DEFAULT_DONGLES ? (DWORD)DongleCount : RY2_DEFAULT_DONGLES;
+    const SIZE_T size = RY2_FILE_IMAGE_SIZE(capacity);
+    RY2_FileImage* image = (RY2_FileImage*)calloc(1, size);
+    if (!image)
+        return FALSE;
+    image->magic = RY2_FILE_MAGIC;
+    image->version = RY2_FILE_VERSION;
+    image->count = (DWORD)DongleCount;
+    image->capacity = capacity;
+    for (int i = 0; i < DongleCount; i++)
+    {
+        RY2_FileDongle* dongle = &image->dongles[i];
+        dongle->present = RY2_ALL_BLOCKS | RY2_FILE_INFO_PRESENT;
+        dongle->info[0] = BENCH_HID_BASE + i;
+        dongle->info[1] = BENCH_UID_BASE + i;
+        dongle->info[2] = 1;
+        memset(dongle->blocks, 0xFF, sizeof dongle->blocks);
+    }
+    FILE* file = fopen(path, "wb");
+    BOOL success = file && fwrite(image, size, 1, file) == 1;
+    if (file && fclose(file) != 0)
+        success = FALSE;
+    free(image);
+    return success;
+}
+
+static int ParseList(const char* text, int* values)
+{
+    int count = 0;
+    while (*text && count < BENCH_MAX_LIST)
+    {
+        char* end;
+        values[count] = (int)strtol(text, &end, 10);
+        if (end == text || values[count] <= 0)
+            return 0;
+        count++;
+        text = *end == ',' ? end + 1 : end;
+        if (*end && *end != ',')
+            return 0;
+    }
+    return *text ? 0 : count;
+}
+
+static int Usage(void)
+{
+    fprintf(stderr, "usage: ry2bench [-t threads] [-p processes] [-d dongles] [-w percent] [-s seconds]\n"
+        "                [-f image] [-l library] [-j] [benchmark...]\n"
+        "  -t, -p  comma-separated lists, every combination is run (default 1)\n"
+        "  -d      dongles in the benchmark image (default 4, up to 4096)\n"
+        "  -w      share of writes in the mix benchmark, in percent (default 10)\n"
+        "  -s      seconds per run (default 1)\n"
+        "  -f      benchmark image, deleted afterwards (default ry2bench.dat)\n"
+        "  -l      library to load (default ./libRockey2.so)\n"
+        "  -j      one JSON object per run instead of a table\n"
+        "benchmarks:");
+    for (int i = 0; i < BENCHMARK_COUNT; i++)
+        fprintf(stderr, " %s", Benchmarks[i].name);
+    fprintf(stderr, "\n");
+    return 2;
+}
+
+int main(int argc, char** argv)
+{
+    int threadCounts[BENCH_MAX_LIST] = { 1 };
+    int processCounts[BENCH_MAX_LIST] = { 1 };
+    int threadListSize = 1;
+    int processListSize = 1;
+    const char* imagePath = "ry2bench.dat";
+    const char* library = "./libRockey2.so";
+    BOOL json = FALSE;
+    int i = 1;
+    for (; i < argc && argv[i][0] == '-'; i++)
+    {
+        const char option = argv[i][1];
+        if (option == 'j' && !argv[i][2])
+        {
+            json = TRUE;
+            continue;
+        }
+        if (argv[i][2] || i + 1 >= argc)
+            return Usage();
+        const char* value = argv[++i];
+        switch (option)
+        {
+        case 't':
+            threadListSize = ParseList(value, threadCounts);
+            break;
+        case 'p':
+            processListSize = ParseList(value, processCounts);
+            break;
+        case 'd':
+            DongleCount = atoi(value);
+            break;
+        case 'w':
+            WritePercent = atoi(value);
+            break;
+        case 's':
+            Seconds = atof(value);
+            break;
+        case 'f':
+            imagePath = value;
+            break;
+        case 'l':
+            library = value;
+            break;
+        default:
+            return Usage();
+        }
+    }
+    if (!threadListSize || !processListSize || DongleCount <= 0 || DongleCount > 4096 ||
+        WritePercent < 0 || WritePercent > 100 || Seconds <= 0)
+        return Usage();
+    for (int t = 0; t < threadListSize; t++)
+    {
+        for (int p = 0; p < processListSize; p++)
+        {
+            if (threadCounts[t] * processCounts[p] > BENCH_MAX_WORKERS)
+                return Usage();
+        }
+    }
+    BOOL selected[BENCHMARK_COUNT] = { FALSE };
+    const BOOL all = i == argc;
+    for (; i < argc; i++)
+    {
+        int b = 0;
+        while (b < BENCHMARK_COUNT && strcmp(argv[i], Benchmarks[b].name) != 0)
+            b++;
+        if (b == BENCHMARK_COUNT)
+            return Usage();
+        selected[b] = TRUE;
+    }
+    if (!WriteBenchImage(imagePath))
+    {
+        fprintf(stderr, "ry2bench: cannot write %s\n", imagePath);
+        return 1;
+    }
+    char maxDongles[10 + 1] = { 0 }; // 4294967295 + '\0'
+    _snprintf(maxDongles, sizeof maxDongles - 1, "%d", DongleCount > RY2_DEFAULT_DONGLES ? DongleCount : RY2_DEFAULT_DONGLES);
+    setenv("ROCKEY2_STORAGE", "file", 1);
+    setenv("ROCKEY2_STORAGE_FILE", imagePath, 1);
+    setenv("ROCKEY2_MAX_DONGLES", maxDongles, 1);
+    TimerOverhead = MeasureTimerOverhead();
+    if (!json)
+    {
+        printf("# %d dongle(s), %d%% writes in mix, %.1f s per run, %llu ns timer overhead subtracted\n",
+            DongleCount, WritePercent, Seconds, (unsigned long long)TimerOverhead);
+        printf("%-16s %7s %5s %12s %10s %12s %9s %9s %9s %7s\n",
+            "benchmark", "threads", "procs", "ops", "ns/op", "ops/s", "p50 ns", "p99 ns", "p999 ns", "errors");
+    }
+    BOOL success = TRUE;
+    for (int b = 0; b < BENCHMARK_COUNT && success; b++)
+    {
+        if (!all && !selected[b])
+            continue;
+        for (int t = 0; t < threadListSize && success; t++)
+        {
+            for (int p = 0; p < processListSize && success; p++)
+                success = RunBenchmark(&Benchmarks[b], library, threadCounts[t], processCounts[p], json);
+        }
+    }
+    remove(imagePath);
+    return success ? 0 : 1;
+}
@@ -0,0 +1,666 @@
+/*
+ * This file is part of the Rockey2 EMU project authored by Brian218.
+ *
+ * Copyright (C) 2026 Brian218 (https://github.com/brian218)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/*
+ * Converts a dongle set between the image file of the file backend, a .reg
+ * file and the live registry:
+ *
+ *     ry2image [-c capacity] <source> <destination>
+ *
+ * A path ending in .reg is a registry file, "registry" is the live
+ * HKEY_CURRENT_USER\Software\Rockey2\Dongles key (Windows only), and anything
+ * else is an image. Images are written sealed with their checksums; version 1
+ * images are accepted as a source. Unlike the library, this tool is an
+ * ordinary program and uses the C runtime.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "platform.h"
+#include "storage.h"
+
+#ifdef _WIN32
+#define strncasecmp _strnicmp
+#endif
+
+#define RY2_REG_LINE_WIDTH 76 // regedit wraps hex data past this column
+#define RY2_REG_CONTIGUOUS 0x80000000 // Transient present bit: the blocks came from a Blocks value
+
+static const char* const RegRootName = "HKEY_CURRENT_USER\\Software\\Rockey2";
+static const char* const RegDonglesName = "HKEY_CURRENT_USER\\Software\\Rockey2\\Dongles";
+static const char* const InfoNames[RY2_INFO_COUNT] = { "HID", "UID", "Version", "Protection" };
+
+// The dongles being converted, each in the image layout of a dongle.
+typedef struct
+{
+    int count;
+    int allocated;
+    RY2_FileDongle* dongles;
+} DongleSet;
+
+// Layout of version 1 images, before the blocks were aligned.
+typedef struct
+{
+    DWORD present;
+    DWORD info[RY2_INFO_COUNT];
+    char blocks[RY2_BLOCK_COUNT][RY2_BLOCK_SIZE];
+} RY2_FileDongleV1;
+
+typedef struct
+{
+    DWORD magic;
+    DWORD version;
+    DWORD count;
+    DWORD capacity; // 0 in images written before it was recorded: RY2_DEFAULT_DONGLES
+} RY2_FileHeaderV1;
+
+static BOOL Fail(const char* format, const char* argument)
+{
+    fprintf(stderr, "ry2image: ");
+    fprintf(stderr, format, argument);
+    fprintf(stderr, "\n");
+    return FALSE;
+}
+
+// Makes sure the set has a record for the dongle at index, zero-filled.
+static RY2_FileDongle* GetSetDongle(DongleSet* set, int index)
+{
+    if (index < 0 || index >= RY2_MAX_DONGLES)
+        return NULL;
+    if (index >= set->allocated)
+    {
+        int allocated = set->allocated ? set->allocated : RY2_DEFAULT_DONGLES;
+        while (allocated <= index)
+            allocated *= 2;
+        RY2_FileDongle* dongles = (RY2_FileDongle*)realloc(set->dongles, allocated * sizeof(RY2_FileDongle));
+        if (!dongles)
+            return NULL;
+        memset(dongles + set->allocated, 0, (allocated - set->allocated) * sizeof(RY2_FileDongle));
+        set->dongles = dongles;
+        set->allocated = allocated;
+    }
+    return &set->dongles[index];
+}
+
+static BOOL ReadWholeFile(const char* path, BYTE** data, SIZE_T* size)
+{
+    FILE* file = fopen(path, "rb");
+    if (!file)
+        return Fail("cannot open %s", path);
+    fseek(file, 0, SEEK_END);
+    const long length = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    *data = (BYTE*)malloc(length > 0 ? length : 1);
+    *size = length > 0 ? (SIZE_T)length : 0;
+    const BOOL success = *data && fread(*data, 1, *size, file) == *size;
+    fclose(file);
+    if (!success)
+    {
+        free(*data);
+        return Fail("cannot read %s", path);
+    }
+    return TRUE;
+}
+
+/*
+ * Writes next to the destination first and renames the result over it, so
+ * that a process mapping the old file never sees a half-written one.
+ */
+static BOOL WriteWholeFile(const char* path, const void* data, SIZE_T size)
+{
+    char tempPath[264 + 1] = { 0 }; // MAX_PATH + ".tmp" + '\0'
+    if (strlen(path) > 260)
+        return Fail("path too long: %s", path);
+    _snprintf(tempPath, sizeof tempPath - 1, "%s.tmp", path);
+    FILE* file = fopen(tempPath, "wb");
+    if (!file)
+        return Fail("cannot create %s", tempPath);
+    BOOL success = fwrite(data, 1, size, file) == size;
+    success = fclose(file) == 0 && success;
+#ifdef _WIN32
+    success = success && MoveFileEx(tempPath, path, MOVEFILE_REPLACE_EXISTING);
+#else
+    success = success && rename(tempPath, path) == 0;
+#endif
+    if (!success)
+    {
+        remove(tempPath);
+        return Fail("cannot write %s", path);
+    }
+    return TRUE;
+}
+
+static BOOL ReadImage(const char* path, DongleSet* set)
+{
+    BYTE* data = NULL;
+    SIZE_T size = 0;
+    if (!ReadWholeFile(path, &data, &size))
+        return FALSE;
+    const RY2_FileHeaderV1* header = (const RY2_FileHeaderV1*)data;
+    BOOL success = size >= sizeof *header && header->magic == RY2_FILE_MAGIC;
+    if (success && header->version == 1)
+    {
+        const DWORD capacity = header->capacity ? header->capacity : RY2_DEFAULT_DONGLES;
+        const RY2_FileDongleV1* dongles = (const RY2_FileDongleV1*)(header + 1);
+        success = header->count <= capacity && sizeof *header + header->count * sizeof *dongles <= size;
+        for (DWORD i = 0; success && i < header->count; i++)
+        {
+            RY2_FileDongle* dongle = GetSetDongle(set, (int)i);
+            success = dongle != NULL;
+            if (success)
+            {
+                dongle->present = dongles[i].present;
+                memcpy(dongle->info, dongles[i].info, sizeof dongle->info);
+                memcpy(dongle->blocks, dongles[i].blocks, sizeof dongle->blocks);
+            }
+        }
+    }
+    else if (success && header->version == RY2_FILE_VERSION)
+    {
+        const RY2_FileImage* image = (const RY2_FileImage*)data;
+        success = size >= sizeof *image && image->count <= image->capacity && RY2_FILE_IMAGE_SIZE(image->count) <= size;
+        if (success && ((image->indexChecksum && ChecksumFileIndex(image, image->count) != (DWORD)image->indexChecksum) ||
+            (image->blocksChecksum && ChecksumFileBlocks(image, image->count) != (DWORD)image->blocksChecksum)))
+        {
+            free(data);
+            return Fail("%s does not match its checksum", path);
+        }
+        for (DWORD i = 0; success && i < image->count; i++)
+        {
+            RY2_FileDongle* dongle = GetSetDongle(set, (int)i);
+            success = dongle != NULL;
+            if (success)
+                *dongle = image->dongles[i];
+        }
+    }
+    else
+        success = FALSE;
+    if (success)
+        set->count = (int)header->count;
+    free(data);
+    return success || Fail("%s is not a valid dongle image", path);
+}
+
+static BOOL WriteImage(const char* path, const DongleSet* set, DWORD capacity)
+{
+    if (capacity < (DWORD)set->count)
+        capacity = (DWORD)set->count;
+    const SIZE_T size = RY2_FILE_IMAGE_SIZE(capacity);
+    RY2_FileImage* image = (RY2_FileImage*)calloc(1, size);
+    if (!image)
+        return Fail("out of memory writing %s", path);
+    image->magic = RY2_FILE_MAGIC;
+    image->version = RY2_FILE_VERSION;
+    image->count = (DWORD)set->count;
+    image->capacity = capacity;
+    if (set->count)
+        memcpy(image->dongles, set->dongles, set->count * sizeof(RY2_FileDongle));
+    image->indexChecksum = (LONG)ChecksumFileIndex(image, image->count);
+    image->blocksChecksum = (LONG)ChecksumFileBlocks(image, image->count);
+    const BOOL success = WriteWholeFile(path, image, size);
+    free(image);
+    return success;
+}
+
+/*
+ * Registry files are UTF-16LE with a byte order mark when written by regedit
+ * and 8-bit for REGEDIT4. Only ASCII matters here, so both are narrowed to a
+ * null-terminated string with every other character replaced by '?'.
+ */
+static char* DecodeRegText(const BYTE* data, SIZE_T size)
+{
+    const BOOL wide = size >= 2 && data[0] == 0xFF && data[1] == 0xFE;
+    const SIZE_T first = wide ? 2 : (size >= 3 && data[0] == 0xEF && data[1] == 0xBB && data[2] == 0xBF) ? 3 : 0;
+    const SIZE_T length = wide ? (size - first) / 2 : size - first;
+    char* text = (char*)malloc(length + 1);
+    if (!text)
+        return NULL;
+    for (SIZE_T i = 0; i < length; i++)
+    {
+        const unsigned character = wide ? data[first + i * 2] | (data[first + i * 2 + 1] << 8) : data[first + i];
+        text[i] = character && character < 0x80 ? (char)character : '?';
+    }
+    text[length] = '\0';
+    return text;
+}
+
+// Parses comma-separated hex bytes; returns the byte count, or -1 if malformed.
+static int ParseHexBytes(const char* text, BYTE* bytes, int maxCount)
+{
+    int count = 0;
+    while (*text)
+    {
+        while (*text == ' ' || *text == '\t' || *text == ',')
+            text++;
+        if (!*text)
+            break;
+        char* end = NULL;
+        const unsigned long value = strtoul(text, &end, 16);
+        if (end == text || value > 0xFF || count >= maxCount)
+            return -1;
+        bytes[count++] = (BYTE)value;
+        text = end;
+    }
+    return count;
+}
+
+// Whether path ends with suffix, ignoring case; *rest receives what follows it.
+static BOOL MatchKeySuffix(const char* path, const char* suffix, const char** rest)
+{
+    const char* found = NULL;
+    for (const char* p = path; *p; p++)
+    {
+        if (strncasecmp(p, suffix, strlen(suffix)) == 0)
+            found = p;
+    }
+    if (!found)
+        return FALSE;
+    *rest = found + strlen(suffix);
+    return TRUE;
+}
+
+static void ParseRegValue(DongleSet* set, int dongleIndex, BOOL* hasCount, const char* name, const char* value)
+{
+    char* end = NULL;
+    if (dongleIndex < 0)
+    {
+        if (lstrcmpi(name, "Count") == 0 && strncasecmp(value, "dword:", 6) == 0)
+        {
+            set->count = (int)strtoul(value + 6, &end, 16);
+            *hasCount = TRUE;
+        }
+        return;
+    }
+    RY2_FileDongle* dongle = GetSetDongle(set, dongleIndex);
+    if (!dongle)
+        return;
+    for (int i = 0; i < RY2_INFO_COUNT; i++)
+    {
+        if (lstrcmpi(name, InfoNames[i]) == 0 && strncasecmp(value, "dword:", 6) == 0)
+        {
+            dongle->info[i] = (DWORD)strtoul(value + 6, &end, 16);
+            dongle->present |= 1u << (8 + i);
+            return;
+        }
+    }
+    if (strncasecmp(value, "hex:", 4) != 0)
+        return;
+    // The library prefers a contiguous Blocks value over the BlockN values.
+    if (lstrcmpi(name, "Blocks") == 0)
+    {
+        if (ParseHexBytes(value + 4, (BYTE*)dongle->blocks, sizeof dongle->blocks) == sizeof dongle->blocks)
+            dongle->present |= RY2_ALL_BLOCKS | RY2_REG_CONTIGUOUS;
+        return;
+    }
+    for (int i = 0; i < RY2_BLOCK_COUNT; i++)
+    {
+        char blockName[6 + 1] = { 0 }; // Block4 + '\0'
+        _snprintf(blockName, sizeof blockName - 1, "Block%d", i);
+        if (lstrcmpi(name, blockName) == 0 && !(dongle->present & RY2_REG_CONTIGUOUS))
+        {
+            BYTE block[RY2_BLOCK_SIZE];
+            if (ParseHexBytes(value + 4, block, sizeof block) == RY2_BLOCK_SIZE)
+            {
+                memcpy(dongle->blocks[i], block, RY2_BLOCK_SIZE);
+                dongle->present |= RY2_FILE_BLOCK_PRESENT(i);
+            }
+            return;
+        }
+    }
+}
+
+static BOOL ReadRegFile(const char* path, DongleSet* set)
+{
+    BYTE* data = NULL;
+    SIZE_T size = 0;
+    if (!ReadWholeFile(path, &data, &size))
+        return FALSE;
+    char* text = DecodeRegText(data, size);
+    free(data);
+    if (!text)
+        return Fail("out of memory reading %s", path);
+    // Joins continuation lines in place: a trailing backslash, CRLF and indent.
+    char* out = text;
+    for (const char* in = text; *in; )
+    {
+        if (*in == '\\' && (in[1] == '\r' || in[1] == '\n'))
+        {
+            in++;
+            while (*in == '\r' || *in == '\n' || *in == ' ' || *in == '\t')
+                in++;
+            continue;
+        }
+        *out++ = *in++;
+    }
+    *out = '\0';
+    int dongleIndex = -2; // -1 is the Dongles key, -2 any other key
+    BOOL hasCount = FALSE;
+    int highest = -1;
+    for (char* line = strtok(text, "\r\n"); line; line = strtok(NULL, "\r\n"))
+    {
+        if (line[0] == '[')
+        {
+            char* close = strrchr(line, ']');
+            if (close)
+                *close = '\0';
+            const char* rest = NULL;
+            dongleIndex = -2;
+            if (line[1] == '-')
+                continue;
+            if (MatchKeySuffix(line + 1, "\\Dongles", &rest) && !*rest)
+                dongleIndex = -1;
+            else if (MatchKeySuffix(line + 1, "\\Dongles\\Dongle", &rest) && *rest)
+            {
+                char* end = NULL;
+                const unsigned long index = strtoul(rest, &end, 10);
+                if (!*end && index < RY2_MAX_DONGLES)
+                    dongleIndex = (int)index;
+            }
+            if (dongleIndex > highest)
+                highest = dongleIndex;
+        }
+        else if (line[0] == '"' && dongleIndex >= -1)
+        {
+            char* nameEnd = strchr(line + 1, '"');
+            if (!nameEnd || nameEnd[1] != '=')
+                continue;
+            *nameEnd = '\0';
+            ParseRegValue(set, dongleIndex, &hasCount, line + 1, nameEnd + 2);
+        }
+    }
+    free(text);
+    for (int i = 0; i < set->allocated; i++)
+        set->dongles[i].present &= ~RY2_REG_CONTIGUOUS;
+    // Without a Count every DongleNN key is kept; the library would reset it to 0.
+    if (!hasCount)
+        set->count = highest + 1;
+    if (set->count < 0 || set->count > RY2_MAX_DONGLES || !GetSetDongle(set, set->count > 0 ? set->count - 1 : 0))
+        return Fail("%s has an invalid Count", path);
+    return TRUE;
+}
+
+// A .reg file being written, in UTF-16LE like the files regedit exports.
+typedef struct
+{
+    BYTE* data;
+    SIZE_T size;
+    SIZE_T allocated;
+} RegText;
+
+static BOOL ReserveRegText(RegText* text, SIZE_T size)
+{
+    if (text->size + size <= text->allocated)
+        return TRUE;
+    SIZE_T allocated = text->allocated ? text->allocated : 65536;
+    while (allocated < text->size + size)
+        allocated *= 2;
+    BYTE* data = (BYTE*)realloc(text->data, allocated);
+    if (!data)
+        return FALSE;
+    text->data = data;
+    text->allocated = allocated;
+    return TRUE;
+}
+
+static BOOL AppendRegText(RegText* text, const char* string)
+{
+    const SIZE_T length = strlen(string);
+    if (!ReserveRegText(text, length * 2))
+        return FALSE;
+    for (SIZE_T i = 0; i < length; i++)
+    {
+        text->data[text->size++] = (BYTE)string[i];
+        text->data[text->size++] = 0;
+    }
+    return TRUE;
+}
+
+// Writes a hex value wrapped the way regedit does, so exports diff cleanly.
+static BOOL AppendRegHex(RegText* text, const char* name, const BYTE* bytes, int count)
+{
+    char item[13 + 1] = { 0 }; // "Block0"=hex: + '\0'
+    _snprintf(item, sizeof item - 1, "\"%s\"=hex:", name);
+    BOOL success = AppendRegText(text, item);
+    SIZE_T column = strlen(item);
+    for (int i = 0; i < count && success; i++)
+    {
+        _snprintf(item, sizeof item - 1, i + 1 < count ? "%02x," : "%02x", bytes[i]);
+        success = AppendRegText(text, item);
+        column += strlen(item);
+        if (i + 1 < count && column > RY2_REG_LINE_WIDTH)
+        {
+            success = success && AppendRegText(text, "\\\r\n  ");
+            column = 2;
+        }
+    }
+    return success && AppendRegText(text, "\r\n");
+}
+
+static BOOL WriteRegFile(const char* path, const DongleSet* set)
+{
+    RegText text = { 0 };
+    char line[59 + 1] = { 0 }; // [HKEY_CURRENT_USER\Software\Rockey2\Dongles\Dongle65535] CRLF + '\0'
+    BOOL success = ReserveRegText(&text, 2);
+    if (success)
+    {
+        text.data[text.size++] = 0xFF; // UTF-16LE byte order mark
+        text.data[text.size++] = 0xFE;
+    }
+    success = success && AppendRegText(&text, "Windows Registry Editor Version 5.00\r\n\r\n");
+    _snprintf(line, sizeof line - 1, "[%s]\r\n\r\n", RegRootName);
+    success = success && AppendRegText(&text, line);
+    _snprintf(line, sizeof line - 1, "[%s]\r\n", RegDonglesName);
+    success = success && AppendRegText(&text, line);
+    _snprintf(line, sizeof line - 1, "\"Count\"=dword:%08x\r\n\r\n", set->count);
+    success = success && AppendRegText(&text, line);
+    for (int i = 0; i < set->count && success; i++)
+    {
+        const RY2_FileDongle* dongle = &set->dongles[i];
+        _snprintf(line, sizeof line - 1, "[%s\\Dongle%02d]\r\n", RegDonglesName, i);
+        success = AppendRegText(&text, line);
+        for (int j = 0; j < RY2_INFO_COUNT && success; j++)
+        {
+            if (!(dongle->present & (1u << (8 + j))))
+                continue;
+            _snprintf(line, sizeof line - 1, "\"%s\"=dword:%08x\r\n", InfoNames[j], dongle->info[j]);
+            success = AppendRegText(&text, line);
+        }
+        for (int j = 0; j < RY2_BLOCK_COUNT && success; j++)
+        {
+            char blockName[6 + 1] = { 0 }; // Block4 + '\0'
+            _snprintf(blockName, sizeof blockName - 1, "Block%d", j);
+            if (dongle->present & RY2_FILE_BLOCK_PRESENT(j))
+                success = AppendRegHex(&text, blockName, (const BYTE*)dongle->blocks[j], RY2_BLOCK_SIZE);
+        }
+        success = success && AppendRegText(&text, "\r\n");
+    }
+    success = success ? WriteWholeFile(path, text.data, text.size) : Fail("out of memory writing %s", path);
+    free(text.data);
+    return success;
+}
+
+#ifdef _WIN32
+static const char* const RegSubKey = "Software\\Rockey2\\Dongles";
+
+static BOOL ReadRegistry(DongleSet* set)
+{
+    HKEY donglesKey = NULL;
+    if (RegOpenKeyEx(HKEY_CURRENT_USER, RegSubKey, 0, KEY_WOW64_64KEY | KEY_READ, &donglesKey) != ERROR_SUCCESS)
+        return Fail("cannot open %s", RegDonglesName);
+    DWORD count = 0;
+    DWORD regType = REG_DWORD;
+    DWORD regSize = sizeof count;
+    if (RegQueryValueEx(donglesKey, "Count", NULL, &regType, (LPBYTE)&count, &regSize) != ERROR_SUCCESS || regType != REG_DWORD || count > RY2_MAX_DONGLES)
+        count = 0;
+    set->count = (int)count;
+    BOOL success = count == 0 || GetSetDongle(set, (int)count - 1);
+    for (DWORD i = 0; i < count && success; i++)
+    {
+        char dongleName[11 + 1] = { 0 }; // Dongle65535 + '\0'
+        _snprintf(dongleName, sizeof dongleName - 1, "Dongle%02d", (int)i);
+        HKEY dongleKey = NULL;
+        if (RegOpenKeyEx(donglesKey, dongleName, 0, KEY_READ, &dongleKey) != ERROR_SUCCESS)
+            continue;
+        RY2_FileDongle* dongle = &set->dongles[i];
+        for (int j = 0; j < RY2_INFO_COUNT; j++)
+        {
+            regType = REG_DWORD;
+            regSize = sizeof(DWORD);
+            if (RegQueryValueEx(dongleKey, InfoNames[j], NULL, &regType, (LPBYTE)&dongle->info[j], &regSize) == ERROR_SUCCESS && regType == REG_DWORD && regSize == sizeof(DWORD))
+                dongle->present |= 1u << (8 + j);
+            else
+                dongle->info[j] = 0;
+        }
+        regType = REG_BINARY;
+        regSize = sizeof dongle->blocks;
+        if (RegQueryValueEx(dongleKey, "Blocks", NULL, &regType, (LPBYTE)dongle->blocks, &regSize) == ERROR_SUCCESS && regType == REG_BINARY && regSize == sizeof dongle->blocks)
+            dongle->present |= RY2_ALL_BLOCKS;
+        else
+        {
+            for (int j = 0; j < RY2_BLOCK_COUNT; j++)
+            {
+                char blockName[6 + 1] = { 0 }; // Block4 + '\0'
+                _snprintf(blockName, sizeof blockName - 1, "Block%d", j);
+                regType = REG_BINARY;
+                regSize = RY2_BLOCK_SIZE;
+                if (RegQueryValueEx(dongleKey, blockName, NULL, &regType, (LPBYTE)dongle->blocks[j], &regSize) == ERROR_SUCCESS && regType == REG_BINARY && regSize == RY2_BLOCK_SIZE)
+                    dongle->present |= RY2_FILE_BLOCK_PRESENT(j);
+            }
+        }
+        RegCloseKey(dongleKey);
+    }
+    RegCloseKey(donglesKey);
+    return success || Fail("out of memory reading %s", RegDonglesName);
+}
+
+static BOOL WriteRegistry(const DongleSet* set)
+{
+    HKEY donglesKey = NULL;
+    if (RegCreateKeyEx(HKEY_CURRENT_USER, RegSubKey, 0, NULL, REG_OPTION_NON_VOLATILE, KEY_WOW64_64KEY | KEY_READ | KEY_WRITE, NULL, &donglesKey, NULL) != ERROR_SUCCESS)
+        return Fail("cannot create %s", RegDonglesName);
+    BOOL success = TRUE;
+    for (int i = 0; i < set->count && success; i++)
+    {
+        char dongleName[11 + 1] = { 0 }; // Dongle65535 + '\0'
+        _snprintf(dongleName, sizeof dongleName - 1, "Dongle%02d", i);
+        HKEY dongleKey = NULL;
+        success = RegCreateKeyEx(donglesKey, dongleName, 0, NULL, REG_OPTION_NON_VOLATILE, KEY_READ | KEY_WRITE, NULL, &dongleKey, NULL) == ERROR_SUCCESS;
+        if (!success)
+            break;
+        const RY2_FileDongle* dongle = &set->dongles[i];
+        for (int j = 0; j < RY2_INFO_COUNT && success; j++)
+        {
+            if (dongle->present & (1u << (8 + j)))
+                success = RegSetValueEx(dongleKey, InfoNames[j], 0, REG_DWORD, (const BYTE*)&dongle->info[j], sizeof(DWORD)) == ERROR_SUCCESS;
+        }
+        // A stale Blocks value would take precedence over the BlockN values.
+        RegDeleteValue(dongleKey, "Blocks");
+        for (int j = 0; j < RY2_BLOCK_COUNT && success; j++)
+        {
+            char blockName[6 + 1] = { 0 }; // Block4 + '\0'
+            _snprintf(blockName, sizeof blockName - 1, "Block%d", j);
+            if (dongle->present & RY2_FILE_BLOCK_PRESENT(j))
+                success = RegSetValueEx(dongleKey, blockName, 0, REG_BINARY, (const BYTE*)dongle->blocks[j], RY2_BLOCK_SIZE) == ERROR_SUCCESS;
+        }
+        RegCloseKey(dongleKey);
+    }
+    // Count goes last, so that a reader never sees dongles that are not written yet.
+    const DWORD count = (DWORD)set->count;
+    success = success && RegSetValueEx(donglesKey, "Count", 0, REG_DWORD, (const BYTE*)&count, sizeof count) == ERROR_SUCCESS;
+    RegCloseKey(donglesKey);
+    return success || Fail("cannot write %s", RegDonglesName);
+}
+#else
+static BOOL ReadRegistry(DongleSet* set)
+{
+    (void)set;
+    return Fail("the %s is only available on Windows", "live registry");
+}
+
+static BOOL WriteRegistry(const DongleSet* set)
+{
+    (void)set;
+    return Fail("the %s is only available on Windows", "live registry");
+}
+#endif
+
+typedef enum { ImageFile, RegFile, LiveRegistry } Endpoint;
+
+static Endpoint GetEndpoint(const char* path)
+{
+    const SIZE_T length = strlen(path);
+    if (lstrcmpi(path, "registry") == 0)
+        return LiveRegistry;
+    return length >= 4 && lstrcmpi(path + length - 4, ".reg") == 0 ? RegFile : ImageFile;
+}
+
+int main(int argc, char** argv)
+{
+    DWORD capacity = RY2_DEFAULT_DONGLES;
+    int first = 1;
+    if (argc == 5 && strcmp(argv[1], "-c") == 0)
+    {
+        capacity = (DWORD)strtoul(argv[2], NULL, 10);
+        first = 3;
+    }
+    if (argc - first != 2 || capacity == 0 || capacity > RY2_MAX_DONGLES)
+    {
+        fprintf(stderr, "usage: ry2image [-c capacity] <source> <destination>\n"
+            "  image files, .reg files or \"registry\" (HKEY_CURRENT_USER\\Software\\Rockey2\\Dongles)\n"
+            "  -c  dongles an image has room for (default %d, up to %d)\n", RY2_DEFAULT_DONGLES, RY2_MAX_DONGLES);
+        return 2;
+    }
+    const char* source = argv[first];
+    const char* destination = argv[first + 1];
+    DongleSet set = { 0 };
+    BOOL success;
+    switch (GetEndpoint(source))
+    {
+    case RegFile:
+        success = ReadRegFile(source, &set);
+        break;
+    case LiveRegistry:
+        success = ReadRegistry(&set);
+        break;
+    default:
+        success = ReadImage(source, &set);
+        break;
+    }
+    if (success)
+    {
+        switch (GetEndpoint(destination))
+        {
+        case RegFile:
+            success = WriteRegFile(destination, &set);
+            break;
+        case LiveRegistry:
+            success = WriteRegistry(&set);
+            break;
+        default:
+            success = WriteImage(destination, &set, capacity);
+            break;
+        }
+    }
+    if (success)
+        printf("%d dongle(s) written to %s\n", set.count, destination);
+    free(set.dongles);
+    return success ? 0 : 1;
+}
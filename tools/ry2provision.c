@@ -0,0 +1,471 @@
+/*
+ * This file is part of the Rockey2 EMU project authored by Brian218.
+ *
+ * Copyright (C) 2026 Brian218 (https://github.com/brian218)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/*
+ * Provisions a whole dongle set at once, as RY2_GenUID would one dongle at a
+ * time, and writes it as an image for the file backend:
+ *
+ *     ry2provision [-t threads] [-c capacity] [-l] <manifest> <image>
+ *
+ * Every non-empty manifest line that does not start with '#' describes one
+ * dongle, in handle order:
+ *
+ *     <HID> <version> <protection> <seed>
+ *
+ * Numbers are in C notation (0x for hex), protection is 0 or 1, and the seed
+ * is the rest of the line, up to 64 characters. The UIDs are computed with
+ * the batched GenUID kernel by a pool of threads, which take chunks of their
+ * own share of the dongles and steal half of the largest remaining share
+ * once theirs is done; the same threads fill in the erased blocks. The image
+ * is then sealed and written in one pass. "-" reads the manifest from
+ * standard input, and -l lists the handle, HID and UID of every dongle.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "platform.h"
+#include "storage.h"
+#include "crypto.h"
+
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+
+#define PROVISION_MAX_THREADS 256
+#define PROVISION_CHUNK MD5_BATCH_SIZE // Dongles a thread takes at a time
+#define PROVISION_MAX_SEED 64
+#define PROVISION_LINE_SIZE 256
+
+typedef struct
+{
+    DWORD hid;
+    DWORD version;
+    DWORD protection;
+    char seed[PROVISION_MAX_SEED + 1];
+} ManifestEntry;
+
+/*
+ * The dongles a thread has yet to provision, [low half, high half) packed
+ * into one value, so that its owner taking from the front and a thief
+ * taking the back half can both claim their part with one exchange.
+ */
+typedef struct
+{
+    volatile LONGLONG range;
+    BYTE padding[64 - sizeof(LONGLONG)];
+} WorkRange;
+
+typedef struct
+{
+    const ManifestEntry* entries;
+    RY2_FileImage* image;
+    WorkRange* ranges;
+    int threadCount;
+} Pool;
+
+typedef struct
+{
+    Pool* pool;
+    int index;
+    int stolen; // Ranges taken from other threads, for the summary
+} PoolThread;
+
+static BOOL Fail(const char* format, const char* argument)
+{
+    fprintf(stderr, "ry2provision: ");
+    fprintf(stderr, format, argument);
+    fprintf(stderr, "\n");
+    return FALSE;
+}
+
+static LONGLONG PackRange(DWORD begin, DWORD end)
+{
+    return (LONGLONG)(((UINT64)end << 32) | begin);
+}
+
+// Claims up to count dongles from the front of a thread's own range.
+static BOOL TakeFront(WorkRange* range, DWORD count, DWORD* begin, DWORD* end)
+{
+    for (;;)
+    {
+        const LONGLONG value = range->range;
+        const DWORD low = (DWORD)value;
+        const DWORD high = (DWORD)((UINT64)value >> 32);
+        if (low >= high)
+            return FALSE;
+        const DWORD next = high - low > count ? low + count : high;
+        if (InterlockedCompareExchange64(&range->range, PackRange(next, high), value) == value)
+        {
+            *begin = low;
+            *end = next;
+            return TRUE;
+        }
+    }
+}
+
+// Moves the back half of the largest remaining range to the thread's own.
+static BOOL Steal(Pool* pool, int thief)
+{
+    for (;;)
+    {
+        int victim = -1;
+        DWORD largest = 0;
+        for (int i = 0; i < pool->threadCount; i++)
+        {
+            const LONGLONG value = pool->ranges[i].range;
+            const DWORD remaining = (DWORD)((UINT64)value >> 32) - (DWORD)value;
+            if (i != thief && (DWORD)value < (DWORD)((UINT64)value >> 32) && remaining > largest)
+            {
+                victim = i;
+                largest = remaining;
+            }
+        }
+        if (victim < 0)
+            return FALSE;
+        const LONGLONG value = pool->ranges[victim].range;
+        const DWORD low = (DWORD)value;
+        const DWORD high = (DWORD)((UINT64)value >> 32);
+        if (low >= high)
+            continue;
+        const DWORD middle = low + (high - low) / 2;
+        if (InterlockedCompareExchange64(&pool->ranges[victim].range, PackRange(low, middle), value) == value)
+        {
+            // Nobody else changes the thief's range while it is empty.
+            const LONGLONG empty = pool->ranges[thief].range;
+            InterlockedCompareExchange64(&pool->ranges[thief].range, PackRange(middle, high), empty);
+            return TRUE;
+        }
+    }
+}
+
+// Provisions dongles [begin, end): their UIDs in one batch, their blocks erased.
+static void ProvisionChunk(const Pool* pool, DWORD begin, DWORD end)
+{
+    const char* seeds[PROVISION_CHUNK] = { NULL };
+    uint32_t uids[PROVISION_CHUNK];
+    const int count = (int)(end - begin);
+    for (int k = 0; k < count; k++)
+        seeds[k] = pool->entries[begin + k].seed;
+    GenUIDBatch(count, seeds, uids);
+    for (int k = 0; k < count; k++)
+    {
+        const ManifestEntry* entry = &pool->entries[begin + k];
+        RY2_FileDongle* dongle = &pool->image->dongles[begin + k];
+        dongle->present = RY2_FILE_INFO_PRESENT;
+        for (int i = 0; i < RY2_BLOCK_COUNT; i++)
+            dongle->present |= RY2_FILE_BLOCK_PRESENT(i);
+        dongle->info[0] = entry->hid;
+        dongle->info[1] = uids[k];
+        dongle->info[2] = entry->version;
+        dongle->info[3] = entry->protection;
+        memset(dongle->blocks, 0xFF, sizeof dongle->blocks);
+    }
+}
+
+#ifdef _WIN32
+static DWORD WINAPI RunPoolThread(LPVOID parameter)
+#else
+static void* RunPoolThread(void* parameter)
+#endif
+{
+    PoolThread* thread = (PoolThread*)parameter;
+    Pool* pool = thread->pool;
+    DWORD begin;
+    DWORD end;
+    do
+    {
+        while (TakeFront(&pool->ranges[thread->index], PROVISION_CHUNK, &begin, &end))
+            ProvisionChunk(pool, begin, end);
+    } while (Steal(pool, thread->index) && ++thread->stolen);
+    return 0;
+}
+
+// Runs the pool on every dongle of the image, each thread starting with an equal share.
+static int RunPool(Pool* pool, DWORD count)
+{
+    PoolThread threads[PROVISION_MAX_THREADS];
+#ifdef _WIN32
+    HANDLE handles[PROVISION_MAX_THREADS];
+#else
+    pthread_t handles[PROVISION_MAX_THREADS];
+#endif
+    for (int i = 0; i < pool->threadCount; i++)
+    {
+        const DWORD begin = (DWORD)((UINT64)count * i / pool->threadCount);
+        const DWORD end = (DWORD)((UINT64)count * (i + 1) / pool->threadCount);
+        pool->ranges[i].range = PackRange(begin, end);
+    }
+    // Picks the MD5 kernel before the threads race to do it.
+    MD5_LaneCount();
+    for (int i = 0; i < pool->threadCount; i++)
+    {
+        threads[i].pool = pool;
+        threads[i].index = i;
+        threads[i].stolen = 0;
+#ifdef _WIN32
+        handles[i] = CreateThread(NULL, 0, RunPoolThread, &threads[i], 0, NULL);
+#else
+        pthread_create(&handles[i], NULL, RunPoolThread, &threads[i]);
+#endif
+    }
+    int stolen = 0;
+    for (int i = 0; i < pool->threadCount; i++)
+    {
+#ifdef _WIN32
+        WaitForSingleObject(handles[i], INFINITE);
+        CloseHandle(handles[i]);
+#else
+        pthread_join(handles[i], NULL);
+#endif
+        stolen += threads[i].stolen;
+    }
+    return stolen;
+}
+
+static int GetProcessorCount(void)
+{
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return (int)info.dwNumberOfProcessors;
+#else
+    const long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (int)count : 1;
+#endif
+}
+
+// Parses one manifest line; returns FALSE with a message naming the line if it is malformed.
+static BOOL ParseManifestLine(char* line, int lineNumber, ManifestEntry* entry)
+{
+    char where[10 + 1] = { 0 }; // 4294967295 + '\0'
+    _snprintf(where, sizeof where - 1, "%d", lineNumber);
+    char* cursor = line;
+    DWORD values[3];
+    for (int i = 0; i < 3; i++)
+    {
+        char* end = NULL;
+        values[i] = (DWORD)strtoul(cursor, &end, 0);
+        if (end == cursor || (*end != ' ' && *end != '\t'))
+            return Fail("line %s: expected <HID> <version> <protection> <seed>", where);
+        cursor = end;
+        while (*cursor == ' ' || *cursor == '\t')
+            cursor++;
+    }
+    if (values[2] > 1)
+        return Fail("line %s: the protection must be 0 or 1", where);
+    const SIZE_T length = strlen(cursor);
+    if (!length)
+        return Fail("line %s: the seed is missing", where);
+    if (length > PROVISION_MAX_SEED)
+        return Fail("line %s: the seed is longer than 64 characters", where);
+    entry->hid = values[0];
+    entry->version = values[1];
+    entry->protection = values[2];
+    memcpy(entry->seed, cursor, length + 1);
+    return TRUE;
+}
+
+static BOOL ReadManifest(const char* path, ManifestEntry** entries, int* count)
+{
+    FILE* file = strcmp(path, "-") == 0 ? stdin : fopen(path, "r");
+    if (!file)
+        return Fail("cannot open %s", path);
+    int allocated = 0;
+    int lineNumber = 0;
+    BOOL success = TRUE;
+    char line[PROVISION_LINE_SIZE + 1] = { 0 };
+    *entries = NULL;
+    *count = 0;
+    while (success && fgets(line, sizeof line, file))
+    {
+        lineNumber++;
+        SIZE_T length = strlen(line);
+        if (length == sizeof line - 1 && line[length - 1] != '\n' && !feof(file))
+        {
+            char where[10 + 1] = { 0 }; // 4294967295 + '\0'
+            _snprintf(where, sizeof where - 1, "%d", lineNumber);
+            success = Fail("line %s is too long", where);
+            break;
+        }
+        while (length && (line[length - 1] == '\n' || line[length - 1] == '\r' || line[length - 1] == ' ' || line[length - 1] == '\t'))
+            line[--length] = '\0';
+        char* start = line;
+        while (*start == ' ' || *start == '\t')
+            start++;
+        if (!*start || *start == '#')
+            continue;
+        if (*count == RY2_MAX_DONGLES)
+        {
+            success = Fail("%s describes more dongles than an image holds", path);
+            break;
+        }
+        if (*count == allocated)
+        {
+            allocated = allocated ? allocated * 2 : 1024;
+            ManifestEntry* grown = (ManifestEntry*)realloc(*entries, allocated * sizeof(ManifestEntry));
+            if (!grown)
+            {
+                success = Fail("out of memory reading %s", path);
+                break;
+            }
+            *entries = grown;
+        }
+        success = ParseManifestLine(start, lineNumber, &(*entries)[*count]);
+        *count += success;
+    }
+    if (file != stdin)
+        fclose(file);
+    return success;
+}
+
+static int CompareHIDs(const void* left, const void* right)
+{
+    const DWORD a = *(const DWORD*)left;
+    const DWORD b = *(const DWORD*)right;
+    return a < b ? -1 : a > b;
+}
+
+// RY2_Open with mode -1 finds a dongle by its HID, so every HID must be unique.
+static BOOL CheckUniqueHIDs(const char* path, const ManifestEntry* entries, int count)
+{
+    DWORD* hids = (DWORD*)malloc((count ? count : 1) * sizeof(DWORD));
+    if (!hids)
+        return Fail("out of memory checking %s", path);
+    for (int i = 0; i < count; i++)
+        hids[i] = entries[i].hid;
+    qsort(hids, count, sizeof(DWORD), CompareHIDs);
+    int duplicate = -1;
+    for (int i = 1; i < count && duplicate < 0; i++)
+    {
+        if (hids[i] == hids[i - 1])
+            duplicate = i;
+    }
+    char hid[10 + 1] = { 0 }; // 0xFFFFFFFF + '\0'
+    if (duplicate >= 0)
+        _snprintf(hid, sizeof hid - 1, "0x%08X", (unsigned)hids[duplicate]);
+    free(hids);
+    return duplicate < 0 || Fail("HID %s appears more than once", hid);
+}
+
+/*
+ * Writes next to the destination first and renames the result over it, so
+ * that a process mapping the old file never sees a half-written one.
+ */
+static BOOL WriteWholeFile(const char* path, const void* data, SIZE_T size)
+{
+    char tempPath[264 + 1] = { 0 }; // MAX_PATH + ".tmp" + '\0'
+    if (strlen(path) > 260)
+        return Fail("path too long: %s", path);
+    _snprintf(tempPath, sizeof tempPath - 1, "%s.tmp", path);
+    FILE* file = fopen(tempPath, "wb");
+    if (!file)
+        return Fail("cannot create %s", tempPath);
+    BOOL success = fwrite(data, 1, size, file) == size;
+    success = fclose(file) == 0 && success;
+#ifdef _WIN32
+    success = success && MoveFileEx(tempPath, path, MOVEFILE_REPLACE_EXISTING);
+#else
+    success = success && rename(tempPath, path) == 0;
+#endif
+    if (!success)
+    {
+        remove(tempPath);
+        return Fail("cannot write %s", path);
+    }
+    return TRUE;
+}
+
+static int Usage(void)
+{
+    fprintf(stderr, "usage: ry2provision [-t threads] [-c capacity] [-l] <manifest> <image>\n"
+        "  manifest lines: <HID> <version> <protection> <seed>, \"-\" reads standard input\n"
+        "  -t  threads computing the UIDs (default: one per processor)\n"
+        "  -c  dongles the image has room for (default 32 or the dongle count, up to 65536)\n"
+        "  -l  list the handle, HID and UID of every dongle\n");
+    return 2;
+}
+
+int main(int argc, char** argv)
+{
+    int threadCount = GetProcessorCount();
+    DWORD capacity = RY2_DEFAULT_DONGLES;
+    BOOL list = FALSE;
+    int i = 1;
+    for (; i < argc && argv[i][0] == '-' && argv[i][1]; i++)
+    {
+        if (strcmp(argv[i], "-l") == 0)
+            list = TRUE;
+        else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc)
+            threadCount = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc)
+            capacity = (DWORD)strtoul(argv[++i], NULL, 0);
+        else
+            return Usage();
+    }
+    if (argc - i != 2 || threadCount <= 0 || capacity == 0 || capacity > RY2_MAX_DONGLES)
+        return Usage();
+    if (threadCount > PROVISION_MAX_THREADS)
+        threadCount = PROVISION_MAX_THREADS;
+    const DWORD started = GetTickCount();
+    ManifestEntry* entries = NULL;
+    int count = 0;
+    if (!ReadManifest(argv[i], &entries, &count) || !CheckUniqueHIDs(argv[i], entries, count))
+    {
+        free(entries);
+        return 1;
+    }
+    if (capacity < (DWORD)count)
+        capacity = (DWORD)count;
+    const SIZE_T size = RY2_FILE_IMAGE_SIZE(capacity);
+    RY2_FileImage* image = (RY2_FileImage*)calloc(1, size);
+    WorkRange* ranges = (WorkRange*)calloc(threadCount, sizeof(WorkRange));
+    if (!image || !ranges)
+    {
+        free(entries);
+        free(image);
+        free(ranges);
+        Fail("out of memory building %s", argv[i + 1]);
+        return 1;
+    }
+    image->magic = RY2_FILE_MAGIC;
+    image->version = RY2_FILE_VERSION;
+    image->count = (DWORD)count;
+    image->capacity = capacity;
+    if (threadCount > count / PROVISION_CHUNK + 1)
+        threadCount = count / PROVISION_CHUNK + 1;
+    Pool pool = { entries, image, ranges, threadCount };
+    const int stolen = RunPool(&pool, (DWORD)count);
+    image->indexChecksum = (LONG)ChecksumFileIndex(image, image->count);
+    image->blocksChecksum = (LONG)ChecksumFileBlocks(image, image->count);
+    const BOOL success = WriteWholeFile(argv[i + 1], image, size);
+    if (success && list)
+    {
+        for (int d = 0; d < count; d++)
+            printf("%d 0x%08X 0x%08X\n", d, (unsigned)image->dongles[d].info[0], (unsigned)image->dongles[d].info[1]);
+    }
+    if (success)
+        fprintf(stderr, "ry2provision: %d dongle(s) written to %s in %u ms by %d thread(s), %d steal(s)\n",
+            count, argv[i + 1], (unsigned)(GetTickCount() - started), threadCount, stolen);
+    free(ranges);
+    free(image);
+    free(entries);
+    return success ? 0 : 1;
+}
@@ -0,0 +1,682 @@
+/*
+ * This file is part of the Rockey2 EMU project authored by Brian218.
+ *
+ * Copyright (C) 2026 Brian218 (https://github.com/brian218)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/*
+ * Replays the call traces that processes running with ROCKEY2_TRACE write:
+ *
+ *     ry2replay [-m original|max] [-x copies] [-l library] trace...
+ *
+ * Every traced process becomes a forked process and every traced thread a
+ * thread of it, which issues the thread's calls in their original order
+ * against the storage the ROCKEY2_* settings select, so replay against a
+ * copy: the trace holds handles and block indexes, not data. -m original
+ * (the default) keeps the recorded spacing between calls, -m max issues
+ * them back to back, and -x runs that many copies of the whole trace at
+ * once. Each process first finds the dongles and opens the handles it
+ * uses, outside the measurement, since the traced process may have inherited
+ * them. Written data, transform input and seeds are synthesized with the
+ * recorded sizes, and a wait lasts at most as long as the recorded one.
+ * The latency of every call is compared with the recorded latency, and
+ * results that differ from the recorded ones are counted. POSIX only.
+ */
+
+#include <dlfcn.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include "platform.h"
+#include "storage.h"
+#include "stats.h"
+#include "trace.h"
+
+#define REPLAY_MAX_PROCESSES 256
+#define REPLAY_SUB_BUCKETS 16 // Histogram buckets per power of two, as in ry2bench
+#define REPLAY_BUCKETS (64 * REPLAY_SUB_BUCKETS)
+#define REPLAY_MAX_BATCH 256
+#define REPLAY_TRANSFORM_SIZE 32 // The longest transform input
+#define REPLAY_MAX_SEED 65 // One past the longest seed, for the error case
+#define REPLAY_SPIN_NS 200000 // Sleep until this close to a scheduled call, then spin
+
+typedef int (*RY2_FindFunc)(void);
+typedef int (*RY2_OpenFunc)(int mode, DWORD uid, DWORD* hid);
+typedef void (*RY2_CloseFunc)(int handle);
+typedef int (*RY2_GenUIDFunc)(int handle, DWORD* uid, char* seed, int isProtect);
+typedef int (*RY2_BlockFunc)(int handle, int block_index, char* buffer512);
+typedef int (*RY2_BlocksFunc)(int handle, DWORD block_mask, char* buffer2560);
+typedef int (*RY2_HandleFunc)(int handle);
+typedef int (*RY2_TransformFunc)(int handle, int len, BYTE* data);
+typedef int (*RY2_TransformBatchFunc)(int handle, int count, int* lens, BYTE** datas);
+typedef int (*RY2_ReadIfChangedFunc)(int handle, int block_index, DWORD* generation, char* buffer512);
+typedef int (*RY2_WaitBlockChangeFunc)(int handle, int block_index, DWORD generation, DWORD timeout_ms);
+// The results are not inspected, so the output structures stay opaque.
+typedef int (*RY2_GetWriteStatsFunc)(int handle, int block_index, void* stats);
+typedef int (*RY2_MapBlocksFunc)(int handle, void* map);
+
+// The library entry points, resolved in each replaying process.
+static struct
+{
+    RY2_FindFunc Find;
+    RY2_OpenFunc Open;
+    RY2_CloseFunc Close;
+    RY2_GenUIDFunc GenUID;
+    RY2_BlockFunc Read;
+    RY2_BlockFunc Write;
+    RY2_BlocksFunc ReadBlocks;
+    RY2_BlocksFunc WriteBlocks;
+    RY2_HandleFunc GetVersion;
+    RY2_TransformFunc Transform;
+    RY2_TransformBatchFunc TransformBatch;
+    RY2_HandleFunc Flush;
+    RY2_ReadIfChangedFunc ReadIfChanged;
+    RY2_WaitBlockChangeFunc WaitBlockChange;
+    RY2_GetWriteStatsFunc GetWriteStats;
+    RY2_MapBlocksFunc MapBlocks;
+    RY2_HandleFunc UnmapBlocks;
+} Api;
+
+// In RY2_StatExport order.
+static const char* const ExportNames[RY2_STAT_EXPORT_COUNT] =
+{
+    "RY2_Find", "RY2_Open", "RY2_Close", "RY2_GenUID", "RY2_Read", "RY2_Write", "RY2_ReadBlocks",
+    "RY2_WriteBlocks", "RY2_GetVersion", "RY2_Transform", "RY2_TransformBatch", "RY2_Flush",
+    "RY2_ReadIfChanged", "RY2_WaitBlockChange", "RY2_GetWriteStats", "RY2_MapBlocks", "RY2_UnmapBlocks"
+};
+
+typedef struct
+{
+    volatile LONGLONG calls;
+    volatile LONGLONG differing; // Results other than the recorded ones
+    volatile LONGLONG totalNs;
+    volatile LONGLONG histogram[REPLAY_BUCKETS];
+} ExportResult;
+
+// Shared by the parent and every replaying process.
+typedef struct
+{
+    volatile LONG ready;
+    volatile LONG go;
+    volatile LONG failed;
+    UINT64 start;
+    volatile LONGLONG lateCalls; // Calls issued after their scheduled time
+    volatile LONGLONG lateNs;
+    ExportResult exports[RY2_STAT_EXPORT_COUNT];
+} RunState;
+
+// The calls of one traced thread, in order.
+typedef struct
+{
+    const RY2_TraceRecord* records;
+    SIZE_T count;
+} Stream;
+
+typedef struct
+{
+    const char* path;
+    DWORD processId;
+    RY2_TraceRecord* records;
+    SIZE_T count;
+    Stream* streams;
+    int streamCount;
+} TraceProcess;
+
+typedef struct Player Player;
+
+struct Player
+{
+    RunState* run;
+    const Stream* stream;
+    ExportResult* results;
+    Player* siblings; // The players of the same process
+    int siblingCount;
+    volatile UINT64 next; // The recorded time of the next call, ~0 when done
+    UINT64 counter;
+    char blocks[RY2_BLOCK_COUNT * RY2_BLOCK_SIZE];
+    BYTE data[REPLAY_MAX_BATCH][REPLAY_TRANSFORM_SIZE];
+    BYTE* datas[REPLAY_MAX_BATCH];
+    int lens[REPLAY_MAX_BATCH];
+    char seed[REPLAY_MAX_SEED + 1];
+};
+
+static BOOL MaxSpeed = FALSE;
+static UINT64 TraceStart = ~(UINT64)0;
+static UINT64 TraceEnd = 0;
+static const RY2_TraceRecord** Opens = NULL; // A successful RY2_Open of every handle
+static int OpenCount = 0;
+
+static UINT64 Now(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (UINT64)now.tv_sec * 1000000000 + (UINT64)now.tv_nsec;
+}
+
+static int GetBucket(UINT64 ns)
+{
+    if (ns < REPLAY_SUB_BUCKETS)
+        return (int)ns;
+    const int exponent = 63 - __builtin_clzll(ns); // at least 4
+    return (exponent - 3) * REPLAY_SUB_BUCKETS + (int)((ns >> (exponent - 4)) & (REPLAY_SUB_BUCKETS - 1));
+}
+
+// The middle of a bucket's range.
+static UINT64 GetBucketValue(int bucket)
+{
+    if (bucket < REPLAY_SUB_BUCKETS)
+        return (UINT64)bucket;
+    const int exponent = bucket / REPLAY_SUB_BUCKETS + 3;
+    const UINT64 low = (UINT64)(REPLAY_SUB_BUCKETS + bucket % REPLAY_SUB_BUCKETS) << (exponent - 4);
+    return low + ((UINT64)1 << (exponent - 4)) / 2;
+}
+
+static UINT64 GetPercentile(const ExportResult* result, double share)
+{
+    const LONGLONG rank = (LONGLONG)(share * result->calls + 0.5);
+    LONGLONG seen = 0;
+    for (int b = 0; b < REPLAY_BUCKETS; b++)
+    {
+        seen += result->histogram[b];
+        if (seen >= rank && seen)
+            return GetBucketValue(b);
+    }
+    return 0;
+}
+
+static int CompareRecords(const void* left, const void* right)
+{
+    const RY2_TraceRecord* a = (const RY2_TraceRecord*)left;
+    const RY2_TraceRecord* b = (const RY2_TraceRecord*)right;
+    if (a->threadId != b->threadId)
+        return a->threadId < b->threadId ? -1 : 1;
+    return a->timestamp < b->timestamp ? -1 : a->timestamp > b->timestamp;
+}
+
+// Reads a trace file and splits it into the streams of its threads.
+static BOOL LoadTrace(const char* path, TraceProcess* process)
+{
+    FILE* file = fopen(path, "rb");
+    if (!file)
+    {
+        fprintf(stderr, "ry2replay: cannot open %s\n", path);
+        return FALSE;
+    }
+    RY2_TraceHeader header;
+    if (fread(&header, sizeof header, 1, file) != 1 || header.magic != RY2_TRACE_MAGIC || header.version != RY2_TRACE_VERSION)
+    {
+        fprintf(stderr, "ry2replay: %s is not a trace of this version\n", path);
+        fclose(file);
+        return FALSE;
+    }
+    SIZE_T capacity = 4096;
+    process->path = path;
+    process->processId = header.processId;
+    process->records = (RY2_TraceRecord*)malloc(capacity * sizeof(RY2_TraceRecord));
+    process->count = 0;
+    while (process->records)
+    {
+        process->count += fread(process->records + process->count, sizeof(RY2_TraceRecord), capacity - process->count, file);
+        if (process->count < capacity)
+            break;
+        capacity *= 2;
+        process->records = (RY2_TraceRecord*)realloc(process->records, capacity * sizeof(RY2_TraceRecord));
+    }
+    fclose(file);
+    if (!process->records)
+        return FALSE;
+    if (header.dropped)
+        fprintf(stderr, "ry2replay: %s lost %u call(s) to a full trace buffer\n", path, (unsigned)header.dropped);
+    qsort(process->records, process->count, sizeof(RY2_TraceRecord), CompareRecords);
+    process->streams = (Stream*)calloc(process->count ? process->count : 1, sizeof(Stream));
+    process->streamCount = 0;
+    if (!process->streams)
+        return FALSE;
+    for (SIZE_T i = 0; i < process->count; i++)
+    {
+        const RY2_TraceRecord* record = &process->records[i];
+        if (record->exportIndex >= RY2_STAT_EXPORT_COUNT)
+        {
+            fprintf(stderr, "ry2replay: %s holds an unknown call\n", path);
+            return FALSE;
+        }
+        if (record->exportIndex == RY2_STAT_OPEN && record->result >= 0)
+        {
+            int o = 0;
+            while (o < OpenCount && Opens[o]->result != record->result)
+                o++;
+            if (o == OpenCount)
+            {
+                Opens = (const RY2_TraceRecord**)realloc((void*)Opens, (OpenCount + 1) * sizeof *Opens);
+                if (!Opens)
+                    return FALSE;
+                Opens[OpenCount++] = record;
+            }
+        }
+        if (!i || record->threadId != record[-1].threadId)
+            process->streams[process->streamCount++].records = record;
+        process->streams[process->streamCount - 1].count++;
+        if (record->timestamp < TraceStart)
+            TraceStart = record->timestamp;
+        if (record->timestamp + record->duration > TraceEnd)
+            TraceEnd = record->timestamp + record->duration;
+    }
+    return TRUE;
+}
+
+static BOOL LoadRockey2(const char* path)
+{
+    void* library = dlopen(path, RTLD_NOW);
+    if (!library)
+    {
+        fprintf(stderr, "ry2replay: %s\n", dlerror());
+        return FALSE;
+    }
+    Api.Find = (RY2_FindFunc)dlsym(library, "RY2_Find");
+    Api.Open = (RY2_OpenFunc)dlsym(library, "RY2_Open");
+    Api.Close = (RY2_CloseFunc)dlsym(library, "RY2_Close");
+    Api.GenUID = (RY2_GenUIDFunc)dlsym(library, "RY2_GenUID");
+    Api.Read = (RY2_BlockFunc)dlsym(library, "RY2_Read");
+    Api.Write = (RY2_BlockFunc)dlsym(library, "RY2_Write");
+    Api.ReadBlocks = (RY2_BlocksFunc)dlsym(library, "RY2_ReadBlocks");
+    Api.WriteBlocks = (RY2_BlocksFunc)dlsym(library, "RY2_WriteBlocks");
+    Api.GetVersion = (RY2_HandleFunc)dlsym(library, "RY2_GetVersion");
+    Api.Transform = (RY2_TransformFunc)dlsym(library, "RY2_Transform");
+    Api.TransformBatch = (RY2_TransformBatchFunc)dlsym(library, "RY2_TransformBatch");
+    Api.Flush = (RY2_HandleFunc)dlsym(library, "RY2_Flush");
+    Api.ReadIfChanged = (RY2_ReadIfChangedFunc)dlsym(library, "RY2_ReadIfChanged");
+    Api.WaitBlockChange = (RY2_WaitBlockChangeFunc)dlsym(library, "RY2_WaitBlockChange");
+    Api.GetWriteStats = (RY2_GetWriteStatsFunc)dlsym(library, "RY2_GetWriteStats");
+    Api.MapBlocks = (RY2_MapBlocksFunc)dlsym(library, "RY2_MapBlocks");
+    Api.UnmapBlocks = (RY2_HandleFunc)dlsym(library, "RY2_UnmapBlocks");
+    if (!Api.Find || !Api.Open || !Api.Close || !Api.GenUID || !Api.Read || !Api.Write || !Api.ReadBlocks ||
+        !Api.WriteBlocks || !Api.GetVersion || !Api.Transform || !Api.TransformBatch || !Api.Flush ||
+        !Api.ReadIfChanged || !Api.WaitBlockChange || !Api.GetWriteStats || !Api.MapBlocks || !Api.UnmapBlocks)
+    {
+        fprintf(stderr, "ry2replay: %s lacks an entry point\n", path);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+// Issues one recorded call with synthesized data of the recorded size.
+static int ReplayCall(Player* player, const RY2_TraceRecord* record)
+{
+    const int handle = record->handle;
+    const DWORD* arguments = record->arguments;
+    switch ((RY2_StatExport)record->exportIndex)
+    {
+    case RY2_STAT_FIND:
+        return Api.Find();
+    case RY2_STAT_OPEN:
+    {
+        DWORD hid = arguments[1];
+        return Api.Open(handle, arguments[0], &hid);
+    }
+    case RY2_STAT_CLOSE:
+        Api.Close(handle);
+        return 0;
+    case RY2_STAT_GENUID:
+    {
+        const DWORD length = arguments[1] < REPLAY_MAX_SEED ? arguments[1] : REPLAY_MAX_SEED;
+        memset(player->seed, 'a' + (int)(player->counter++ % 26), length);
+        player->seed[length] = '\0';
+        DWORD uid = 0;
+        return Api.GenUID(handle, &uid, player->seed, (int)arguments[0]);
+    }
+    case RY2_STAT_READ:
+        return Api.Read(handle, (int)arguments[0], player->blocks);
+    case RY2_STAT_WRITE:
+        // A new value every time, so that no write is elided as unchanged.
+        memset(player->blocks, (int)(player->counter++ & 0xFF), RY2_BLOCK_SIZE);
+        return Api.Write(handle, (int)arguments[0], player->blocks);
+    case RY2_STAT_READ_BLOCKS:
+        return Api.ReadBlocks(handle, arguments[0], player->blocks);
+    case RY2_STAT_WRITE_BLOCKS:
+        memset(player->blocks, (int)(player->counter++ & 0xFF), sizeof player->blocks);
+        return Api.WriteBlocks(handle, arguments[0], player->blocks);
+    case RY2_STAT_GET_VERSION:
+        return Api.GetVersion(handle);
+    case RY2_STAT_TRANSFORM:
+    {
+        const int len = (int)arguments[0] < 0 ? 0 : (int)arguments[0];
+        return Api.Transform(handle, len <= REPLAY_TRANSFORM_SIZE ? len : REPLAY_TRANSFORM_SIZE + 1, player->data[0]);
+    }
+    case RY2_STAT_TRANSFORM_BATCH:
+    {
+        const int count = (int)arguments[0] < REPLAY_MAX_BATCH ? (int)arguments[0] : REPLAY_MAX_BATCH;
+        return Api.TransformBatch(handle, count, player->lens, player->datas);
+    }
+    case RY2_STAT_FLUSH:
+        return Api.Flush(handle);
+    case RY2_STAT_READ_IF_CHANGED:
+    {
+        DWORD generation = arguments[1];
+        return Api.ReadIfChanged(handle, (int)arguments[0], &generation, player->blocks);
+    }
+    case RY2_STAT_WAIT_BLOCK_CHANGE:
+    {
+        const DWORD waited = (record->duration + 999999) / 1000000;
+        return Api.WaitBlockChange(handle, (int)arguments[0], arguments[1], arguments[2] < waited ? arguments[2] : waited);
+    }
+    case RY2_STAT_GET_WRITE_STATS:
+        return Api.GetWriteStats(handle, (int)arguments[0], player->blocks);
+    case RY2_STAT_MAP_BLOCKS:
+    {
+        void* map[2];
+        return Api.MapBlocks(handle, map);
+    }
+    case RY2_STAT_UNMAP_BLOCKS:
+        return Api.UnmapBlocks(handle);
+    default:
+        return 0;
+    }
+}
+
+// Waits for the scheduled time of a call, sleeping for most of the way.
+static void WaitUntil(UINT64 target)
+{
+    for (;;)
+    {
+        const UINT64 now = Now();
+        if (now >= target)
+            return;
+        if (target - now > REPLAY_SPIN_NS)
+        {
+            const UINT64 sleepNs = target - now - REPLAY_SPIN_NS / 2;
+            const struct timespec duration = { (time_t)(sleepNs / 1000000000), (long)(sleepNs % 1000000000) };
+            nanosleep(&duration, NULL);
+        }
+        else
+            YieldProcessor();
+    }
+}
+
+/*
+ * RY2_Find, RY2_Open and RY2_Close change what the other threads' calls see,
+ * so they wait until every other thread of the process has passed the time
+ * they were recorded at; a thread running late or at maximum speed would
+ * otherwise close a handle that earlier calls still use.
+ */
+static void WaitForSiblings(const Player* player, UINT64 timestamp)
+{
+    for (int s = 0; s < player->siblingCount; s++)
+    {
+        const Player* sibling = &player->siblings[s];
+        while (sibling != player && sibling->next < timestamp)
+            sched_yield();
+    }
+}
+
+static void* RunPlayer(void* parameter)
+{
+    Player* player = (Player*)parameter;
+    RunState* run = player->run;
+    ExportResult* results = player->results;
+    LONGLONG lateCalls = 0;
+    LONGLONG lateNs = 0;
+    InterlockedIncrement(&run->ready);
+    while (!run->go)
+        YieldProcessor();
+    for (SIZE_T i = 0; i < player->stream->count; i++)
+    {
+        const RY2_TraceRecord* record = &player->stream->records[i];
+        player->next = record->timestamp;
+        if (record->exportIndex == RY2_STAT_FIND || record->exportIndex == RY2_STAT_OPEN || record->exportIndex == RY2_STAT_CLOSE)
+            WaitForSiblings(player, record->timestamp);
+        if (!MaxSpeed)
+        {
+            const UINT64 target = run->start + (record->timestamp - TraceStart);
+            WaitUntil(target);
+            const UINT64 late = Now() - target;
+            if (late > REPLAY_SPIN_NS)
+            {
+                lateCalls++;
+                lateNs += (LONGLONG)late;
+            }
+        }
+        const UINT64 t0 = Now();
+        const int ret = ReplayCall(player, record);
+        const UINT64 ns = Now() - t0;
+        ExportResult* result = &results[record->exportIndex];
+        result->calls++;
+        result->differing += ret != record->result;
+        result->totalNs += (LONGLONG)ns;
+        result->histogram[GetBucket(ns)]++;
+    }
+    player->next = ~(UINT64)0;
+    InterlockedExchangeAdd64(&run->lateCalls, lateCalls);
+    InterlockedExchangeAdd64(&run->lateNs, lateNs);
+    return NULL;
+}
+
+static void AddResults(ExportResult* total, const ExportResult* results)
+{
+    for (int e = 0; e < RY2_STAT_EXPORT_COUNT; e++)
+    {
+        InterlockedExchangeAdd64(&total[e].calls, results[e].calls);
+        InterlockedExchangeAdd64(&total[e].differing, results[e].differing);
+        InterlockedExchangeAdd64(&total[e].totalNs, results[e].totalNs);
+        for (int b = 0; b < REPLAY_BUCKETS; b++)
+        {
+            if (results[e].histogram[b])
+                InterlockedExchangeAdd64(&total[e].histogram[b], results[e].histogram[b]);
+        }
+    }
+}
+
+/*
+ * Brings a replaying process to the state the traced one started in: a
+ * traced process may have inherited its handles, and at maximum speed a
+ * thread may run ahead of the thread that opened them. So the dongles are
+ * found, and every handle the process uses is opened as it was somewhere in
+ * the traces, before the clock starts.
+ */
+static void PrepareProcess(const TraceProcess* process)
+{
+    Api.Find();
+    for (int o = 0; o < OpenCount; o++)
+    {
+        const RY2_TraceRecord* open = Opens[o];
+        SIZE_T i = 0;
+        while (i < process->count && (process->records[i].handle != open->result ||
+            process->records[i].exportIndex == RY2_STAT_FIND || process->records[i].exportIndex == RY2_STAT_OPEN))
+            i++;
+        DWORD hid = open->arguments[1];
+        if (i < process->count)
+            Api.Open(open->handle, open->arguments[0], &hid);
+    }
+}
+
+// The body of a replaying process: one thread per stream of the traced process.
+static int RunProcess(RunState* run, const TraceProcess* process, const char* library)
+{
+    Player* players = (Player*)calloc(process->streamCount, sizeof(Player));
+    ExportResult* results = (ExportResult*)calloc((SIZE_T)process->streamCount * RY2_STAT_EXPORT_COUNT, sizeof(ExportResult));
+    pthread_t* threadIds = (pthread_t*)calloc(process->streamCount, sizeof(pthread_t));
+    if (!players || !results || !threadIds || !LoadRockey2(library))
+    {
+        InterlockedExchange(&run->failed, 1);
+        for (int i = 0; i < process->streamCount; i++)
+            InterlockedIncrement(&run->ready);
+        return 1;
+    }
+    PrepareProcess(process);
+    for (int i = 0; i < process->streamCount; i++)
+    {
+        Player* player = &players[i];
+        player->run = run;
+        player->stream = &process->streams[i];
+        player->results = &results[i * RY2_STAT_EXPORT_COUNT];
+        player->siblings = players;
+        player->siblingCount = process->streamCount;
+        player->next = process->streams[i].records[0].timestamp;
+        for (int d = 0; d < REPLAY_MAX_BATCH; d++)
+        {
+            memset(player->data[d], 0x5A ^ d, REPLAY_TRANSFORM_SIZE);
+            player->datas[d] = player->data[d];
+            player->lens[d] = REPLAY_TRANSFORM_SIZE;
+        }
+        pthread_create(&threadIds[i], NULL, RunPlayer, player);
+    }
+    for (int i = 0; i < process->streamCount; i++)
+    {
+        pthread_join(threadIds[i], NULL);
+        AddResults(run->exports, players[i].results);
+    }
+    free(threadIds);
+    free(results);
+    free(players);
+    return 0;
+}
+
+// Prints the replayed latencies next to the recorded ones.
+static void Report(const RunState* run, const TraceProcess* processes, int processCount, int copies, double wallSeconds)
+{
+    static ExportResult recorded[RY2_STAT_EXPORT_COUNT];
+    for (int p = 0; p < processCount; p++)
+    {
+        for (SIZE_T i = 0; i < processes[p].count; i++)
+        {
+            const RY2_TraceRecord* record = &processes[p].records[i];
+            ExportResult* result = &recorded[record->exportIndex];
+            result->calls += copies;
+            result->totalNs += (LONGLONG)record->duration * copies;
+            result->histogram[GetBucket(record->duration)] += copies;
+        }
+    }
+    printf("%-20s %10s %10s %9s %9s %9s %10s %9s %9s\n", "export", "calls", "mean ns", "p50 ns", "p99 ns", "p999 ns",
+        "rec. mean", "rec. p99", "differing");
+    for (int e = 0; e < RY2_STAT_EXPORT_COUNT; e++)
+    {
+        const ExportResult* result = &run->exports[e];
+        if (!result->calls)
+            continue;
+        printf("%-20s %10lld %10.0f %9llu %9llu %9llu %10.0f %9llu %9lld\n", ExportNames[e], (long long)result->calls,
+            (double)result->totalNs / result->calls, (unsigned long long)GetPercentile(result, 0.5),
+            (unsigned long long)GetPercentile(result, 0.99), (unsigned long long)GetPercentile(result, 0.999),
+            recorded[e].calls ? (double)recorded[e].totalNs / recorded[e].calls : 0,
+            (unsigned long long)GetPercentile(&recorded[e], 0.99), (long long)result->differing);
+    }
+    printf("replayed in %.3f s, recorded over %.3f s", wallSeconds, (TraceEnd - TraceStart) / 1e9);
+    if (!MaxSpeed)
+        printf("; %lld call(s) started late, by %.0f us on average", (long long)run->lateCalls,
+            run->lateCalls ? run->lateNs / 1e3 / run->lateCalls : 0);
+    printf("\n");
+    fflush(stdout);
+}
+
+static int Usage(void)
+{
+    fprintf(stderr, "usage: ry2replay [-m original|max] [-x copies] [-l library] trace...\n"
+        "  -m  original keeps the recorded spacing of the calls (default), max issues them back to back\n"
+        "  -x  copies of the whole trace replayed at once (default 1)\n"
+        "  -l  library to load (default ./libRockey2.so)\n"
+        "  replays against the storage the ROCKEY2_* settings select\n");
+    return 2;
+}
+
+int main(int argc, char** argv)
+{
+    const char* library = "./libRockey2.so";
+    int copies = 1;
+    int i = 1;
+    for (; i < argc && argv[i][0] == '-'; i++)
+    {
+        if (argv[i][2] || i + 1 >= argc)
+            return Usage();
+        const char* value = argv[++i];
+        switch (argv[i - 1][1])
+        {
+        case 'm':
+            if (strcmp(value, "max") == 0)
+                MaxSpeed = TRUE;
+            else if (strcmp(value, "original") != 0)
+                return Usage();
+            break;
+        case 'x':
+            copies = atoi(value);
+            break;
+        case 'l':
+            library = value;
+            break;
+        default:
+            return Usage();
+        }
+    }
+    const int processCount = argc - i;
+    if (processCount <= 0 || copies <= 0 || processCount * copies > REPLAY_MAX_PROCESSES)
+        return Usage();
+    TraceProcess* processes = (TraceProcess*)calloc(processCount, sizeof(TraceProcess));
+    if (!processes)
+        return 1;
+    LONGLONG calls = 0;
+    int threads = 0;
+    for (int p = 0; p < processCount; p++)
+    {
+        if (!LoadTrace(argv[i + p], &processes[p]))
+            return 1;
+        calls += (LONGLONG)processes[p].count;
+        threads += processes[p].streamCount;
+    }
+    if (!calls)
+    {
+        fprintf(stderr, "ry2replay: the traces hold no calls\n");
+        return 1;
+    }
+    printf("# %d process(es), %d thread(s), %lld call(s); %s speed, %d cop%s\n", processCount, threads, (long long)calls,
+        MaxSpeed ? "maximum" : "original", copies, copies == 1 ? "y" : "ies");
+    // The replay itself is not traced.
+    unsetenv("ROCKEY2_TRACE");
+    RunState* run = (RunState*)mmap(NULL, sizeof(RunState), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (run == MAP_FAILED)
+        return 1;
+    fflush(stdout);
+    pid_t children[REPLAY_MAX_PROCESSES];
+    int started = 0;
+    for (; started < processCount * copies; started++)
+    {
+        children[started] = fork();
+        if (children[started] == 0)
+            _exit(RunProcess(run, &processes[started % processCount], library));
+        if (children[started] < 0)
+            break;
+    }
+    BOOL success = started == processCount * copies;
+    while (success && run->ready < threads * copies)
+        usleep(1000);
+    success = success && !run->failed;
+    // Leave the processes time to reach their first calls before the schedule starts.
+    run->start = Now() + 10000000;
+    MemoryBarrier();
+    InterlockedExchange(&run->go, 1);
+    for (int c = 0; c < started; c++)
+    {
+        int status = 0;
+        waitpid(children[c], &status, 0);
+        success = success && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    }
+    const double wallSeconds = (Now() - run->start) / 1e9;
+    if (success)
+        Report(run, processes, processCount, copies, wallSeconds);
+    munmap(run, sizeof(RunState));
+    return success ? 0 : 1;
+}
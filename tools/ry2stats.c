@@ -0,0 +1,180 @@
+/*
+ * This file is part of the Rockey2 EMU project authored by Brian218.
+ *
+ * Copyright (C) 2026 Brian218 (https://github.com/brian218)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/*
+ * Prints the statistics that processes running with ROCKEY2_STATS=1 collect
+ * in the ROCKEY2_STATS shared-memory segment:
+ *
+ *     ry2stats [-i seconds [-n count]]
+ *
+ * Without -i it prints the totals since the segment was created. With -i it
+ * prints what changed during each interval, count times or until stopped.
+ * The segment is only read, so the tool never disturbs the processes.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "platform.h"
+#include "stats.h"
+
+// In RY2_StatExport order.
+static const char* const ExportNames[RY2_STAT_EXPORT_COUNT] =
+{
+    "RY2_Find", "RY2_Open", "RY2_Close", "RY2_GenUID", "RY2_Read", "RY2_Write", "RY2_ReadBlocks",
+    "RY2_WriteBlocks", "RY2_GetVersion", "RY2_Transform", "RY2_TransformBatch", "RY2_Flush",
+    "RY2_ReadIfChanged", "RY2_WaitBlockChange", "RY2_GetWriteStats", "RY2_MapBlocks", "RY2_UnmapBlocks"
+};
+
+// The stripes of a segment added up, or the difference of two such sums.
+typedef struct
+{
+    LONGLONG calls[RY2_STAT_EXPORT_COUNT];
+    LONGLONG totalNs[RY2_STAT_EXPORT_COUNT];
+    LONGLONG buckets[RY2_STAT_EXPORT_COUNT][RY2_STATS_BUCKETS];
+    LONGLONG counters[RY2_STAT_COUNTER_COUNT];
+} StatsTotals;
+
+static void SumStats(const RY2_StatsShared* stats, StatsTotals* totals)
+{
+    memset(totals, 0, sizeof *totals);
+    for (int s = 0; s < RY2_STATS_STRIPES; s++)
+    {
+        const RY2_StatsStripe* stripe = &stats->stripes[s];
+        for (int e = 0; e < RY2_STAT_EXPORT_COUNT; e++)
+        {
+            totals->calls[e] += stripe->exports[e].calls;
+            totals->totalNs[e] += stripe->exports[e].totalNs;
+            for (int b = 0; b < RY2_STATS_BUCKETS; b++)
+                totals->buckets[e][b] += stripe->exports[e].buckets[b];
+        }
+        for (int c = 0; c < RY2_STAT_COUNTER_COUNT; c++)
+            totals->counters[c] += stripe->counters[c];
+    }
+}
+
+static void SubtractStats(StatsTotals* totals, const StatsTotals* before)
+{
+    LONGLONG* values = (LONGLONG*)totals;
+    const LONGLONG* previous = (const LONGLONG*)before;
+    for (SIZE_T i = 0; i < sizeof *totals / sizeof(LONGLONG); i++)
+        values[i] -= previous[i];
+}
+
+// The upper bound of the bucket holding the given share of the calls.
+static LONGLONG GetPercentile(const LONGLONG* buckets, LONGLONG calls, double share)
+{
+    const LONGLONG rank = (LONGLONG)(share * calls + 0.5);
+    LONGLONG seen = 0;
+    for (int b = 0; b < RY2_STATS_BUCKETS; b++)
+    {
+        seen += buckets[b];
+        if (seen >= rank && seen > 0)
+            return ((LONGLONG)2 << b) - 1;
+    }
+    return 0;
+}
+
+static double GetRatio(LONGLONG part, LONGLONG whole)
+{
+    return whole > 0 ? (double)part / whole : 0;
+}
+
+static void PrintStats(const StatsTotals* totals, double seconds)
+{
+    printf("%-20s %12s %10s %10s %10s %10s %11s\n", "export", "calls", seconds > 0 ? "calls/s" : "", "mean ns", "p50 ns <=",
+        "p99 ns <=", "p999 ns <=");
+    for (int e = 0; e < RY2_STAT_EXPORT_COUNT; e++)
+    {
+        const LONGLONG calls = totals->calls[e];
+        if (calls <= 0)
+            continue;
+        char rate[20 + 1] = { 0 }; // 20 digits + '\0'
+        if (seconds > 0)
+            _snprintf(rate, sizeof rate - 1, "%.0f", calls / seconds);
+        printf("%-20s %12lld %10s %10.0f %10lld %10lld %11lld\n", ExportNames[e], (long long)calls, rate,
+            GetRatio(totals->totalNs[e], calls), (long long)GetPercentile(totals->buckets[e], calls, 0.5),
+            (long long)GetPercentile(totals->buckets[e], calls, 0.99), (long long)GetPercentile(totals->buckets[e], calls, 0.999));
+    }
+    const LONGLONG* c = totals->counters;
+    printf("lock waits           %12lld, mean wait %.0f ns\n", (long long)c[RY2_STAT_LOCK_WAITS],
+        GetRatio(c[RY2_STAT_LOCK_WAIT_NS], c[RY2_STAT_LOCK_WAITS]));
+    printf("storage reads        %12lld, %lld bytes\n", (long long)c[RY2_STAT_STORAGE_READS], (long long)c[RY2_STAT_STORAGE_READ_BYTES]);
+    printf("storage writes       %12lld, %lld bytes\n", (long long)c[RY2_STAT_STORAGE_WRITES], (long long)c[RY2_STAT_STORAGE_WRITE_BYTES]);
+    printf("storage time         %12lld ns, mean %.0f ns per operation\n", (long long)c[RY2_STAT_STORAGE_NS],
+        GetRatio(c[RY2_STAT_STORAGE_NS], c[RY2_STAT_STORAGE_READS] + c[RY2_STAT_STORAGE_WRITES]));
+    printf("block cache          %12lld hits, %lld misses (%.1f%% hits)\n", (long long)c[RY2_STAT_BLOCK_CACHE_HITS],
+        (long long)c[RY2_STAT_BLOCK_CACHE_MISSES],
+        100 * GetRatio(c[RY2_STAT_BLOCK_CACHE_HITS], c[RY2_STAT_BLOCK_CACHE_HITS] + c[RY2_STAT_BLOCK_CACHE_MISSES]));
+    printf("transform cache      %12lld hits, %lld misses (%.1f%% hits)\n", (long long)c[RY2_STAT_TRANSFORM_CACHE_HITS],
+        (long long)c[RY2_STAT_TRANSFORM_CACHE_MISSES],
+        100 * GetRatio(c[RY2_STAT_TRANSFORM_CACHE_HITS], c[RY2_STAT_TRANSFORM_CACHE_HITS] + c[RY2_STAT_TRANSFORM_CACHE_MISSES]));
+    fflush(stdout);
+}
+
+int main(int argc, char** argv)
+{
+    double seconds = 0;
+    long count = 0;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-i") == 0 && i + 1 < argc)
+            seconds = atof(argv[++i]);
+        else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc)
+            count = atol(argv[++i]);
+        else
+            seconds = -1;
+    }
+    if (seconds < 0 || (count && !seconds))
+    {
+        fprintf(stderr, "usage: ry2stats [-i seconds [-n count]]\n"
+            "  prints the totals, or with -i the changes of every interval (count times)\n");
+        return 2;
+    }
+    HANDLE mapping = NULL;
+    const RY2_StatsShared* stats = (const RY2_StatsShared*)OpenSharedMemoryView("ROCKEY2_STATS", sizeof(RY2_StatsShared), &mapping);
+    if (!stats)
+    {
+        fprintf(stderr, "ry2stats: no statistics yet; run the host with ROCKEY2_STATS=1\n");
+        return 1;
+    }
+    if (stats->magic != RY2_STATS_MAGIC || stats->version != RY2_STATS_VERSION)
+    {
+        fprintf(stderr, "ry2stats: the statistics were written by another version of the library\n");
+        CloseSharedMemory((void*)stats, sizeof(RY2_StatsShared), mapping);
+        return 1;
+    }
+    static StatsTotals before, now;
+    SumStats(stats, &before);
+    if (!seconds)
+        PrintStats(&before, 0);
+    for (long interval = 1; seconds && (!count || interval <= count); interval++)
+    {
+        Sleep((DWORD)(seconds * 1000));
+        SumStats(stats, &now);
+        StatsTotals delta = now;
+        SubtractStats(&delta, &before);
+        before = now;
+        printf("%s--- interval %ld, %.1f s\n", interval > 1 ? "\n" : "", interval, seconds);
+        PrintStats(&delta, seconds);
+    }
+    CloseSharedMemory((void*)stats, sizeof(RY2_StatsShared), mapping);
+    return 0;
+}